@@ -0,0 +1,98 @@
+#ifndef AVATAR
+#define AVATAR
+
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <openpose/headers.hpp>
+
+#include "limbtransform.h"
+
+// avatar view coords, keypoints are drawn in a DISPLAY_WIDTH x DISPLAY_HEIGHT space
+const unsigned int DISPLAY_WIDTH = 1080;
+const unsigned int DISPLAY_HEIGHT = 1080;
+const float LIMB_WIDTH = 50.0f;
+const float FACE_RADIUS = 100.0f;
+// limb textures 0 - 9 and the head
+const unsigned int NUM_PARTS = 11;
+const unsigned int HEAD_PART = 10;
+
+// rectangle limb mappings
+const int limbMap[10][2] = {  {1, 8},     // 0. torso 1
+                              {8, 1},     // 1. torso 2
+                              {3, 2},     // 2. R bicep
+                              {4, 3},     // 3. R forearm
+                              {5, 6},     // 4. L bicep
+                              {6, 7},     // 5. L forearm
+                              {10, 9},    // 6. R thigh
+                              {11, 10},   // 7. R calf
+                              {12, 13},   // 8. L thigh
+                              {13, 14}};  // 9. L calf
+
+
+// avatar dimensions scaled by nose-ear distance
+inline void avatarScale(const op::Array<float>& keypoints, int p, float& faceRadius, float& limbWidth) {
+    faceRadius = FACE_RADIUS;
+    limbWidth = LIMB_WIDTH;
+    if (keypoints[{p, 0, 2}] != 0) {
+
+        glm::vec2 noseLoc = glm::vec2(keypoints[{p, 0, 0}],
+                                      keypoints[{p, 0, 1}]);
+
+        if (keypoints[{p, 17, 2}] != 0) {
+            // right ear detected
+            glm::vec2 earLoc = glm::vec2(keypoints[{p, 17, 0}],
+                                            keypoints[{p, 17, 1}]);
+            faceRadius = glm::distance(noseLoc, earLoc);
+            limbWidth = faceRadius / 2;
+        } else if (keypoints[{p, 18, 2}] != 0) {
+            // left ear detected
+            glm::vec2 earLoc = glm::vec2(keypoints[{p, 18, 0}],
+                                            keypoints[{p, 18, 1}]);
+            faceRadius = glm::distance(noseLoc, earLoc);
+            limbWidth = faceRadius / 2;
+        }
+    }
+}
+
+// head part covering the circle of faceRadius around the nose
+inline LimbInstance headInstance(float noseX, float noseY, float faceRadius) {
+    LimbInstance head = {{2 * faceRadius, 0.0f}, {0.0f, 2 * faceRadius},
+                         {noseX - faceRadius, noseY - faceRadius}, (float)HEAD_PART};
+    return head;
+}
+
+// limbs then head of every person in draw order, without depth ordering,
+// at most maxInstances parts
+inline void avatarInstances(const op::Array<float>& keypoints, LimbBatch& batch,
+                            std::vector<LimbInstance>& instances, size_t maxInstances) {
+    instances.clear();
+    int people = keypoints.getSize(0);
+    std::vector<float> faceRadii(people);
+    batch.clear();
+    for (int p = 0; p < people; p++) {
+        float limbWidth;
+        avatarScale(keypoints, p, faceRadii[p], limbWidth);
+        for (unsigned int i = 0; i < sizeof(limbMap) / sizeof(limbMap[0]); i++) {
+            int idx1 = limbMap[i][0];
+            int idx2 = limbMap[i][1];
+            if (keypoints[{p, idx1, 2}] == 0 || keypoints[{p, idx2, 2}] == 0)
+                continue;
+            // make torso wider
+            float width = (i == 0 || i == 1) ? limbWidth * 2 : limbWidth;
+            batch.add(p, i, keypoints[{p, idx1, 0}], keypoints[{p, idx1, 1}],
+                      keypoints[{p, idx2, 0}], keypoints[{p, idx2, 1}], width);
+        }
+    }
+    batch.compute();
+
+    size_t limb = 0;
+    for (int p = 0; p < people && instances.size() + NUM_PARTS <= maxInstances; p++) {
+        for (; limb < batch.size() && batch.person[limb] == p; limb++)
+            instances.push_back(batch.instance(limb, batch.limb[limb]));
+        if (keypoints[{p, 0, 2}] != 0)
+            instances.push_back(headInstance(keypoints[{p, 0, 0}], keypoints[{p, 0, 1}], faceRadii[p]));
+    }
+}
+
+#endif
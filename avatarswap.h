@@ -0,0 +1,152 @@
+#ifndef AVATARSWAP
+#define AVATARSWAP
+
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "avatar.h"
+#include "glcontext.h"
+#include "partmesh.h"
+#include "texturearray.h"
+
+// everything drawn for one avatar: the part textures and their outlines
+struct AvatarAssets {
+    PartTextureArray parts;
+    PartMeshes meshes;
+};
+
+
+// replaces the avatar while the render loop keeps running
+// a worker thread with its own context sharing objects with the render context decodes the
+// part images, traces their outlines and uploads a new texture array, then waits on a fence
+// until the GPU holds the whole upload; only then the assets are published, and the render
+// loop takes them at the start of a frame with one atomic check, so a frame is drawn either
+// entirely with the old or entirely with the new avatar and never waits on the load
+class AvatarSwap {
+public:
+    bool start(RenderContext& renderContext, bool tracedOutlines) {
+        if (!renderContext.createUploadContext())
+            return false;
+        context = &renderContext;
+        outlines = tracedOutlines;
+        running = true;
+        worker = std::thread(&AvatarSwap::run, this);
+        return true;
+    }
+
+    bool enabled() const {
+        return context != NULL;
+    }
+
+    // load the avatar of a directory of part images 0.png to 10.png, replacing any load
+    // that has not started yet; cacheName is the outline cache in the working directory
+    void request(const std::string& directory, const std::string& cacheName) {
+        if (!enabled())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pendingDir = directory;
+            pendingCache = cacheName;
+            hasRequest = true;
+        }
+        cv.notify_one();
+    }
+
+    // at the start of a frame: true when a new avatar is resident, moving it into assets
+    bool take(AvatarAssets& assets) {
+        if (!ready.load(std::memory_order_acquire))
+            return false;
+        assets = loaded;
+        loaded = AvatarAssets();
+        {
+            // under the lock, so the worker cannot miss the wakeup between its check and its wait
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.store(false, std::memory_order_release);
+        }
+        cv.notify_one();
+        return true;
+    }
+
+    void stop() {
+        if (!enabled())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        cv.notify_all();
+        if (worker.joinable())
+            worker.join();
+        // a load finished but never taken
+        if (ready.load(std::memory_order_acquire))
+            loaded.parts.free();
+        ready.store(false);
+        context = NULL;
+    }
+
+private:
+    RenderContext* context = NULL;
+    bool outlines = true;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool running = false;
+    bool hasRequest = false;
+    std::string pendingDir;
+    std::string pendingCache;
+
+    // written by the worker while ready is false, read by the render thread once it is true
+    AvatarAssets loaded;
+    std::atomic<bool> ready{false};
+
+    void run() {
+        if (!context->makeUploadCurrent()) {
+            std::cout << "ERROR::AVATARSWAP::CONTEXT_NOT_CURRENT" << std::endl;
+            return;
+        }
+        while (true) {
+            std::string directory, cacheName;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                // one published avatar at a time, the next load waits until it is taken
+                cv.wait(lock, [this] { return !running || (hasRequest && !ready.load(std::memory_order_acquire)); });
+                if (!running)
+                    break;
+                directory = pendingDir;
+                cacheName = pendingCache;
+                hasRequest = false;
+            }
+
+            std::vector<std::string> paths;
+            for (unsigned int i = 0; i < NUM_PARTS; i++)
+                paths.push_back(directory + "/" + std::to_string(i) + ".png");
+            AvatarAssets assets;
+            if (!outlines || !assets.meshes.load(paths, cacheName))
+                assets.meshes.quads(NUM_PARTS);
+            if (!assets.parts.load(paths)) {
+                std::cout << "Failed to load avatar " << directory << ", keeping the current one" << std::endl;
+                assets.parts.free();
+                continue;
+            }
+
+            // the texture is complete for the render context once this fence has signaled
+            GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(fence);
+
+            loaded = assets;
+            ready.store(true, std::memory_order_release);
+            std::cout << "Avatar " << directory << " loaded" << std::endl;
+        }
+        context->releaseUploadContext();
+    }
+};
+
+#endif
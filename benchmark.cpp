@@ -0,0 +1,151 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <math.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "gesture.h"
+#include "limbtransform.h"
+#include "poselift.h"
+
+
+const unsigned int NUM_LIMBS = 10;
+const unsigned int REPEATS = 200;
+
+// random joint pairs for the given number of people
+void randomLimbs(unsigned int people, LimbBatch& batch) {
+    batch.clear();
+    for (unsigned int p = 0; p < people; p++) {
+        for (unsigned int l = 0; l < NUM_LIMBS; l++) {
+            batch.add(p, l, rand() % 1080, rand() % 1080, rand() % 1080, rand() % 1080, 25.0f);
+        }
+    }
+}
+
+// per-limb glm path as done by the render loop before batching
+double benchGLM(const LimbBatch& batch, std::vector<glm::mat4>& out) {
+    out.resize(batch.size());
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int r = 0; r < REPEATS; r++) {
+        for (size_t i = 0; i < batch.size(); i++) {
+            glm::vec2 coord1 = glm::vec2(batch.x1[i], batch.y1[i]);
+            glm::vec2 coord2 = glm::vec2(batch.x2[i], batch.y2[i]);
+            float length = glm::distance(coord1, coord2);
+            float theta = atan2(coord2.y - coord1.y, coord2.x - coord1.x);
+
+            glm::mat4 model_M = glm::mat4(1.0f);
+            model_M = glm::translate(model_M, glm::vec3(coord1.x, coord1.y, 0.0f));
+            model_M = glm::rotate(model_M, theta, glm::vec3(0.0f, 0.0f, 1.0f));
+            model_M = glm::scale(model_M, glm::vec3(length, batch.width[i], 1.0f));
+            out[i] = model_M;
+        }
+    }
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / REPEATS;
+}
+
+double benchBatched(LimbBatch& batch) {
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int r = 0; r < REPEATS; r++) {
+        batch.compute();
+    }
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / REPEATS;
+}
+
+// largest element difference between the two paths
+float maxError(const LimbBatch& batch, const std::vector<glm::mat4>& reference) {
+    float err = 0.0f;
+    for (size_t i = 0; i < batch.size(); i++) {
+        glm::mat4 m;
+        batch.modelMatrix(i, &m[0][0]);
+        for (int col = 0; col < 4; col++) {
+            for (int row = 0; row < 4; row++) {
+                err = fmax(err, fabs(m[col][row] - reference[i][col][row]));
+            }
+        }
+    }
+    return err;
+}
+
+// lifting network with random weights on a random pose
+void benchLifting() {
+    PoseLifter lifter;
+    lifter.randomInit();
+
+    float keypoints[LIFT_JOINTS * 3];
+    for (int j = 0; j < LIFT_JOINTS; j++) {
+        keypoints[j * 3] = rand() % 1080;
+        keypoints[j * 3 + 1] = rand() % 1080;
+        keypoints[j * 3 + 2] = 1.0f;
+    }
+
+    float depth[LIFT_JOINTS], torso;
+    const unsigned int runs = 10000;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int r = 0; r < runs; r++) {
+        lifter.lift(keypoints, depth, torso);
+    }
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << "pose lifting, " << lifter.macs() << " MACs: " << elapsed.count() / runs
+              << " us per person" << std::endl;
+}
+
+// one streaming DTW update against a growing template library
+void benchGestures() {
+    float keypoints[GESTURE_JOINTS * 3];
+    for (int j = 0; j < GESTURE_JOINTS; j++) {
+        keypoints[j * 3] = rand() % 1080;
+        keypoints[j * 3 + 1] = rand() % 1080;
+        keypoints[j * 3 + 2] = 1.0f;
+    }
+
+    std::cout << "gesture recognition, time per frame in us" << std::endl;
+    std::cout << "templates\tframes\ttime" << std::endl;
+    unsigned int counts[] = {3, 30, 300, 900};
+    for (unsigned int templates : counts) {
+        GestureEngine engine;
+        while (engine.templateCount() < templates) {
+            engine.addBuiltinTemplates();
+        }
+
+        const unsigned int runs = 1000;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int r = 0; r < runs; r++) {
+            engine.update(keypoints);
+        }
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << engine.templateCount() << "\t" << engine.totalFrames() << "\t" << elapsed.count() / runs << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    srand(0);
+
+    std::cout << "limb transforms, " << NUM_LIMBS << " limbs per person, time per frame in us" << std::endl;
+    std::cout << "people\tglm\tbatched\tspeedup\tmax error" << std::endl;
+
+    unsigned int counts[] = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000};
+    for (unsigned int people : counts) {
+        LimbBatch batch;
+        std::vector<glm::mat4> reference;
+        randomLimbs(people, batch);
+
+        double glmTime = benchGLM(batch, reference);
+        double batchedTime = benchBatched(batch);
+
+        std::cout << people << "\t" << glmTime << "\t" << batchedTime << "\t"
+                  << glmTime / batchedTime << "x\t" << maxError(batch, reference) << std::endl;
+    }
+    std::cout << std::endl;
+
+    benchLifting();
+    std::cout << std::endl;
+
+    benchGestures();
+    return 0;
+}
@@ -0,0 +1,120 @@
+#ifndef CAMERABACKGROUND
+#define CAMERABACKGROUND
+
+#include <cstring>
+#include <iostream>
+
+#include <glad/glad.h>
+
+#include "glstate.h"
+
+// camera frame layouts, matching background.frag
+const int BACKGROUND_BGR = 0;
+const int BACKGROUND_YUYV = 1;
+// pixel buffers in flight, a buffer is refilled BACKGROUND_RING frames after its last upload
+const int BACKGROUND_RING = 3;
+
+
+// live camera image behind the avatar
+// frames are copied into a ring of pixel unpack buffers and transferred to the texture
+// from there, so glTexSubImage2D returns without waiting for the copy and the GPU reads
+// one buffer while the CPU fills the next; color conversion happens in background.frag
+class CameraBackground {
+public:
+    unsigned int texture = 0;
+    int width = 0;
+    int height = 0;
+    int format = BACKGROUND_BGR;
+    unsigned int unit = 0;
+
+    // allocate the texture once for frames of the given size, later frames only replace its contents,
+    // the texture is bound to textureUnit through the state cache
+    bool init(int frameWidth, int frameHeight, int frameFormat, unsigned int textureUnit) {
+        if (frameFormat == BACKGROUND_YUYV && frameWidth % 2 != 0) {
+            std::cout << "ERROR::BACKGROUND::YUYV_WIDTH_NOT_EVEN " << frameWidth << std::endl;
+            return false;
+        }
+        width = frameWidth;
+        height = frameHeight;
+        format = frameFormat;
+        unit = textureUnit;
+
+        // frames are stored as raw bytes the driver copies without conversion:
+        // BGR as three single channel texels per pixel, YUYV as one RGBA texel (Y0, U, Y1, V) per pixel pair
+        if (format == BACKGROUND_YUYV) {
+            texWidth = width / 2;
+            internalFormat = GL_RGBA8;
+            pixelFormat = GL_RGBA;
+            frameBytes = (size_t)width * height * 2;
+        } else {
+            texWidth = 3 * width;
+            internalFormat = GL_R8;
+            pixelFormat = GL_RED;
+            frameBytes = (size_t)width * height * 3;
+        }
+
+        glGenTextures(1, &texture);
+        glState().bindTexture(unit, GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, texWidth, height, 0, pixelFormat, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glGenBuffers(BACKGROUND_RING, pbo);
+        for (int i = 0; i < BACKGROUND_RING; i++) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo[i]);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, frameBytes, NULL, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return true;
+    }
+
+    // copy a frame into the next ring buffer and queue its transfer into the texture,
+    // rows are stride bytes apart in the source
+    bool upload(const unsigned char* data, size_t stride) {
+        size_t rowBytes = frameBytes / height;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo[next]);
+        // invalidating lets the driver hand out fresh memory if the GPU still reads the buffer
+        void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, frameBytes,
+                                        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (mapped == NULL) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            return false;
+        }
+        if (stride == rowBytes) {
+            std::memcpy(mapped, data, frameBytes);
+        } else {
+            for (int y = 0; y < height; y++)
+                std::memcpy((unsigned char*)mapped + y * rowBytes, data + y * stride, rowBytes);
+        }
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        // source is the bound buffer, the call only queues the transfer
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glState().bindTexture(unit, GL_TEXTURE_2D, texture);
+        glState().activeTexture(unit);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texWidth, height, pixelFormat, GL_UNSIGNED_BYTE, (void*)0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        next = (next + 1) % BACKGROUND_RING;
+        return true;
+    }
+
+    void free() {
+        glDeleteBuffers(BACKGROUND_RING, pbo);
+        glDeleteTextures(1, &texture);
+        texture = 0;
+    }
+
+private:
+    unsigned int pbo[BACKGROUND_RING] = {0, 0, 0};
+    int next = 0;
+    int texWidth = 0;
+    GLenum internalFormat = GL_R8;
+    GLenum pixelFormat = GL_RED;
+    size_t frameBytes = 0;
+};
+
+#endif
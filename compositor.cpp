@@ -0,0 +1,100 @@
+// stb_image implementation in this file only, the headers include stb_image.h again
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <opencv2/opencv.hpp>
+#include <openpose/headers.hpp>
+
+#include "avatar.h"
+#include "cpucompositor.h"
+#include "limbtransform.h"
+#include "posestream.h"
+
+
+// same clear color as the GL render loop, BGR
+const cv::Scalar CLEAR_COLOR(0.3 * 255, 0.3 * 255, 0.2 * 255);
+
+DEFINE_string(video, "", "Read frames from a video file instead of the camera, stops at its end");
+DEFINE_string(output, "", "Write the rendered frames to this video file");
+DEFINE_int32(width, DISPLAY_WIDTH, "Width of the rendered frames");
+DEFINE_int32(height, DISPLAY_HEIGHT, "Height of the rendered frames");
+DEFINE_double(output_fps, 30.0, "Frame rate written to the output");
+DEFINE_int32(threads, 0, "Threads rendering the tiles, 0 for one per core");
+
+// avatar frames without any GL stack: pose inference as in main.bin, the instanced
+// avatar composited on the CPU and written to a video file
+int main(int argc, char* argv[]) {
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    if (FLAGS_threads > 0)
+        cv::setNumThreads(FLAGS_threads);
+
+    cv::VideoCapture cam;
+    if (FLAGS_video.empty())
+        cam.open(0);
+    else
+        cam.open(FLAGS_video);
+    if (!cam.isOpened()) {
+        std::cout << "Cannot open " << (FLAGS_video.empty() ? "camera" : FLAGS_video) << std::endl;
+        return -1;
+    }
+
+    std::vector<std::string> partPaths;
+    for (unsigned int i = 0; i < NUM_PARTS; i++)
+        partPaths.push_back("../textures/avatar/" + std::to_string(i) + ".png");
+    CPUCompositor compositor;
+    if (!compositor.load(partPaths))
+        return -1;
+
+    cv::VideoWriter writer;
+    if (!FLAGS_output.empty()) {
+        writer.open(FLAGS_output, CV_FOURCC('m', 'p', '4', 'v'), FLAGS_output_fps, cv::Size(FLAGS_width, FLAGS_height));
+        if (!writer.isOpened()) {
+            std::cout << "ERROR::COMPOSITOR::FILE_NOT_OPENED " << FLAGS_output << std::endl;
+            return -1;
+        }
+    }
+
+    op::Wrapper opWrapper{op::ThreadManagerMode::Asynchronous};
+    opWrapper.start();
+    PoseStream poseStream(cam, opWrapper, false, cam.get(CV_CAP_PROP_FRAME_HEIGHT));
+    poseStream.start();
+
+    LimbBatch limbBatch;
+    std::vector<LimbInstance> instances;
+    cv::Mat frame(FLAGS_height, FLAGS_width, CV_8UC3);
+    unsigned int frames = 0;
+    std::chrono::duration<double, std::milli> renderTime = std::chrono::duration<double, std::milli>::zero();
+    while (!poseStream.finished()) {
+        PoseSample sample;
+        if (!poseStream.take(sample)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        avatarInstances(sample.keypoints, limbBatch, instances, sample.keypoints.getSize(0) * NUM_PARTS);
+        compositor.render(instances, DISPLAY_WIDTH, DISPLAY_HEIGHT, CLEAR_COLOR, frame);
+        renderTime += std::chrono::steady_clock::now() - start;
+        if (writer.isOpened())
+            writer.write(frame);
+
+        if (++frames == 120) {
+            std::cout << renderTime.count() / frames << " ms render CPU per frame" << std::endl;
+            frames = 0;
+            renderTime = std::chrono::duration<double, std::milli>::zero();
+        }
+    }
+
+    poseStream.stop();
+    cam.release();
+    writer.release();
+    return 0;
+}
@@ -0,0 +1,395 @@
+#ifndef CPUCOMPOSITOR
+#define CPUCOMPOSITOR
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <opencv2/opencv.hpp>
+
+#include "limbtransform.h"
+#include "stb_image.h"
+
+// square tiles rendered in parallel, each one by a single thread
+const int COMPOSITOR_TILE = 64;
+// texels below this alpha are discarded, same test as instanced.frag
+const unsigned int COMPOSITOR_ALPHA = 26;
+
+
+// the instanced avatar draw rasterized on the CPU into a BGR cv::Mat, for machines without any GL stack
+// every part is the affine image of its texture like in instanced.vert, so each output
+// pixel maps back to texel coords linearly; rows of a tile are clipped to the part
+// analytically and filled with bilinear samples, four pixels at a time with SSE2,
+// from the mip level the GL path would pick for the part's scale; texels failing the
+// alpha test are skipped and the rest overwrite the frame, as without GL blending
+// output rows run top down and the view coords are mirrored in x, like projection_M
+class CPUCompositor {
+public:
+    // part images with their mip chains, loaded once
+    bool load(const std::vector<std::string>& paths) {
+        parts.clear();
+        parts.resize(paths.size());
+        for (size_t i = 0; i < paths.size(); i++) {
+            int width, height, channels;
+            unsigned char* image = stbi_load(paths[i].c_str(), &width, &height, &channels, 4);
+            if (image == NULL) {
+                std::cout << "ERROR::COMPOSITOR::FILE_NOT_SUCCESFULLY_READ " << paths[i] << std::endl;
+                return false;
+            }
+            Level base;
+            base.width = width;
+            base.height = height;
+            base.texels.resize((size_t)width * height);
+            std::memcpy(base.texels.data(), image, base.texels.size() * 4);
+            stbi_image_free(image);
+            parts[i].push_back(base);
+            while (parts[i].back().width > 1 || parts[i].back().height > 1)
+                parts[i].push_back(halve(parts[i].back()));
+        }
+        return true;
+    }
+
+    // draw the parts over a frame cleared to clearBGR; the parts are placed in a viewWidth x viewHeight
+    // space scaled to the frame, and drawn in order, later ones on top
+    void render(const std::vector<LimbInstance>& instances, float viewWidth, float viewHeight,
+                const cv::Scalar& clearBGR, cv::Mat& frame) {
+        int tilesX = (frame.cols + COMPOSITOR_TILE - 1) / COMPOSITOR_TILE;
+        int tilesY = (frame.rows + COMPOSITOR_TILE - 1) / COMPOSITOR_TILE;
+        setup(instances, viewWidth, viewHeight, frame.cols, frame.rows);
+        unsigned char clear[3] = {cv::saturate_cast<unsigned char>(clearBGR[0]), cv::saturate_cast<unsigned char>(clearBGR[1]),
+                                  cv::saturate_cast<unsigned char>(clearBGR[2])};
+
+        cv::parallel_for_(cv::Range(0, tilesX * tilesY), [&](const cv::Range& range) {
+            for (int tile = range.start; tile < range.end; tile++) {
+                int x0 = (tile % tilesX) * COMPOSITOR_TILE;
+                int y0 = (tile / tilesX) * COMPOSITOR_TILE;
+                int x1 = std::min(x0 + COMPOSITOR_TILE, frame.cols);
+                int y1 = std::min(y0 + COMPOSITOR_TILE, frame.rows);
+                for (int y = y0; y < y1; y++) {
+                    unsigned char* row = frame.ptr<unsigned char>(y) + 3 * x0;
+                    for (int x = x0; x < x1; x++, row += 3) {
+                        row[0] = clear[0];
+                        row[1] = clear[1];
+                        row[2] = clear[2];
+                    }
+                }
+                for (size_t i = 0; i < spans.size(); i++) {
+                    const Span& span = spans[i];
+                    if (span.x1 <= x0 || span.x0 >= x1 || span.y1 <= y0 || span.y0 >= y1)
+                        continue;
+                    drawPart(span, x0, y0, x1, y1, frame);
+                }
+            }
+        });
+    }
+
+private:
+    struct Level {
+        int width;
+        int height;
+        // RGBA, R in the lowest byte
+        std::vector<uint32_t> texels;
+    };
+
+    // an instance prepared for drawing: screen bounds, and the texel coords (u, v), normalized
+    // to the part, as linear functions of the pixel, u = u0 + ux * x + uy * y, v likewise
+    // magnified parts are sampled bilinearly from level, minified ones take the nearest texel
+    // of level and of coarser, mixed by weight in 1/128 steps
+    struct Span {
+        int x0, y0, x1, y1;
+        const Level* level;
+        const Level* coarser;
+        int weight;
+        float u0, ux, uy;
+        float v0, vx, vy;
+    };
+
+    std::vector<std::vector<Level> > parts;
+    std::vector<Span> spans;
+
+    // next mip level, box filtered like glGenerateMipmap
+    static Level halve(const Level& src) {
+        Level dst;
+        dst.width = std::max(src.width / 2, 1);
+        dst.height = std::max(src.height / 2, 1);
+        dst.texels.resize((size_t)dst.width * dst.height);
+        for (int y = 0; y < dst.height; y++) {
+            int sy0 = std::min(2 * y, src.height - 1);
+            int sy1 = std::min(2 * y + 1, src.height - 1);
+            for (int x = 0; x < dst.width; x++) {
+                int sx0 = std::min(2 * x, src.width - 1);
+                int sx1 = std::min(2 * x + 1, src.width - 1);
+                uint32_t t[4] = {src.texels[sy0 * src.width + sx0], src.texels[sy0 * src.width + sx1],
+                                 src.texels[sy1 * src.width + sx0], src.texels[sy1 * src.width + sx1]};
+                uint32_t out = 0;
+                for (int c = 0; c < 32; c += 8) {
+                    uint32_t sum = ((t[0] >> c) & 255) + ((t[1] >> c) & 255) + ((t[2] >> c) & 255) + ((t[3] >> c) & 255);
+                    out |= ((sum + 2) / 4) << c;
+                }
+                dst.texels[y * dst.width + x] = out;
+            }
+        }
+        return dst;
+    }
+
+    // invert the part transforms for frame pixels, pick their mip levels and bound them on screen
+    void setup(const std::vector<LimbInstance>& instances, float viewWidth, float viewHeight, int cols, int rows) {
+        spans.clear();
+        // view coords of the pixel center (x, y): (viewWidth - (x + 0.5) * sx, (y + 0.5) * sy)
+        float sx = viewWidth / cols;
+        float sy = viewHeight / rows;
+        for (size_t i = 0; i < instances.size(); i++) {
+            const LimbInstance& inst = instances[i];
+            int part = (int)inst.layer;
+            if (part < 0 || part >= (int)parts.size())
+                continue;
+            float det = inst.axisX[0] * inst.axisY[1] - inst.axisX[1] * inst.axisY[0];
+            if (std::fabs(det) < 1e-6f)
+                continue;
+
+            // view = offset + axisX * u + axisY * (1 - v), solved for (u, v) and expressed in pixels
+            float ix[2] = {inst.axisY[1] / det, -inst.axisX[1] / det};
+            float iy[2] = {-inst.axisY[0] / det, inst.axisX[0] / det};
+            float ox = viewWidth - 0.5f * sx - inst.offset[0];
+            float oy = 0.5f * sy - inst.offset[1];
+            Span span;
+            span.u0 = ix[0] * ox + iy[0] * oy;
+            span.ux = -ix[0] * sx;
+            span.uy = iy[0] * sy;
+            span.v0 = 1.0f - (ix[1] * ox + iy[1] * oy);
+            span.vx = ix[1] * sx;
+            span.vy = -iy[1] * sy;
+
+            // level of detail from the texels per pixel along the larger screen axis, filtered like
+            // the GL defaults: linear magnification, GL_NEAREST_MIPMAP_LINEAR minification
+            const std::vector<Level>& levels = parts[part];
+            float w = levels[0].width, h = levels[0].height;
+            float rho = std::max(std::sqrt(span.ux * w * span.ux * w + span.vx * h * span.vx * h),
+                                 std::sqrt(span.uy * w * span.uy * w + span.vy * h * span.vy * h));
+            float lambda = std::log2(std::max(rho, 1e-6f));
+            int last = levels.size() - 1;
+            span.level = &levels[0];
+            span.coarser = NULL;
+            span.weight = 0;
+            if (lambda > 0.5f) {
+                int level = std::min((int)lambda, last);
+                span.level = &levels[level];
+                span.coarser = &levels[std::min(level + 1, last)];
+                span.weight = level < last ? (int)((lambda - level) * 128.0f) : 0;
+            }
+
+            // screen bounds of the quad corners
+            float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f;
+            for (int corner = 0; corner < 4; corner++) {
+                float cu = corner & 1, cv = corner >> 1;
+                float vx = inst.offset[0] + inst.axisX[0] * cu + inst.axisY[0] * cv;
+                float vy = inst.offset[1] + inst.axisX[1] * cu + inst.axisY[1] * cv;
+                float x = (viewWidth - vx) / sx;
+                float y = vy / sy;
+                minX = std::min(minX, x); maxX = std::max(maxX, x);
+                minY = std::min(minY, y); maxY = std::max(maxY, y);
+            }
+            span.x0 = std::max((int)std::floor(minX), 0);
+            span.y0 = std::max((int)std::floor(minY), 0);
+            span.x1 = std::min((int)std::ceil(maxX) + 1, cols);
+            span.y1 = std::min((int)std::ceil(maxY) + 1, rows);
+            if (span.x0 < span.x1 && span.y0 < span.y1)
+                spans.push_back(span);
+        }
+    }
+
+    // narrow [lo, hi] to the x where 0 <= a + b * x <= 1
+    static void clip(float a, float b, float& lo, float& hi) {
+        if (std::fabs(b) < 1e-12f) {
+            if (a < 0.0f || a > 1.0f)
+                hi = lo - 1.0f;
+            return;
+        }
+        float e0 = -a / b, e1 = (1.0f - a) / b;
+        lo = std::max(lo, std::min(e0, e1));
+        hi = std::min(hi, std::max(e0, e1));
+    }
+
+    // write a filtered texel if it passes the alpha test
+    static inline void store(uint32_t texel, unsigned char* pixel) {
+        if ((texel >> 24) < COMPOSITOR_ALPHA)
+            return;
+        pixel[0] = (texel >> 16) & 255;
+        pixel[1] = (texel >> 8) & 255;
+        pixel[2] = texel & 255;
+    }
+
+    void drawPart(const Span& span, int tileX0, int tileY0, int tileX1, int tileY1, cv::Mat& frame) {
+        int yStart = std::max(span.y0, tileY0), yEnd = std::min(span.y1, tileY1);
+        for (int y = yStart; y < yEnd; y++) {
+            float u = span.u0 + span.uy * y;
+            float v = span.v0 + span.vy * y;
+            float lo = std::max(span.x0, tileX0), hi = std::min(span.x1, tileX1) - 1;
+            clip(u, span.ux, lo, hi);
+            clip(v, span.vx, lo, hi);
+            int x = (int)std::ceil(lo), xEnd = (int)std::floor(hi) + 1;
+            if (x >= xEnd)
+                continue;
+            unsigned char* pixel = frame.ptr<unsigned char>(y) + 3 * x;
+            if (span.coarser != NULL)
+                nearestRow(span, u, v, x, xEnd, pixel);
+            else
+                bilinearRow(*span.level, u, v, span.ux, span.vx, x, xEnd, pixel);
+        }
+    }
+
+    // pixels x to xEnd of a row where the texel coords are (u + ux * x, v + vx * x)
+    static void bilinearRow(const Level& level, float u, float v, float ux, float vx, int x, int xEnd, unsigned char* pixel) {
+        // level texel position, centers at half integers
+        float w = level.width, h = level.height;
+        float px0 = u * w - 0.5f, pxStep = ux * w;
+        float py0 = v * h - 0.5f, pyStep = vx * h;
+#if defined(__SSE2__)
+        const __m128 lane = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+        const __m128 half = _mm_set1_ps(-0.5f), one = _mm_set1_ps(1.0f), scale = _mm_set1_ps(128.0f);
+        const __m128i ones = _mm_set1_epi32(1), zero = _mm_setzero_si128();
+        const __m128i maxX = _mm_set1_epi32(level.width - 1), maxY = _mm_set1_epi32(level.height - 1);
+        const __m128 px4 = _mm_set1_ps(px0), pxStep4 = _mm_set1_ps(pxStep);
+        const __m128 py4 = _mm_set1_ps(py0), pyStep4 = _mm_set1_ps(pyStep);
+        for (; x + 4 <= xEnd; x += 4, pixel += 12) {
+            __m128 xs = _mm_add_ps(_mm_set1_ps((float)x), lane);
+            __m128 px = _mm_max_ps(_mm_add_ps(px4, _mm_mul_ps(xs, pxStep4)), half);
+            __m128 py = _mm_max_ps(_mm_add_ps(py4, _mm_mul_ps(xs, pyStep4)), half);
+            // floor of values above -1
+            __m128i x0 = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(px, one)), ones);
+            __m128i y0 = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(py, one)), ones);
+            __m128i fx = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(px, _mm_cvtepi32_ps(x0)), scale));
+            __m128i fy = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(py, _mm_cvtepi32_ps(y0)), scale));
+            // clamp to the edge
+            __m128i x1 = clamp(_mm_add_epi32(x0, ones), maxX);
+            __m128i y1 = clamp(_mm_add_epi32(y0, ones), maxY);
+            x0 = clamp(x0, maxX);
+            y0 = clamp(y0, maxY);
+            __m128i t00, t10, t01, t11;
+            gather(level, x0, y0, t00);
+            gather(level, x1, y0, t10);
+            gather(level, x0, y1, t01);
+            gather(level, x1, y1, t11);
+
+            // per-pixel weights repeated over the four channels, pixels 0-1 and 2-3
+            __m128i fx16 = _mm_packs_epi32(fx, fx), fy16 = _mm_packs_epi32(fy, fy);
+            fx16 = _mm_unpacklo_epi16(fx16, fx16);
+            fy16 = _mm_unpacklo_epi16(fy16, fy16);
+            __m128i wxLo = _mm_unpacklo_epi32(fx16, fx16), wxHi = _mm_unpackhi_epi32(fx16, fx16);
+            __m128i wyLo = _mm_unpacklo_epi32(fy16, fy16), wyHi = _mm_unpackhi_epi32(fy16, fy16);
+
+            __m128i top = lerp(_mm_unpacklo_epi8(t00, zero), _mm_unpacklo_epi8(t10, zero), wxLo);
+            __m128i bottom = lerp(_mm_unpacklo_epi8(t01, zero), _mm_unpacklo_epi8(t11, zero), wxLo);
+            __m128i lo = lerp(top, bottom, wyLo);
+            top = lerp(_mm_unpackhi_epi8(t00, zero), _mm_unpackhi_epi8(t10, zero), wxHi);
+            bottom = lerp(_mm_unpackhi_epi8(t01, zero), _mm_unpackhi_epi8(t11, zero), wxHi);
+            __m128i hi = lerp(top, bottom, wyHi);
+            store4(_mm_packus_epi16(lo, hi), pixel);
+        }
+#endif
+        for (; x < xEnd; x++, pixel += 3) {
+            float px = std::max(px0 + pxStep * x, -0.5f);
+            float py = std::max(py0 + pyStep * x, -0.5f);
+            int x0 = (int)(px + 1.0f) - 1, y0 = (int)(py + 1.0f) - 1;
+            int fx = (int)((px - x0) * 128.0f), fy = (int)((py - y0) * 128.0f);
+            int xa = std::min(std::max(x0, 0), level.width - 1), xb = std::min(x0 + 1, level.width - 1);
+            int ya = std::min(std::max(y0, 0), level.height - 1), yb = std::min(y0 + 1, level.height - 1);
+            const uint32_t* top = &level.texels[ya * level.width];
+            const uint32_t* bottom = &level.texels[yb * level.width];
+            uint32_t out = 0;
+            for (int c = 0; c < 32; c += 8) {
+                int t0 = lerp((top[xa] >> c) & 255, (top[xb] >> c) & 255, fx);
+                int t1 = lerp((bottom[xa] >> c) & 255, (bottom[xb] >> c) & 255, fx);
+                out |= (uint32_t)lerp(t0, t1, fy) << c;
+            }
+            store(out, pixel);
+        }
+    }
+
+    // nearest texels of two levels mixed by the span weight
+    static void nearestRow(const Span& span, float u, float v, int x, int xEnd, unsigned char* pixel) {
+        const Level& fine = *span.level;
+        const Level& coarse = *span.coarser;
+#if defined(__SSE2__)
+        const __m128 lane = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+        const __m128 u4 = _mm_set1_ps(u), ux4 = _mm_set1_ps(span.ux);
+        const __m128 v4 = _mm_set1_ps(v), vx4 = _mm_set1_ps(span.vx);
+        const __m128i zero = _mm_setzero_si128(), weight = _mm_set1_epi16(span.weight);
+        for (; x + 4 <= xEnd; x += 4, pixel += 12) {
+            __m128 xs = _mm_add_ps(_mm_set1_ps((float)x), lane);
+            __m128 us = _mm_add_ps(u4, _mm_mul_ps(xs, ux4));
+            __m128 vs = _mm_add_ps(v4, _mm_mul_ps(xs, vx4));
+            __m128i a, b;
+            gather(fine, clamp(_mm_cvttps_epi32(_mm_mul_ps(us, _mm_set1_ps(fine.width))), _mm_set1_epi32(fine.width - 1)),
+                   clamp(_mm_cvttps_epi32(_mm_mul_ps(vs, _mm_set1_ps(fine.height))), _mm_set1_epi32(fine.height - 1)), a);
+            gather(coarse, clamp(_mm_cvttps_epi32(_mm_mul_ps(us, _mm_set1_ps(coarse.width))), _mm_set1_epi32(coarse.width - 1)),
+                   clamp(_mm_cvttps_epi32(_mm_mul_ps(vs, _mm_set1_ps(coarse.height))), _mm_set1_epi32(coarse.height - 1)), b);
+            __m128i lo = lerp(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), weight);
+            __m128i hi = lerp(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), weight);
+            store4(_mm_packus_epi16(lo, hi), pixel);
+        }
+#endif
+        for (; x < xEnd; x++, pixel += 3) {
+            float us = u + span.ux * x, vs = v + span.vx * x;
+            uint32_t a = nearest(fine, us, vs), b = nearest(coarse, us, vs);
+            uint32_t out = 0;
+            for (int c = 0; c < 32; c += 8)
+                out |= (uint32_t)lerp((a >> c) & 255, (b >> c) & 255, span.weight) << c;
+            store(out, pixel);
+        }
+    }
+
+    static inline uint32_t nearest(const Level& level, float u, float v) {
+        int x = std::min(std::max((int)(u * level.width), 0), level.width - 1);
+        int y = std::min(std::max((int)(v * level.height), 0), level.height - 1);
+        return level.texels[y * level.width + x];
+    }
+
+    // a + (b - a) * t with t in 1/128 steps, rounding like the SIMD path
+    static inline int lerp(int a, int b, int t) {
+        return a + (((b - a) * t) >> 7);
+    }
+
+#if defined(__SSE2__)
+    // 16-bit channels a + (b - a) * t, t in 1/128 steps
+    static inline __m128i lerp(__m128i a, __m128i b, __m128i t) {
+        return _mm_add_epi16(a, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(b, a), t), 7));
+    }
+
+    // clamp to 0 .. limit, SSE2 has no 32-bit min and max
+    static inline __m128i clamp(__m128i v, __m128i limit) {
+        v = _mm_and_si128(v, _mm_cmpgt_epi32(v, _mm_set1_epi32(-1)));
+        __m128i over = _mm_cmpgt_epi32(v, limit);
+        return _mm_or_si128(_mm_and_si128(over, limit), _mm_andnot_si128(over, v));
+    }
+
+    // texels at four positions, SSE2 has no gather
+    static inline void gather(const Level& level, __m128i x, __m128i y, __m128i& texels) {
+        int xs[4], ys[4];
+        _mm_storeu_si128((__m128i*)xs, x);
+        _mm_storeu_si128((__m128i*)ys, y);
+        const uint32_t* t = level.texels.data();
+        int w = level.width;
+        texels = _mm_set_epi32(t[ys[3] * w + xs[3]], t[ys[2] * w + xs[2]], t[ys[1] * w + xs[1]], t[ys[0] * w + xs[0]]);
+    }
+
+    static inline void store4(__m128i texels, unsigned char* pixel) {
+        uint32_t out[4];
+        _mm_storeu_si128((__m128i*)out, texels);
+        store(out[0], pixel);
+        store(out[1], pixel + 3);
+        store(out[2], pixel + 6);
+        store(out[3], pixel + 9);
+    }
+#endif
+};
+
+#endif
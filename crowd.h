@@ -0,0 +1,316 @@
+#ifndef CROWD
+#define CROWD
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <openpose/headers.hpp>
+
+#include "avatar.h"
+#include "limbtransform.h"
+
+// BODY_25 joints of the synthetic skeletons
+const int SYNTHETIC_JOINTS = 25;
+
+// front row avatar height in view units, row r is drawn at 1 / (1 + CROWD_ROW_SCALE * r)
+const float CROWD_AVATAR_HEIGHT = 360.0f;
+const float CROWD_ROW_SCALE = 0.25f;
+// seat spacing and the rise from one row to the next, in front row avatar heights
+const float CROWD_SEAT_SPACING = 0.45f;
+const float CROWD_ROW_RISE = 0.35f;
+// width of the stands in view widths, and the period of the camera pan across them in seconds
+const float CROWD_WIDTH = 3.0f;
+const double CROWD_PAN_PERIOD = 20.0;
+// frames averaged per report, and per step of the avatar count sweep
+const unsigned int CROWD_REPORT_FRAMES = 120;
+
+// low detail avatars: one torso part, and each arm and leg as a single part from its
+// root to its end joint, textured with the upper part; joint, joint, part
+const int crowdLowLimbMap[5][3] = {  {1, 8, 0},     // torso
+                                     {4, 2, 2},     // R arm
+                                     {5, 7, 4},     // L arm
+                                     {11, 9, 6},    // R leg
+                                     {12, 14, 8}};  // L leg
+
+
+// procedurally animated BODY_25 skeletons standing in for pose inference, for stress tests:
+// every skeleton cheers, swinging its arms and bouncing at its own rate and phase
+class SyntheticSkeletons {
+public:
+    explicit SyntheticSkeletons(int count) {
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        people.resize(count);
+        for (int p = 0; p < count; p++) {
+            Person& person = people[p];
+            person.height = 200.0f + 250.0f * unit(rng);
+            person.x = DISPLAY_WIDTH * (0.15f + 0.7f * unit(rng));
+            person.y = DISPLAY_HEIGHT * 0.55f + person.height * 0.2f * unit(rng);
+            person.phase = 6.2832f * unit(rng);
+            person.rate = 6.2832f * (0.4f + 0.8f * unit(rng));
+        }
+    }
+
+    // every skeleton at time seconds
+    void pose(double time, op::Array<float>& keypoints) {
+        int count = people.size();
+        if (keypoints.getSize(0) != count || keypoints.getSize(1) != SYNTHETIC_JOINTS)
+            keypoints.reset({count, SYNTHETIC_JOINTS, 3});
+        for (int p = 0; p < count; p++)
+            skeleton(people[p], time, keypoints.getPtr() + p * SYNTHETIC_JOINTS * 3);
+    }
+
+private:
+    struct Person {
+        float x, y, height;
+        float phase, rate;
+    };
+
+    std::vector<Person> people;
+
+    static void set(float* joints, int joint, float x, float y) {
+        joints[joint * 3] = x;
+        joints[joint * 3 + 1] = y;
+        joints[joint * 3 + 2] = 1.0f;
+    }
+
+    // bone of length from joint a at angle from straight down, mirrored to the left for side -1
+    static void bone(float* joints, int a, int b, float length, float angle, float side) {
+        set(joints, b, joints[a * 3] + side * length * std::sin(angle), joints[a * 3 + 1] + length * std::cos(angle));
+    }
+
+    static void skeleton(const Person& person, double time, float* joints) {
+        float h = person.height;
+        float cycle = person.rate * (float)std::fmod(time, 1000.0) + person.phase;
+        float hipX = person.x + 0.02f * h * std::sin(cycle);
+        float hipY = person.y - 0.03f * h * std::fabs(std::sin(cycle));
+
+        set(joints, 8, hipX, hipY);
+        set(joints, 1, hipX + 0.02f * h * std::sin(cycle), hipY - 0.30f * h);
+        float neckX = joints[1 * 3], neckY = joints[1 * 3 + 1];
+        set(joints, 0, neckX, neckY - 0.11f * h);
+        set(joints, 15, neckX - 0.025f * h, neckY - 0.13f * h);
+        set(joints, 16, neckX + 0.025f * h, neckY - 0.13f * h);
+        set(joints, 17, neckX - 0.06f * h, neckY - 0.11f * h);
+        set(joints, 18, neckX + 0.06f * h, neckY - 0.11f * h);
+
+        // right side to the left of the image, as OpenPose sees a person facing the camera
+        for (int s = 0; s < 2; s++) {
+            float side = s == 0 ? -1.0f : 1.0f;
+            int shoulder = s == 0 ? 2 : 5, hip = s == 0 ? 9 : 12;
+            float swing = std::sin(cycle + s * 1.3f);
+            set(joints, shoulder, neckX + side * 0.11f * h, neckY + 0.01f * h);
+            float upper = 0.25f + 1.2f * (1.0f + swing);
+            bone(joints, shoulder, shoulder + 1, 0.16f * h, upper, side);
+            bone(joints, shoulder + 1, shoulder + 2, 0.15f * h, upper + 0.4f + 0.3f * swing, side);
+
+            set(joints, hip, hipX + side * 0.055f * h, hipY);
+            float thigh = 0.08f + 0.1f * std::sin(cycle + s * 3.1416f);
+            bone(joints, hip, hip + 1, 0.23f * h, thigh, side);
+            bone(joints, hip + 1, hip + 2, 0.23f * h, thigh - 0.15f, side);
+
+            // big toe, small toe, heel
+            int ankle = hip + 2, foot = s == 0 ? 22 : 19;
+            float ankleX = joints[ankle * 3], ankleY = joints[ankle * 3 + 1];
+            set(joints, foot, ankleX + side * 0.05f * h, ankleY + 0.03f * h);
+            set(joints, foot + 1, ankleX + side * 0.07f * h, ankleY + 0.03f * h);
+            set(joints, foot + 2, ankleX - side * 0.01f * h, ankleY + 0.02f * h);
+        }
+    }
+};
+
+
+// a stadium crowd of avatars replaying the people of a pose source
+// seats are laid out in rows, each row further back and smaller, the stands are wider than
+// the view and the camera pans across them; avatars outside the view are culled before
+// their limbs are transformed, and avatars smaller than the LOD height on screen are drawn
+// with the five parts of crowdLowLimbMap and the head instead of all eleven
+class Crowd {
+public:
+    // avatars seated, and the instances they need at most
+    void init(int avatars, float lodHeight, bool sweepCount) {
+        lod = lodHeight;
+        sweep = sweepCount;
+        seats.clear();
+        float baseline = DISPLAY_HEIGHT + 0.15f * CROWD_AVATAR_HEIGHT;
+        for (int row = 0; (int)seats.size() < avatars; row++) {
+            float scale = 1.0f / (1.0f + CROWD_ROW_SCALE * row);
+            // stands span the same screen width on every row, rows further back fit more seats
+            float spacing = CROWD_SEAT_SPACING * CROWD_AVATAR_HEIGHT;
+            int count = std::max(1, (int)(CROWD_WIDTH * DISPLAY_WIDTH / (scale * spacing)));
+            // from the middle of the row outwards, so a partly seated row faces the camera
+            for (int i = 0; i < count && (int)seats.size() < avatars; i++) {
+                Seat seat = {(i % 2 == 0 ? i / 2 : -(i + 1) / 2) * spacing, baseline, scale};
+                seats.push_back(seat);
+            }
+            baseline -= CROWD_ROW_RISE * CROWD_AVATAR_HEIGHT * scale;
+        }
+        // the sweep doubles the seated avatars from the front row back
+        active = sweep ? 1 : seats.size();
+        swept = false;
+        lastFrame = std::chrono::steady_clock::now();
+    }
+
+    bool enabled() const {
+        return !seats.empty();
+    }
+
+    // true once the sweep reported the frame time with every seat taken
+    bool sweepDone() const {
+        return swept;
+    }
+
+    size_t maxInstances() const {
+        return seats.size() * NUM_PARTS;
+    }
+
+    // instances of the visible avatars, back rows first, avatar i replays source person i
+    // modulo the people in the source, scaled to its seat
+    void build(const op::Array<float>& source, double time, LimbBatch& batch, std::vector<LimbInstance>& instances) {
+        instances.clear();
+        batch.clear();
+        heads.clear();
+        int people = source.getSize(0);
+        if (people == 0)
+            return;
+        int joints = source.getSize(1);
+
+        // feet, center and height of every source person
+        bounds.resize(people);
+        for (int p = 0; p < people; p++) {
+            Bounds& b = bounds[p];
+            float minX = 0.0f, maxX = 0.0f, minY = 0.0f, maxY = 0.0f;
+            bool found = false;
+            for (int j = 0; j < joints; j++) {
+                if (source[{p, j, 2}] == 0)
+                    continue;
+                float x = source[{p, j, 0}], y = source[{p, j, 1}];
+                minX = found ? std::min(minX, x) : x;
+                maxX = found ? std::max(maxX, x) : x;
+                minY = found ? std::min(minY, y) : y;
+                maxY = found ? std::max(maxY, y) : y;
+                found = true;
+            }
+            b.centerX = (minX + maxX) / 2;
+            b.feet = maxY;
+            b.halfWidth = (maxX - minX) / 2;
+            b.height = maxY - minY;
+            avatarScale(source, p, b.faceRadius, b.limbWidth);
+        }
+
+        // camera pan, rows further back move less
+        float pan = 0.8f * (CROWD_WIDTH - 1.0f) / 2 * DISPLAY_WIDTH * std::sin(6.2832 * time / CROWD_PAN_PERIOD);
+        int drawn = 0, low = 0;
+        for (int i = active - 1; i >= 0; i--) {
+            const Seat& seat = seats[i];
+            int p = i % people;
+            const Bounds& b = bounds[p];
+            if (b.height <= 0.0f)
+                continue;
+
+            // screen bounds of the seated avatar, grown by the head and limb widths
+            float height = CROWD_AVATAR_HEIGHT * seat.scale;
+            float k = height / b.height;
+            float x = DISPLAY_WIDTH / 2.0f + (seat.x - pan) * seat.scale;
+            float margin = std::max(b.faceRadius, b.limbWidth) * k;
+            if (x + b.halfWidth * k + margin < 0.0f || x - b.halfWidth * k - margin > DISPLAY_WIDTH ||
+                seat.baseline + margin < 0.0f || seat.baseline - height - margin > DISPLAY_HEIGHT)
+                continue;
+
+            bool full = height >= lod;
+            if (!full)
+                low++;
+            int count = full ? sizeof(limbMap) / sizeof(limbMap[0]) : sizeof(crowdLowLimbMap) / sizeof(crowdLowLimbMap[0]);
+            for (int l = 0; l < count; l++) {
+                int idx1 = full ? limbMap[l][0] : crowdLowLimbMap[l][0];
+                int idx2 = full ? limbMap[l][1] : crowdLowLimbMap[l][1];
+                int part = full ? l : crowdLowLimbMap[l][2];
+                if (source[{p, idx1, 2}] == 0 || source[{p, idx2, 2}] == 0)
+                    continue;
+                // make torso wider
+                float width = (part == 0 || part == 1) ? b.limbWidth * 2 : b.limbWidth;
+                batch.add(drawn, part,
+                          x + (source[{p, idx1, 0}] - b.centerX) * k, seat.baseline + (source[{p, idx1, 1}] - b.feet) * k,
+                          x + (source[{p, idx2, 0}] - b.centerX) * k, seat.baseline + (source[{p, idx2, 1}] - b.feet) * k,
+                          width * k);
+            }
+            if (source[{p, 0, 2}] != 0)
+                heads.push_back(std::make_pair(drawn, headInstance(x + (source[{p, 0, 0}] - b.centerX) * k,
+                                                                   seat.baseline + (source[{p, 0, 1}] - b.feet) * k,
+                                                                   b.faceRadius * k)));
+            drawn++;
+        }
+        batch.compute();
+
+        // limbs then head of every avatar, in draw order
+        size_t limb = 0, head = 0;
+        for (int a = 0; a < drawn; a++) {
+            for (; limb < batch.size() && batch.person[limb] == a; limb++)
+                instances.push_back(batch.instance(limb, batch.limb[limb]));
+            if (head < heads.size() && heads[head].first == a)
+                instances.push_back(heads[head++].second);
+        }
+
+        frameDrawn += drawn;
+        frameLow += low;
+        frameCulled += active - drawn;
+        frameInstances += instances.size();
+    }
+
+    // call once per frame, after presenting; prints the averages every CROWD_REPORT_FRAMES
+    // frames when reporting or sweeping, then steps the sweep
+    void endFrame(bool report) {
+        auto now = std::chrono::steady_clock::now();
+        frameTime += now - lastFrame;
+        lastFrame = now;
+        if (++frames < CROWD_REPORT_FRAMES)
+            return;
+        if (report || sweep) {
+            std::cout << "crowd: " << active << " avatars, " << frameTime.count() / frames << " ms per frame, "
+                      << frameDrawn / (double)frames << " drawn (" << frameLow / (double)frames << " low detail), "
+                      << frameCulled / (double)frames << " culled, "
+                      << frameInstances / (double)frames << " instances" << std::endl;
+        }
+        if (sweep && active < (int)seats.size())
+            active = std::min(2 * active, (int)seats.size());
+        else if (sweep)
+            swept = true;
+        frames = 0;
+        frameDrawn = frameLow = frameCulled = frameInstances = 0;
+        frameTime = std::chrono::duration<double, std::milli>::zero();
+    }
+
+private:
+    // seat position in front row view units from the middle of the stands, its feet on screen
+    // and its scale
+    struct Seat {
+        float x, baseline, scale;
+    };
+
+    struct Bounds {
+        float centerX, feet, halfWidth, height;
+        float faceRadius, limbWidth;
+    };
+
+    std::vector<Seat> seats;
+    int active = 0;
+    float lod = 0.0f;
+    bool sweep = false;
+    bool swept = false;
+    std::vector<Bounds> bounds;
+    std::vector<std::pair<int, LimbInstance>> heads;
+
+    unsigned int frames = 0;
+    unsigned long frameDrawn = 0;
+    unsigned long frameLow = 0;
+    unsigned long frameCulled = 0;
+    unsigned long frameInstances = 0;
+    std::chrono::steady_clock::time_point lastFrame;
+    std::chrono::duration<double, std::milli> frameTime = std::chrono::duration<double, std::milli>::zero();
+};
+
+#endif
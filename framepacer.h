@@ -0,0 +1,103 @@
+#ifndef FRAMEPACER
+#define FRAMEPACER
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include <glad/glad.h>
+
+// upper bound of the frames the GPU may still be working on when the CPU starts the next one
+const int MAX_FRAMES_IN_FLIGHT = 3;
+
+
+// explicit frame pacing at the end of each frame
+// every presented frame is fenced, and the CPU does not start a new frame while more than
+// framesInFlight frames are unfinished on the GPU (0 waits for each frame to finish), so
+// the driver queue stays shallow instead of filling up and draining in bursts; an optional
+// frame rate cap sleeps until the next frame is due rather than spinning
+class FramePacer {
+public:
+    FramePacer(int framesInFlight, double targetFps) {
+        maxInFlight = framesInFlight < 0 ? 0 : framesInFlight > MAX_FRAMES_IN_FLIGHT ? MAX_FRAMES_IN_FLIGHT : framesInFlight;
+        if (targetFps > 0.0)
+            period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / targetFps));
+        for (int i = 0; i <= MAX_FRAMES_IN_FLIGHT; i++)
+            fence[i] = 0;
+        deadline = lastFrame = std::chrono::steady_clock::now();
+    }
+
+    // call after presenting the frame
+    void endFrame() {
+        fence[next] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        next = (next + 1) % (maxInFlight + 1);
+
+        // the slot to be fenced next holds the newest frame that has to be finished
+        auto start = std::chrono::steady_clock::now();
+        if (fence[next] != 0) {
+            glClientWaitSync(fence[next], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(fence[next]);
+            fence[next] = 0;
+        }
+        auto now = std::chrono::steady_clock::now();
+        fenceTime += now - start;
+
+        // frames running late start right away, without catching up in a burst
+        if (period.count() > 0) {
+            deadline += period;
+            if (deadline > now) {
+                std::this_thread::sleep_until(deadline);
+                sleepTime += std::chrono::steady_clock::now() - now;
+                now = std::chrono::steady_clock::now();
+            } else {
+                deadline = now;
+            }
+        }
+
+        std::chrono::duration<double, std::milli> frameTime = now - lastFrame;
+        lastFrame = now;
+        if (frames == 0 || frameTime < shortestFrame)
+            shortestFrame = frameTime;
+        if (frames == 0 || frameTime > longestFrame)
+            longestFrame = frameTime;
+        totalFrameTime += frameTime;
+        frames++;
+    }
+
+    // frame time spread and the time spent waiting since the last report
+    void report() {
+        if (frames == 0)
+            return;
+        std::cout << "pacing: " << totalFrameTime.count() / frames << " ms per frame ("
+                  << shortestFrame.count() << " - " << longestFrame.count() << " ms), "
+                  << fenceTime.count() / frames << " ms fence wait, "
+                  << sleepTime.count() / frames << " ms sleep, "
+                  << maxInFlight << " frames in flight" << std::endl;
+        frames = 0;
+        totalFrameTime = fenceTime = sleepTime = std::chrono::duration<double, std::milli>::zero();
+    }
+
+    void free() {
+        for (int i = 0; i <= MAX_FRAMES_IN_FLIGHT; i++) {
+            if (fence[i] != 0)
+                glDeleteSync(fence[i]);
+            fence[i] = 0;
+        }
+    }
+
+private:
+    int maxInFlight;
+    GLsync fence[MAX_FRAMES_IN_FLIGHT + 1];
+    int next = 0;
+    std::chrono::steady_clock::duration period = std::chrono::steady_clock::duration::zero();
+    std::chrono::steady_clock::time_point deadline, lastFrame;
+
+    unsigned int frames = 0;
+    std::chrono::duration<double, std::milli> totalFrameTime = std::chrono::duration<double, std::milli>::zero();
+    std::chrono::duration<double, std::milli> shortestFrame = std::chrono::duration<double, std::milli>::zero();
+    std::chrono::duration<double, std::milli> longestFrame = std::chrono::duration<double, std::milli>::zero();
+    std::chrono::duration<double, std::milli> fenceTime = std::chrono::duration<double, std::milli>::zero();
+    std::chrono::duration<double, std::milli> sleepTime = std::chrono::duration<double, std::milli>::zero();
+};
+
+#endif
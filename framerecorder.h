@@ -0,0 +1,252 @@
+#ifndef FRAMERECORDER
+#define FRAMERECORDER
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glad/glad.h>
+#include <opencv2/opencv.hpp>
+
+// frames read back asynchronously, a readback is mapped READBACK_RING - 1 frames after it was issued
+const int READBACK_RING = 3;
+
+
+// records the rendered frames to a video file without stalling the render loop
+// each frame is read into a pixel pack buffer guarded by a fence and mapped two frames
+// later, when the GPU is long done with it; the pixels go to an encoder thread through
+// a bounded queue, full queues drop the frame or, if configured, wait for the encoder
+// .y4m paths are written as raw I420, anything else goes through cv::VideoWriter
+class FrameRecorder {
+public:
+    FrameRecorder() {}
+
+    ~FrameRecorder() {
+        close();
+    }
+
+    bool isOpen() const {
+        return open;
+    }
+
+    bool start(const std::string& path, int frameWidth, int frameHeight, double fps, int queueLimit, bool dropWhenFull) {
+        width = frameWidth;
+        height = frameHeight;
+        maxQueue = queueLimit < 1 ? 1 : queueLimit;
+        dropFrames = dropWhenFull;
+        frameBytes = (size_t)width * height * 4;
+
+        y4m = path.size() > 4 && path.compare(path.size() - 4, 4, ".y4m") == 0;
+        // I420 halves both sizes for the chroma planes
+        if (y4m && (width % 2 != 0 || height % 2 != 0)) {
+            std::cout << "ERROR::FRAMERECORDER::ODD_SIZE " << width << "x" << height << " cannot be written to "
+                      << path << std::endl;
+            return false;
+        }
+        if (y4m) {
+            y4mFile = std::fopen(path.c_str(), "wb");
+            if (y4mFile == NULL) {
+                std::cout << "ERROR::FRAMERECORDER::FILE_NOT_OPENED " << path << std::endl;
+                return false;
+            }
+            std::fprintf(y4mFile, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, (int)(fps + 0.5));
+        } else {
+            writer.open(path, CV_FOURCC('m', 'p', '4', 'v'), fps, cv::Size(width, height));
+            if (!writer.isOpened()) {
+                std::cout << "ERROR::FRAMERECORDER::FILE_NOT_OPENED " << path << std::endl;
+                return false;
+            }
+        }
+
+        glGenBuffers(READBACK_RING, pbo);
+        for (int i = 0; i < READBACK_RING; i++) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, frameBytes, NULL, GL_STREAM_READ);
+            fence[i] = 0;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        open = true;
+        stopping = false;
+        encoder = std::thread(&FrameRecorder::run, this);
+        return true;
+    }
+
+    // queue the readback of the finished frame in the bound read framebuffer and
+    // hand the frame read back READBACK_RING - 1 calls ago to the encoder
+    void capture() {
+        if (!open)
+            return;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[next]);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, width, height, GL_BGRA, GL_UNSIGNED_BYTE, (void*)0);
+        fence[next] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        next = (next + 1) % READBACK_RING;
+
+        // the oldest readback is the one to be overwritten next
+        if (fence[next] != 0)
+            collect(next);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // encode the readbacks still in flight, wait for the encoder and close the file
+    void close() {
+        if (!open)
+            return;
+        for (int i = 1; i <= READBACK_RING; i++) {
+            int slot = (next + i) % READBACK_RING;
+            if (fence[slot] != 0)
+                collect(slot);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glDeleteBuffers(READBACK_RING, pbo);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        frameQueued.notify_one();
+        encoder.join();
+        if (y4m)
+            std::fclose(y4mFile);
+        else
+            writer.release();
+        open = false;
+    }
+
+    // readback stall, queue depth and drops since the last report
+    void report() {
+        size_t depth, peak;
+        unsigned int encodedFrames, droppedFrames;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            depth = queue.size();
+            peak = peakQueue;
+            encodedFrames = encoded;
+            droppedFrames = dropped;
+            peakQueue = depth;
+            encoded = dropped = 0;
+        }
+        std::cout << "recording: " << (readbacks ? stallTime.count() / readbacks : 0.0) << " ms readback stall per frame, "
+                  << "queue " << depth << "/" << maxQueue << " (peak " << peak << "), "
+                  << encodedFrames << " encoded, " << droppedFrames << " dropped" << std::endl;
+        stallTime = std::chrono::duration<double, std::milli>::zero();
+        readbacks = 0;
+    }
+
+private:
+    bool open = false;
+    int width = 0;
+    int height = 0;
+    size_t frameBytes = 0;
+    int maxQueue = 1;
+    bool dropFrames = true;
+
+    // render thread state
+    unsigned int pbo[READBACK_RING];
+    GLsync fence[READBACK_RING];
+    int next = 0;
+    unsigned int readbacks = 0;
+    std::chrono::duration<double, std::milli> stallTime = std::chrono::duration<double, std::milli>::zero();
+
+    // shared with the encoder, guarded by mutex
+    std::thread encoder;
+    std::mutex mutex;
+    std::condition_variable frameQueued;
+    std::condition_variable frameTaken;
+    std::deque<cv::Mat> queue;
+    // finished frame buffers, reused to avoid an allocation per frame
+    std::vector<cv::Mat> pool;
+    bool stopping = false;
+    size_t peakQueue = 0;
+    unsigned int encoded = 0;
+    unsigned int dropped = 0;
+
+    // encoder thread state
+    bool y4m = false;
+    FILE* y4mFile = NULL;
+    cv::VideoWriter writer;
+
+    // wait for the readback in a slot, copy it out and queue it for encoding
+    void collect(int slot) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[slot]);
+        auto start = std::chrono::steady_clock::now();
+        glClientWaitSync(fence[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(fence[slot]);
+        fence[slot] = 0;
+        const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameBytes, GL_MAP_READ_BIT);
+        stallTime += std::chrono::steady_clock::now() - start;
+        readbacks++;
+        if (pixels == NULL)
+            return;
+
+        cv::Mat frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if ((int)queue.size() >= maxQueue) {
+                if (dropFrames) {
+                    dropped++;
+                    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                    return;
+                }
+                frameTaken.wait(lock, [this] { return (int)queue.size() < maxQueue; });
+            }
+            if (!pool.empty()) {
+                frame = pool.back();
+                pool.pop_back();
+            }
+        }
+        if (frame.empty())
+            frame.create(height, width, CV_8UC4);
+        std::memcpy(frame.data, pixels, frameBytes);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(frame);
+            if (queue.size() > peakQueue)
+                peakQueue = queue.size();
+        }
+        frameQueued.notify_one();
+    }
+
+    void run() {
+        cv::Mat upright, converted;
+        while (true) {
+            cv::Mat frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                frameQueued.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (queue.empty())
+                    return;
+                frame = queue.front();
+                queue.pop_front();
+            }
+            frameTaken.notify_one();
+
+            // GL rows start at the bottom
+            cv::flip(frame, upright, 0);
+            if (y4m) {
+                cv::cvtColor(upright, converted, cv::COLOR_BGRA2YUV_I420);
+                std::fputs("FRAME\n", y4mFile);
+                std::fwrite(converted.data, 1, converted.total() * converted.elemSize(), y4mFile);
+            } else {
+                cv::cvtColor(upright, converted, cv::COLOR_BGRA2BGR);
+                writer.write(converted);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            pool.push_back(frame);
+            encoded++;
+        }
+    }
+};
+
+#endif
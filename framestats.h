@@ -0,0 +1,81 @@
+#ifndef FRAMESTATS
+#define FRAMESTATS
+
+#include <chrono>
+#include <iostream>
+
+
+// per-frame GL call counters and render CPU time, averaged over a number of frames
+class FrameStats {
+public:
+    // counters of the current frame
+    unsigned int drawCalls = 0;
+    unsigned int uniformUploads = 0;
+    unsigned int bufferUploads = 0;
+    // state calls issued and skipped by the state cache
+    unsigned int stateCalls = 0;
+    unsigned int stateSkipped = 0;
+
+    explicit FrameStats(unsigned int reportInterval) : reportInterval(reportInterval) {}
+
+    // CPU time spent issuing GL calls for the frame
+    void beginRender() {
+        renderStart = std::chrono::steady_clock::now();
+    }
+
+    void endRender() {
+        renderTime += std::chrono::steady_clock::now() - renderStart;
+    }
+
+    // CPU time spent handing the camera frame to GL
+    void beginUpload() {
+        uploadStart = std::chrono::steady_clock::now();
+    }
+
+    void endUpload() {
+        uploadTime += std::chrono::steady_clock::now() - uploadStart;
+    }
+
+    // accumulate the frame and print the averages every reportInterval frames,
+    // true on the frames that end a report interval
+    bool endFrame(bool report) {
+        frames++;
+        totalDrawCalls += drawCalls;
+        totalUniformUploads += uniformUploads;
+        totalBufferUploads += bufferUploads;
+        totalStateCalls += stateCalls;
+        totalStateSkipped += stateSkipped;
+        drawCalls = uniformUploads = bufferUploads = stateCalls = stateSkipped = 0;
+
+        if (frames < reportInterval)
+            return false;
+        if (report) {
+            std::cout << "per frame over " << frames << " frames: "
+                      << totalDrawCalls / (double)frames << " draw calls, "
+                      << totalUniformUploads / (double)frames << " uniform uploads, "
+                      << totalBufferUploads / (double)frames << " buffer uploads, "
+                      << totalStateCalls / (double)frames << " state calls ("
+                      << totalStateSkipped / (double)frames << " redundant skipped), "
+                      << renderTime.count() / frames << " ms render CPU, "
+                      << uploadTime.count() / frames << " ms upload CPU" << std::endl;
+        }
+        frames = 0;
+        totalDrawCalls = totalUniformUploads = totalBufferUploads = totalStateCalls = totalStateSkipped = 0;
+        renderTime = uploadTime = std::chrono::duration<double, std::milli>::zero();
+        return true;
+    }
+
+private:
+    unsigned int reportInterval;
+    unsigned int frames = 0;
+    unsigned long totalDrawCalls = 0;
+    unsigned long totalUniformUploads = 0;
+    unsigned long totalBufferUploads = 0;
+    unsigned long totalStateCalls = 0;
+    unsigned long totalStateSkipped = 0;
+    std::chrono::steady_clock::time_point renderStart, uploadStart;
+    std::chrono::duration<double, std::milli> renderTime = std::chrono::duration<double, std::milli>::zero();
+    std::chrono::duration<double, std::milli> uploadTime = std::chrono::duration<double, std::milli>::zero();
+};
+
+#endif
@@ -0,0 +1,264 @@
+#ifndef GESTURE
+#define GESTURE
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <math.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+// body joints used for gestures (BODY_25 0-14: head, arms, torso, legs)
+const int GESTURE_JOINTS = 15;
+// feature dimension, x and y of each joint padded to the SIMD width
+const int GESTURE_DIMS = 32;
+
+// streaming gesture recognition with subsequence DTW
+// every template keeps one DTW column that is advanced by a single frame per update,
+// so a template match can start at any frame and the cost per frame is constant:
+// one vectorized distance pass over all template frames, then one column update per template
+//
+// template file format, one template per block:
+//      name threshold length
+//      length lines of 2 * GESTURE_JOINTS values, joints relative to the neck in torso lengths
+class GestureEngine {
+public:
+    // called with the template name and its normalized DTW cost when a gesture is recognized
+    std::function<void(const std::string&, float)> onGesture;
+
+    // idealized skeleton gestures: T-pose, both arms raised, right hand wave
+    void addBuiltinTemplates() {
+        std::vector<float> pose;
+
+        pose = restPose();
+        setArm(pose, 0, -0.85f, 0.0f, -1.35f, 0.0f);
+        setArm(pose, 1, 0.85f, 0.0f, 1.35f, 0.0f);
+        addTemplate("t-pose", 0.2f, std::vector<std::vector<float>>(6, pose));
+
+        pose = restPose();
+        setArm(pose, 0, -0.45f, -0.5f, -0.5f, -1.0f);
+        setArm(pose, 1, 0.45f, -0.5f, 0.5f, -1.0f);
+        addTemplate("raise-arms", 0.2f, std::vector<std::vector<float>>(6, pose));
+
+        std::vector<std::vector<float>> wave;
+        for (int f = 0; f < 16; f++) {
+            pose = restPose();
+            float swing = 0.25f * sinf(f * 2.0f * (float)M_PI / 8.0f);
+            setArm(pose, 0, -0.75f, 0.05f, -0.8f + swing, -0.5f);
+            wave.push_back(pose);
+        }
+        addTemplate("wave", 0.25f, wave);
+    }
+
+    bool loadTemplates(const std::string& path) {
+        std::ifstream file(path);
+        if (!file) {
+            std::cout << "ERROR::GESTURE::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+            return false;
+        }
+        std::string name;
+        float threshold;
+        int length;
+        while (file >> name >> threshold >> length) {
+            if (length <= 0) {
+                std::cout << "ERROR::GESTURE::INVALID_TEMPLATE_LENGTH " << name << " " << length << std::endl;
+                return false;
+            }
+            std::vector<std::vector<float>> frames(length, std::vector<float>(2 * GESTURE_JOINTS));
+            for (int f = 0; f < length; f++)
+                for (int d = 0; d < 2 * GESTURE_JOINTS; d++)
+                    file >> frames[f][d];
+            if (!file) {
+                std::cout << "ERROR::GESTURE::TRUNCATED_TEMPLATE " << name << std::endl;
+                return false;
+            }
+            addTemplate(name, threshold, frames);
+        }
+        return true;
+    }
+
+    // frames hold 2 * GESTURE_JOINTS normalized coordinates each
+    void addTemplate(const std::string& name, float threshold, const std::vector<std::vector<float>>& frames) {
+        Template t;
+        t.name = name;
+        t.threshold = threshold;
+        t.offset = totalFrames();
+        t.length = frames.size();
+        t.column.assign(t.length + 1, std::numeric_limits<float>::infinity());
+        t.column[0] = 0.0f;
+        t.cooldown = 0;
+        for (size_t f = 0; f < frames.size(); f++) {
+            for (int d = 0; d < GESTURE_DIMS; d++)
+                templateFrames.push_back(d < 2 * GESTURE_JOINTS ? frames[f][d] : 0.0f);
+        }
+        templates.push_back(t);
+        distances.resize(totalFrames());
+    }
+
+    size_t templateCount() const {
+        return templates.size();
+    }
+
+    int totalFrames() const {
+        return templateFrames.size() / GESTURE_DIMS;
+    }
+
+    // advance every template by one pose of 25 keypoints (x, y, conf)
+    // poses without a visible torso reset the stream
+    void update(const float* keypoints) {
+        if (!features(keypoints)) {
+            reset();
+            return;
+        }
+        frameDistances(templateFrames.data(), feature, weight, distances.data(), totalFrames());
+
+        for (size_t k = 0; k < templates.size(); k++) {
+            Template& t = templates[k];
+            const float* d = distances.data() + t.offset;
+            // D[i] = d_i + min(D[i - 1], D_prev[i], D_prev[i - 1]), D[0] = 0 so matches start anywhere
+            float diagonal = t.column[0];
+            for (int i = 1; i <= t.length; i++) {
+                float up = t.column[i];
+                t.column[i] = d[i - 1] + std::min(std::min(t.column[i - 1], up), diagonal);
+                diagonal = up;
+            }
+
+            if (t.cooldown > 0) {
+                t.cooldown--;
+                continue;
+            }
+            float cost = t.column[t.length] / t.length;
+            if (cost < t.threshold) {
+                if (onGesture)
+                    onGesture(t.name, cost);
+                t.cooldown = t.length;
+                std::fill(t.column.begin() + 1, t.column.end(), std::numeric_limits<float>::infinity());
+            }
+        }
+    }
+
+    void reset() {
+        for (size_t k = 0; k < templates.size(); k++)
+            std::fill(templates[k].column.begin() + 1, templates[k].column.end(),
+                      std::numeric_limits<float>::infinity());
+    }
+
+    // weighted squared distances between one feature and n template frames
+    static void frameDistances(const float* frames, const float* x, const float* w, float* out, int n) {
+#if defined(__AVX__)
+        __m256 x0 = _mm256_loadu_ps(x), x1 = _mm256_loadu_ps(x + 8);
+        __m256 x2 = _mm256_loadu_ps(x + 16), x3 = _mm256_loadu_ps(x + 24);
+        __m256 w0 = _mm256_loadu_ps(w), w1 = _mm256_loadu_ps(w + 8);
+        __m256 w2 = _mm256_loadu_ps(w + 16), w3 = _mm256_loadu_ps(w + 24);
+        for (int f = 0; f < n; f++) {
+            const float* t = frames + f * GESTURE_DIMS;
+            __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(t), x0);
+            __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(t + 8), x1);
+            __m256 d2 = _mm256_sub_ps(_mm256_loadu_ps(t + 16), x2);
+            __m256 d3 = _mm256_sub_ps(_mm256_loadu_ps(t + 24), x3);
+            __m256 acc = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(d0, d0), w0),
+                                                     _mm256_mul_ps(_mm256_mul_ps(d1, d1), w1)),
+                                       _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(d2, d2), w2),
+                                                     _mm256_mul_ps(_mm256_mul_ps(d3, d3), w3)));
+            __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+            sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+            sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+            out[f] = _mm_cvtss_f32(sum);
+        }
+#elif defined(__SSE2__)
+        for (int f = 0; f < n; f++) {
+            const float* t = frames + f * GESTURE_DIMS;
+            __m128 acc = _mm_setzero_ps();
+            for (int d = 0; d < GESTURE_DIMS; d += 4) {
+                __m128 diff = _mm_sub_ps(_mm_loadu_ps(t + d), _mm_loadu_ps(x + d));
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_mul_ps(diff, diff), _mm_loadu_ps(w + d)));
+            }
+            acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+            acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+            out[f] = _mm_cvtss_f32(acc);
+        }
+#else
+        for (int f = 0; f < n; f++) {
+            const float* t = frames + f * GESTURE_DIMS;
+            float acc = 0.0f;
+            for (int d = 0; d < GESTURE_DIMS; d++)
+                acc += (t[d] - x[d]) * (t[d] - x[d]) * w[d];
+            out[f] = acc;
+        }
+#endif
+    }
+
+private:
+    struct Template {
+        std::string name;
+        float threshold;
+        int offset, length;
+        std::vector<float> column;
+        int cooldown;
+    };
+
+    std::vector<Template> templates;
+    // all template frames back to back, GESTURE_DIMS floats each
+    std::vector<float> templateFrames;
+    std::vector<float> distances;
+    // live feature and its per-dimension weight, zero for undetected joints
+    float feature[GESTURE_DIMS];
+    float weight[GESTURE_DIMS];
+
+    // joints relative to the neck in torso lengths
+    bool features(const float* keypoints) {
+        const float* neck = keypoints + 1 * 3;
+        const float* hip = keypoints + 8 * 3;
+        if (neck[2] == 0 || hip[2] == 0)
+            return false;
+        float torso = sqrtf((neck[0] - hip[0]) * (neck[0] - hip[0]) + (neck[1] - hip[1]) * (neck[1] - hip[1]));
+        if (torso <= 0.0f)
+            return false;
+
+        for (int d = 0; d < GESTURE_DIMS; d++) {
+            feature[d] = 0.0f;
+            weight[d] = 0.0f;
+        }
+        for (int j = 0; j < GESTURE_JOINTS; j++) {
+            if (keypoints[j * 3 + 2] == 0)
+                continue;
+            feature[2 * j] = (keypoints[j * 3] - neck[0]) / torso;
+            feature[2 * j + 1] = (keypoints[j * 3 + 1] - neck[1]) / torso;
+            weight[2 * j] = weight[2 * j + 1] = 1.0f;
+        }
+        return true;
+    }
+
+    // standing skeleton, arms down
+    static std::vector<float> restPose() {
+        const float joints[GESTURE_JOINTS][2] = {{0.0f, -0.45f},                                // nose
+                                                 {0.0f, 0.0f},                                  // neck
+                                                 {-0.35f, 0.0f}, {-0.4f, 0.5f}, {-0.4f, 1.0f},  // right arm
+                                                 {0.35f, 0.0f}, {0.4f, 0.5f}, {0.4f, 1.0f},     // left arm
+                                                 {0.0f, 1.0f},                                  // mid hip
+                                                 {-0.15f, 1.0f}, {-0.15f, 1.6f}, {-0.15f, 2.2f},// right leg
+                                                 {0.15f, 1.0f}, {0.15f, 1.6f}, {0.15f, 2.2f}};  // left leg
+        return std::vector<float>(&joints[0][0], &joints[0][0] + 2 * GESTURE_JOINTS);
+    }
+
+    // side 0 is the right arm (joints 3, 4), side 1 the left arm (joints 6, 7)
+    static void setArm(std::vector<float>& pose, int side, float ex, float ey, float wx, float wy) {
+        int elbow = side == 0 ? 3 : 6;
+        pose[2 * elbow] = ex;
+        pose[2 * elbow + 1] = ey;
+        pose[2 * elbow + 2] = wx;
+        pose[2 * elbow + 3] = wy;
+    }
+};
+
+#endif
@@ -0,0 +1,239 @@
+#ifndef GLCONTEXT
+#define GLCONTEXT
+
+#include <iostream>
+#include <set>
+#include <string>
+
+// keep X11 out of the EGL headers, its macros clash with OpenCV and OpenPose
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "glstate.h"
+
+
+// OpenGL 3.3 core context to render into: a GLFW window, or headless through EGL
+// without any surface, drawing into a framebuffer object of the requested size
+// (works with Mesa llvmpipe on machines without a GPU or X server)
+class RenderContext {
+public:
+    int width = 0;
+    int height = 0;
+    bool headless = false;
+    // framebuffer the frame is drawn into, 0 for the window
+    unsigned int framebuffer = 0;
+
+    bool create(bool offscreen, int w, int h, const char* title) {
+        headless = offscreen;
+        width = w;
+        height = h;
+        return headless ? createHeadless() : createWindow(title);
+    }
+
+    // swap interval policy: wait for the vertical blank, wait only when the frame is on time
+    // and tear when it is late, or never wait; headless has no surface to wait for
+    void setSwapInterval(const std::string& mode) {
+        if (headless)
+            return;
+        int interval = 1;
+        if (mode == "off") {
+            interval = 0;
+        } else if (mode == "adaptive") {
+            if (glfwExtensionSupported("GLX_EXT_swap_control_tear") || glfwExtensionSupported("WGL_EXT_swap_control_tear"))
+                interval = -1;
+            else
+                std::cout << "Adaptive vsync is not supported, using vsync" << std::endl;
+        }
+        glfwSwapInterval(interval);
+    }
+
+    // current size of the framebuffer drawn to, the window may have been resized
+    void framebufferSize(int& w, int& h) {
+        if (headless) {
+            w = width;
+            h = height;
+        } else {
+            glfwGetFramebufferSize(window, &w, &h);
+        }
+    }
+
+    // false once the window is closed or escape is pressed, headless runs until the input ends
+    bool running() {
+        if (headless)
+            return true;
+        if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+            glfwSetWindowShouldClose(window, true);
+        return !glfwWindowShouldClose(window);
+    }
+
+    // true once per press of a key, headless has no keyboard
+    bool keyPressed(int key) {
+        if (headless)
+            return false;
+        bool down = glfwGetKey(window, key) == GLFW_PRESS;
+        bool pressed = down && held.count(key) == 0;
+        if (down)
+            held.insert(key);
+        else
+            held.erase(key);
+        return pressed;
+    }
+
+    // second context sharing textures and buffers with this one, made current on a worker
+    // thread to upload without blocking the render loop; a hidden window or a surfaceless
+    // EGL context, created here on the render thread
+    bool createUploadContext() {
+        if (headless) {
+            const EGLint contextAttribs[] = {EGL_CONTEXT_MAJOR_VERSION, 3,
+                                             EGL_CONTEXT_MINOR_VERSION, 3,
+                                             EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                             EGL_NONE};
+            uploadContext = eglCreateContext(display, config, context, contextAttribs);
+            if (uploadContext == EGL_NO_CONTEXT) {
+                std::cout << "Failed to create the EGL upload context" << std::endl;
+                return false;
+            }
+        } else {
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+            uploadWindow = glfwCreateWindow(1, 1, "", NULL, window);
+            glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+            if (uploadWindow == NULL) {
+                std::cout << "Failed to create the GLFW upload context" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // on the worker thread, before its first and after its last GL call
+    bool makeUploadCurrent() {
+        if (headless)
+            return eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, uploadContext);
+        glfwMakeContextCurrent(uploadWindow);
+        return true;
+    }
+
+    void releaseUploadContext() {
+        if (headless)
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        else
+            glfwMakeContextCurrent(NULL);
+    }
+
+    // show the frame, headless only submits the queued commands
+    void present() {
+        if (headless) {
+            glFlush();
+        } else {
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+    }
+
+    void destroy() {
+        if (headless) {
+            glDeleteFramebuffers(1, &framebuffer);
+            glDeleteRenderbuffers(1, &colorBuffer);
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (uploadContext != EGL_NO_CONTEXT)
+                eglDestroyContext(display, uploadContext);
+            eglDestroyContext(display, context);
+            eglTerminate(display);
+        } else {
+            glfwTerminate();
+        }
+    }
+
+private:
+    GLFWwindow* window = NULL;
+    GLFWwindow* uploadWindow = NULL;
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLConfig config = NULL;
+    EGLContext context = EGL_NO_CONTEXT;
+    EGLContext uploadContext = EGL_NO_CONTEXT;
+    std::set<int> held;
+    unsigned int colorBuffer = 0;
+
+    bool createWindow(const char* title) {
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        window = glfwCreateWindow(width, height, title, NULL, NULL);
+        if (window == NULL) {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return false;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool createHeadless() {
+        // surfaceless platform first, the default display works on drivers without it
+        display = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+            std::cout << "Failed to initialize EGL" << std::endl;
+            return false;
+        }
+        if (!eglBindAPI(EGL_OPENGL_API)) {
+            std::cout << "EGL has no desktop OpenGL" << std::endl;
+            return false;
+        }
+
+        // no surface is ever created, so any config (or none) will do
+        EGLint configCount = 0;
+        const EGLint configAttribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+        eglChooseConfig(display, configAttribs, &config, 1, &configCount);
+        if (configCount == 0)
+            config = NULL;
+        const EGLint contextAttribs[] = {EGL_CONTEXT_MAJOR_VERSION, 3,
+                                         EGL_CONTEXT_MINOR_VERSION, 3,
+                                         EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                         EGL_NONE};
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+        if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+            std::cout << "Failed to create EGL context" << std::endl;
+            return false;
+        }
+
+        if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return false;
+        }
+
+        // offscreen color target in place of the window
+        glGenRenderbuffers(1, &colorBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "ERROR::CONTEXT::FRAMEBUFFER_NOT_COMPLETE" << std::endl;
+            return false;
+        }
+        glState().viewport(0, 0, width, height);
+        return true;
+    }
+
+    // set viewport to window dimensions
+    static void framebufferSizeCallback(GLFWwindow* window, int w, int h) {
+        glState().viewport(0, 0, w, h);
+    }
+};
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef GLSTATE
+#define GLSTATE
+
+#include <glad/glad.h>
+
+
+// cache of the bound OpenGL state, calls that would not change anything are skipped
+// all binds of program, vertex array, textures, blend and viewport should go through it;
+// after touching that state directly, call invalidate() so the next call is issued
+class GLState {
+public:
+    static const int MAX_UNITS = 16;
+
+    // calls issued to the driver and calls skipped as redundant, since resetCounters()
+    unsigned int issued = 0;
+    unsigned int skipped = 0;
+
+    GLState() {
+        invalidate();
+    }
+
+    void invalidate() {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (int u = 0; u < MAX_UNITS; u++) {
+            for (int t = 0; t < TARGETS; t++)
+                textures[u][t] = UNKNOWN;
+        }
+        blend = UNKNOWN;
+        blendSrc = blendDst = UNKNOWN;
+        viewportRect[0] = viewportRect[1] = viewportRect[2] = viewportRect[3] = UNKNOWN;
+    }
+
+    void resetCounters() {
+        issued = skipped = 0;
+    }
+
+    void useProgram(unsigned int id) {
+        if (changed(program, id))
+            glUseProgram(id);
+    }
+
+    // forget a program that is being deleted, ids can be reused
+    void forgetProgram(unsigned int id) {
+        if (program == id)
+            program = UNKNOWN;
+    }
+
+    void bindVertexArray(unsigned int id) {
+        if (changed(vertexArray, id))
+            glBindVertexArray(id);
+    }
+
+    // texture unit that glTex* calls apply to
+    void activeTexture(unsigned int unit) {
+        if (changed(activeUnit, unit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    void bindTexture(unsigned int unit, GLenum target, unsigned int id) {
+        unsigned int& bound = textures[unit][targetIndex(target)];
+        if (bound == id) {
+            skipped++;
+            return;
+        }
+        activeTexture(unit);
+        bound = id;
+        issued++;
+        glBindTexture(target, id);
+    }
+
+    void setBlend(bool enabled) {
+        if (changed(blend, enabled ? 1u : 0u)) {
+            if (enabled)
+                glEnable(GL_BLEND);
+            else
+                glDisable(GL_BLEND);
+        }
+    }
+
+    void blendFunc(GLenum src, GLenum dst) {
+        if (blendSrc == src && blendDst == dst) {
+            skipped++;
+            return;
+        }
+        blendSrc = src;
+        blendDst = dst;
+        issued++;
+        glBlendFunc(src, dst);
+    }
+
+    void viewport(int x, int y, int width, int height) {
+        unsigned int rect[4] = {(unsigned int)x, (unsigned int)y, (unsigned int)width, (unsigned int)height};
+        if (rect[0] == viewportRect[0] && rect[1] == viewportRect[1] &&
+            rect[2] == viewportRect[2] && rect[3] == viewportRect[3]) {
+            skipped++;
+            return;
+        }
+        for (int i = 0; i < 4; i++)
+            viewportRect[i] = rect[i];
+        issued++;
+        glViewport(x, y, width, height);
+    }
+
+private:
+    static const unsigned int UNKNOWN = 0xFFFFFFFFu;
+    static const int TARGETS = 3;
+
+    unsigned int program;
+    unsigned int vertexArray;
+    unsigned int activeUnit;
+    unsigned int textures[MAX_UNITS][TARGETS];
+    unsigned int blend;
+    unsigned int blendSrc, blendDst;
+    unsigned int viewportRect[4];
+
+    // record the new value and count the call, false if it is already set
+    bool changed(unsigned int& current, unsigned int value) {
+        if (current == value) {
+            skipped++;
+            return false;
+        }
+        current = value;
+        issued++;
+        return true;
+    }
+
+    static int targetIndex(GLenum target) {
+        switch (target) {
+            case GL_TEXTURE_2D_ARRAY: return 1;
+            case GL_TEXTURE_BUFFER: return 2;
+            default: return 0;
+        }
+    }
+};
+
+// state cache of the current context
+inline GLState& glState() {
+    static GLState state;
+    return state;
+}
+
+#endif
@@ -0,0 +1,301 @@
+#ifndef HANDFACE
+#define HANDFACE
+
+#include <array>
+#include <condition_variable>
+#include <iostream>
+#include <math.h>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include <openpose/headers.hpp>
+
+
+const int HAND_POINTS = 21;
+const int FACE_POINTS = 70;
+const float HAND_FACE_MIN_CONFIDENCE = 0.2f;
+
+// hand bones, thumb to pinky
+const int handBones[20][2] = {  {0, 1},   {1, 2},   {2, 3},   {3, 4},
+                                {0, 5},   {5, 6},   {6, 7},   {7, 8},
+                                {0, 9},   {9, 10},  {10, 11}, {11, 12},
+                                {0, 13},  {13, 14}, {14, 15}, {15, 16},
+                                {0, 17},  {17, 18}, {18, 19}, {19, 20}};
+
+// face feature outlines: brows, nose, eyes, outer and inner lips
+// {first point, last point, closed loop}
+const int faceFeatures[8][3] = {{17, 21, 0},
+                                {22, 26, 0},
+                                {27, 30, 0},
+                                {31, 35, 0},
+                                {36, 41, 1},
+                                {42, 47, 1},
+                                {48, 59, 1},
+                                {60, 67, 1}};
+
+// segments connecting the face feature points
+inline std::vector<std::pair<int, int>> faceSegments() {
+    std::vector<std::pair<int, int>> segments;
+    for (unsigned int f = 0; f < sizeof(faceFeatures) / sizeof(faceFeatures[0]); f++) {
+        for (int i = faceFeatures[f][0]; i < faceFeatures[f][1]; i++)
+            segments.push_back(std::make_pair(i, i + 1));
+        if (faceFeatures[f][2])
+            segments.push_back(std::make_pair(faceFeatures[f][1], faceFeatures[f][0]));
+    }
+    return segments;
+}
+
+
+// hand and face keypoint estimation on ROIs around the body wrists and head
+// a second OpenPose instance with body estimation disabled runs on a worker thread every
+// few frames, using rectangles derived from the body keypoints; between updates the
+// detail keypoints are blended towards the newest result and follow their body anchor
+class HandFaceTracker {
+public:
+    HandFaceTracker(bool hands, bool face, int interval)
+        : hands(hands), face(face), interval(interval < 1 ? 1 : interval),
+          opWrapper{op::ThreadManagerMode::Asynchronous} {
+        // body network disabled, hands and face run on the provided rectangles only
+        op::WrapperStructPose wrapperStructPose{};
+        wrapperStructPose.poseMode = op::PoseMode::Disabled;
+        op::WrapperStructHand wrapperStructHand{};
+        wrapperStructHand.enable = hands;
+        wrapperStructHand.detector = op::Detector::Provided;
+        op::WrapperStructFace wrapperStructFace{};
+        wrapperStructFace.enable = face;
+        wrapperStructFace.detector = op::Detector::Provided;
+        opWrapper.configure(wrapperStructPose);
+        opWrapper.configure(wrapperStructHand);
+        opWrapper.configure(wrapperStructFace);
+        opWrapper.start();
+
+        worker = std::thread(&HandFaceTracker::run, this);
+    }
+
+    ~HandFaceTracker() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        jobReady.notify_one();
+        worker.join();
+        opWrapper.stop();
+    }
+
+    // called once per rendered frame with the body keypoints of that frame
+    void update(const cv::Mat& frame, const op::Array<float>& poseKeypoints) {
+        frameCount++;
+        int people = poseKeypoints.getSize(0);
+        currentAnchors.assign(people * 6, 0.0f);
+        for (int p = 0; p < people; p++)
+            anchorsOf(poseKeypoints, p, &currentAnchors[p * 6]);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        // pick up a finished result
+        if (finished) {
+            previous = latest;
+            latest = result;
+            finished = false;
+            updateFrame = frameCount;
+        }
+        // queue the next ROI estimation at the configured cadence
+        if (!busy && frameCount - submitFrame >= interval && people > 0) {
+            job.frame = frame.clone();
+            job.anchors = currentAnchors;
+            job.handRects.clear();
+            job.faceRects.clear();
+            for (int p = 0; p < people; p++) {
+                std::array<op::Rectangle<float>, 2> handRect = {{handROI(poseKeypoints, p, 7, 6),
+                                                                 handROI(poseKeypoints, p, 4, 3)}};
+                job.handRects.push_back(handRect);
+                job.faceRects.push_back(faceROI(poseKeypoints, p));
+            }
+            busy = true;
+            submitFrame = frameCount;
+            jobReady.notify_one();
+        }
+    }
+
+    // interpolated hand keypoints (21 x, y, conf) of a person, side 0 is left
+    // returns false if no estimate is available
+    bool handKeypoints(int person, int side, float* out) const {
+        if (!hands)
+            return false;
+        return interpolate(person, side * HAND_POINTS, HAND_POINTS, 2 * side, out);
+    }
+
+    // interpolated face keypoints (70 x, y, conf) of a person
+    bool faceKeypoints(int person, float* out) const {
+        if (!face)
+            return false;
+        return interpolate(person, 2 * HAND_POINTS, FACE_POINTS, 4, out);
+    }
+
+private:
+    // per person keypoints of one estimation: left hand, right hand, face
+    // stored relative to the body anchors they were estimated with
+    struct Result {
+        int people = 0;
+        std::vector<float> points;
+        std::vector<float> anchors;
+    };
+
+    struct Job {
+        cv::Mat frame;
+        std::vector<float> anchors;
+        std::vector<std::array<op::Rectangle<float>, 2>> handRects;
+        std::vector<op::Rectangle<float>> faceRects;
+    };
+
+    static const int POINTS_PER_PERSON = (2 * HAND_POINTS + FACE_POINTS) * 3;
+
+    bool hands, face;
+    int interval;
+    op::Wrapper opWrapper;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable jobReady;
+    bool stopping = false;
+    bool busy = false;
+    bool finished = false;
+    Job job;
+    Result result;
+
+    // render thread state
+    long frameCount = 0;
+    long submitFrame = -1000000;
+    long updateFrame = 0;
+    Result previous, latest;
+    std::vector<float> currentAnchors;
+
+    // left wrist, right wrist, nose; zero if not detected
+    static void anchorsOf(const op::Array<float>& kp, int p, float* anchors) {
+        const int idx[3] = {7, 4, 0};
+        for (int i = 0; i < 3; i++) {
+            bool found = kp[{p, idx[i], 2}] != 0;
+            anchors[2 * i] = found ? kp[{p, idx[i], 0}] : 0.0f;
+            anchors[2 * i + 1] = found ? kp[{p, idx[i], 1}] : 0.0f;
+        }
+    }
+
+    // square around the wrist, extended along the forearm, sized by the forearm length
+    static op::Rectangle<float> handROI(const op::Array<float>& kp, int p, int wrist, int elbow) {
+        if (kp[{p, wrist, 2}] == 0 || kp[{p, elbow, 2}] == 0)
+            return op::Rectangle<float>{};
+        float wx = kp[{p, wrist, 0}], wy = kp[{p, wrist, 1}];
+        float dx = wx - kp[{p, elbow, 0}], dy = wy - kp[{p, elbow, 1}];
+        float size = 1.5f * sqrtf(dx * dx + dy * dy);
+        float cx = wx + 0.33f * dx, cy = wy + 0.33f * dy;
+        return op::Rectangle<float>{cx - size / 2, cy - size / 2, size, size};
+    }
+
+    // square around the nose, sized by the nose to neck distance
+    static op::Rectangle<float> faceROI(const op::Array<float>& kp, int p) {
+        if (kp[{p, 0, 2}] == 0 || kp[{p, 1, 2}] == 0)
+            return op::Rectangle<float>{};
+        float nx = kp[{p, 0, 0}], ny = kp[{p, 0, 1}];
+        float dx = nx - kp[{p, 1, 0}], dy = ny - kp[{p, 1, 1}];
+        float size = 1.8f * sqrtf(dx * dx + dy * dy);
+        return op::Rectangle<float>{nx - size / 2, ny - size / 2, size, size};
+    }
+
+    bool interpolate(int person, int first, int count, int anchor, float* out) const {
+        if (person >= latest.people || person * 6 + anchor + 1 >= (int)currentAnchors.size())
+            return false;
+        const float* cur = &currentAnchors[person * 6 + anchor];
+        if (cur[0] == 0 && cur[1] == 0)
+            return false;
+        const float* next = &latest.points[person * POINTS_PER_PERSON + first * 3];
+        bool blend = person < previous.people;
+        const float* prev = blend ? &previous.points[person * POINTS_PER_PERSON + first * 3] : next;
+        float t = fminf(1.0f, (frameCount - updateFrame + 1) / (float)interval);
+
+        bool found = false;
+        for (int i = 0; i < count; i++) {
+            float conf = next[3 * i + 2];
+            bool hasPrev = prev[3 * i + 2] >= HAND_FACE_MIN_CONFIDENCE;
+            if (conf < HAND_FACE_MIN_CONFIDENCE) {
+                out[3 * i] = out[3 * i + 1] = out[3 * i + 2] = 0.0f;
+                continue;
+            }
+            float s = hasPrev ? t : 1.0f;
+            out[3 * i] = cur[0] + prev[3 * i] + s * (next[3 * i] - prev[3 * i]);
+            out[3 * i + 1] = cur[1] + prev[3 * i + 1] + s * (next[3 * i + 1] - prev[3 * i + 1]);
+            out[3 * i + 2] = conf;
+            found = true;
+        }
+        return found;
+    }
+
+    void run() {
+        while (true) {
+            Job current;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobReady.wait(lock, [this] { return stopping || busy; });
+                if (stopping)
+                    return;
+                current = job;
+            }
+
+            auto datumsPtr = std::make_shared<std::vector<std::shared_ptr<op::Datum>>>();
+            datumsPtr->emplace_back(std::make_shared<op::Datum>());
+            auto& datum = datumsPtr->at(0);
+            datum->cvInputData = OP_CV2OPCONSTMAT(current.frame);
+            datum->handRectangles = current.handRects;
+            datum->faceRectangles = current.faceRects;
+
+            Result estimate;
+            if (opWrapper.emplaceAndPop(datumsPtr) && datumsPtr != nullptr && !datumsPtr->empty())
+                estimate = collect(*datumsPtr->at(0), current.anchors);
+            else
+                std::cout << "Hand/face estimation failed" << std::endl;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            result = estimate;
+            finished = true;
+            busy = false;
+        }
+    }
+
+    // gather hand and face keypoints relative to their anchors
+    Result collect(const op::Datum& datum, const std::vector<float>& anchors) const {
+        Result r;
+        r.people = anchors.size() / 6;
+        r.anchors = anchors;
+        r.points.assign(r.people * POINTS_PER_PERSON, 0.0f);
+        for (int p = 0; p < r.people; p++) {
+            float* dst = &r.points[p * POINTS_PER_PERSON];
+            for (int side = 0; side < 2 && hands; side++) {
+                const op::Array<float>& hk = datum.handKeypoints[side];
+                if (p >= hk.getSize(0))
+                    continue;
+                const float* anchor = &anchors[p * 6 + 2 * side];
+                for (int i = 0; i < HAND_POINTS; i++) {
+                    float* point = dst + (side * HAND_POINTS + i) * 3;
+                    point[0] = hk[{p, i, 0}] - anchor[0];
+                    point[1] = hk[{p, i, 1}] - anchor[1];
+                    point[2] = hk[{p, i, 2}];
+                }
+            }
+            const op::Array<float>& fk = datum.faceKeypoints;
+            if (face && p < fk.getSize(0)) {
+                const float* anchor = &anchors[p * 6 + 4];
+                for (int i = 0; i < FACE_POINTS; i++) {
+                    float* point = dst + (2 * HAND_POINTS + i) * 3;
+                    point[0] = fk[{p, i, 0}] - anchor[0];
+                    point[1] = fk[{p, i, 1}] - anchor[1];
+                    point[2] = fk[{p, i, 2}];
+                }
+            }
+        }
+        return r;
+    }
+};
+
+#endif
@@ -0,0 +1,315 @@
+#ifndef HUD
+#define HUD
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+#include <openpose/headers.hpp>
+
+#include "glstate.h"
+#include "posestream.h"
+#include "shaderprogram.h"
+
+// stages timed every frame: camera read, pose inference (both on the capture thread), and
+// on the render thread, back to back so every millisecond of the frame is in one of them,
+// frame start with the avatar swap and background upload, pose processing, CPU render
+// submission, output with the recording readback and the overlay, and present
+const int HUD_CAPTURE = 0;
+const int HUD_INFERENCE = 1;
+const int HUD_UPLOAD = 2;
+const int HUD_POSE = 3;
+const int HUD_RENDER = 4;
+const int HUD_OUTPUT = 5;
+const int HUD_SWAP = 6;
+const int HUD_STAGES = 7;
+// frames shown in every graph, two pixels each
+const int HUD_SAMPLES = 120;
+// frames the fps is averaged over
+const int HUD_FPS_FRAMES = 30;
+
+// BODY_25 bones of the raw skeleton
+const unsigned int hudBones[24][2] = {{1, 8}, {1, 2}, {1, 5}, {2, 3}, {3, 4}, {5, 6}, {6, 7}, {8, 9},
+                                      {9, 10}, {10, 11}, {8, 12}, {12, 13}, {13, 14}, {1, 0}, {0, 15}, {15, 17},
+                                      {0, 16}, {16, 18}, {14, 19}, {19, 20}, {14, 21}, {11, 22}, {22, 23}, {11, 24}};
+
+// line vertex of the overlay in pixels from the top left, with its color
+struct HudVertex {
+    float position[2];
+    unsigned char color[4];
+};
+
+
+// performance overlay for diagnosing a running kiosk without a profiler: a timing graph of
+// every stage over the last HUD_SAMPLES frames with the newest value and the graph scale,
+// fps, capture to display latency and the cost of the overlay itself, drawn as one batch
+// of lines with seven segment text; and the newest detected skeleton drawn as one indexed
+// GL_LINES draw straight from the raw keypoints
+// timings are collected while the overlay is hidden, so it shows history when toggled on
+class PerfHud {
+public:
+    bool visible = false;
+
+    void init(bool show) {
+        visible = show;
+        std::fill(&samples[0][0], &samples[0][0] + HUD_STAGES * HUD_SAMPLES, 0.0f);
+        std::fill(current, current + HUD_STAGES, 0.0f);
+        std::fill(intervals, intervals + HUD_FPS_FRAMES, 0.0f);
+        lastMark = lastFrame = std::chrono::steady_clock::now();
+
+        glGenVertexArrays(1, &lineVAO);
+        glGenBuffers(1, &lineVBO);
+        glState().bindVertexArray(lineVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, lineVBO);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(HudVertex), (void*)offsetof(HudVertex, position));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(HudVertex), (void*)offsetof(HudVertex, color));
+        glEnableVertexAttribArray(1);
+
+        glGenVertexArrays(1, &skeletonVAO);
+        glGenBuffers(1, &skeletonVBO);
+        glGenBuffers(1, &skeletonEBO);
+        glState().bindVertexArray(skeletonVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, skeletonVBO);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0);
+        glEnableVertexAttribArray(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, skeletonEBO);
+        glState().bindVertexArray(0);
+    }
+
+    // start of the next timed stage
+    void mark() {
+        lastMark = std::chrono::steady_clock::now();
+    }
+
+    // time since the last mark as the given stage, and a new mark
+    void lap(int stage) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        current[stage] += std::chrono::duration<float, std::milli>(now - lastMark).count();
+        lastMark = now;
+    }
+
+    // stages of the newest inference result, kept until the next one
+    void pose(const PoseSample& sample) {
+        captureMs = sample.captureMs;
+        inferenceMs = sample.inferenceMs;
+        captureTime = sample.time;
+    }
+
+    // GPU time of the scene from the render scale timer queries, a few frames old; 0 when not measured
+    void gpu(float ms) {
+        gpuMs = ms;
+    }
+
+    // raw keypoints of the skeleton, [people][joints][x, y, confidence], kept while hidden
+    // and uploaded when next drawn, so toggling the overlay on never shows a stale skeleton
+    void skeleton(const op::Array<float>& keypoints) {
+        skeletonJoints = keypoints.getSize(0) == 0 ? 0 : keypoints.getSize(1);
+        skeletonPeople = skeletonJoints < 25 ? 0 : keypoints.getSize(0);
+        if (skeletonPeople == 0)
+            return;
+        skeletonPoints.assign(keypoints.getConstPtr(), keypoints.getConstPtr() + keypoints.getVolume());
+        skeletonChanged = true;
+    }
+
+    // after the frame was presented: the stages of the frame go into the graphs
+    void endFrame() {
+        current[HUD_CAPTURE] = captureMs;
+        current[HUD_INFERENCE] = inferenceMs;
+        for (int s = 0; s < HUD_STAGES; s++) {
+            samples[s][head] = current[s];
+            current[s] = 0.0f;
+        }
+        head = (head + 1) % HUD_SAMPLES;
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        intervals[frames++ % HUD_FPS_FRAMES] = std::chrono::duration<float, std::milli>(now - lastFrame).count();
+        lastFrame = now;
+        latencyMs = captureTime > 0.0 ? (float)((poseClock() - captureTime) * 1000.0) : 0.0f;
+    }
+
+    // overlay into the bound framebuffer of the given size, two draws
+    void draw(ShaderProgram& hudSP, ShaderProgram& skeletonSP, int width, int height) {
+        if (!visible)
+            return;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        if (skeletonPeople > 0) {
+            if (skeletonChanged)
+                uploadSkeleton();
+            skeletonSP.use();
+            glState().bindVertexArray(skeletonVAO);
+            glDrawElements(GL_LINES, skeletonPeople * 24 * 2, GL_UNSIGNED_INT, 0);
+        }
+
+        vertices.clear();
+        const unsigned char white[4] = {255, 255, 255, 255};
+        const unsigned char dim[4] = {110, 110, 110, 255};
+        const unsigned char colors[HUD_STAGES][4] = {{90, 200, 255, 255}, {255, 120, 200, 255}, {180, 140, 255, 255},
+                                                     {255, 210, 60, 255}, {100, 255, 120, 255}, {60, 230, 230, 255},
+                                                     {255, 140, 60, 255}};
+
+        // fps, latency and the cost of the overlay
+        float interval = 0.0f;
+        int counted = std::min(frames, HUD_FPS_FRAMES);
+        for (int i = 0; i < counted; i++)
+            interval += intervals[i] / counted;
+        float x = 10.0f;
+        x = text(x, 10.0f, "FPS " + number(interval > 0.0f ? 1000.0f / interval : 0.0f), white) + 16.0f;
+        x = text(x, 10.0f, "LAt " + number(latencyMs), white) + 16.0f;
+        x = text(x, 10.0f, "HUd " + number(drawMs, 2), white) + 16.0f;
+        if (gpuMs > 0.0f)
+            text(x, 10.0f, "GPU " + number(gpuMs), white);
+
+        // a graph per stage scaled to its maximum, newest sample on the right; the render
+        // stage is the CPU time submitting the frame, the GPU may still be drawing it
+        const char* labels[HUD_STAGES] = {"CAP", "InF", "UPL", "POSE", "CPU", "OUt", "PrES"};
+        for (int s = 0; s < HUD_STAGES; s++) {
+            float top = 34.0f + s * 44.0f, bottom = top + 36.0f, left = 50.0f;
+            float newest = samples[s][(head + HUD_SAMPLES - 1) % HUD_SAMPLES];
+            float peak = *std::max_element(samples[s], samples[s] + HUD_SAMPLES);
+            float scale = 5.0f;
+            while (scale < peak)
+                scale *= 2.0f;
+
+            text(10.0f, top, labels[s], colors[s]);
+            text(10.0f, top + 14.0f, number(newest), white);
+            line(left, bottom, left + 2.0f * HUD_SAMPLES, bottom, dim);
+            line(left, top, left + 2.0f * HUD_SAMPLES, top, dim);
+            text(left + 2.0f * HUD_SAMPLES + 6.0f, top, number(scale, 0), dim);
+            for (int i = 1; i < HUD_SAMPLES; i++) {
+                float a = samples[s][(head + i - 1) % HUD_SAMPLES], b = samples[s][(head + i) % HUD_SAMPLES];
+                line(left + 2.0f * (i - 1), bottom - (bottom - top) * a / scale,
+                     left + 2.0f * i, bottom - (bottom - top) * b / scale, colors[s]);
+            }
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, lineVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(HudVertex) * vertices.size(), vertices.data(), GL_STREAM_DRAW);
+        hudSP.use();
+        if (width != viewportWidth || height != viewportHeight) {
+            glUniform2f(glGetUniformLocation(hudSP.ID, "viewport"), (float)width, (float)height);
+            viewportWidth = width;
+            viewportHeight = height;
+        }
+        glState().bindVertexArray(lineVAO);
+        glDrawArrays(GL_LINES, 0, vertices.size());
+
+        drawMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void free() {
+        glDeleteVertexArrays(1, &lineVAO);
+        glDeleteBuffers(1, &lineVBO);
+        glDeleteVertexArrays(1, &skeletonVAO);
+        glDeleteBuffers(1, &skeletonVBO);
+        glDeleteBuffers(1, &skeletonEBO);
+    }
+
+private:
+    unsigned int lineVAO = 0, lineVBO = 0;
+    unsigned int skeletonVAO = 0, skeletonVBO = 0, skeletonEBO = 0;
+    int skeletonPeople = 0, skeletonJoints = 0, indexedPeople = 0, indexedJoints = 0;
+    std::vector<float> skeletonPoints;
+    bool skeletonChanged = false;
+    std::vector<HudVertex> vertices;
+    int viewportWidth = 0, viewportHeight = 0;
+
+    float samples[HUD_STAGES][HUD_SAMPLES];
+    float current[HUD_STAGES];
+    int head = 0;
+    float intervals[HUD_FPS_FRAMES];
+    int frames = 0;
+    float captureMs = 0.0f, inferenceMs = 0.0f, latencyMs = 0.0f, drawMs = 0.0f, gpuMs = 0.0f;
+    double captureTime = 0.0;
+    std::chrono::steady_clock::time_point lastMark, lastFrame;
+
+    // keypoints of the newest skeleton into the VBO, before the draw that shows them
+    void uploadSkeleton() {
+        glBindBuffer(GL_ARRAY_BUFFER, skeletonVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * skeletonPoints.size(), skeletonPoints.data(), GL_STREAM_DRAW);
+        // bones of every person, rebuilt only when more people than ever before are detected
+        // or the joint count changes
+        if (skeletonPeople > indexedPeople || skeletonJoints != indexedJoints) {
+            std::vector<unsigned int> indices;
+            for (int p = 0; p < skeletonPeople; p++) {
+                for (int b = 0; b < 24; b++) {
+                    indices.push_back(p * skeletonJoints + hudBones[b][0]);
+                    indices.push_back(p * skeletonJoints + hudBones[b][1]);
+                }
+            }
+            glState().bindVertexArray(skeletonVAO);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(), indices.data(), GL_STATIC_DRAW);
+            indexedPeople = skeletonPeople;
+            indexedJoints = skeletonJoints;
+        }
+        skeletonChanged = false;
+    }
+
+    static std::string number(float value, int decimals = 1) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+        return buffer;
+    }
+
+    void line(float x1, float y1, float x2, float y2, const unsigned char* color) {
+        HudVertex a = {{x1, y1}, {color[0], color[1], color[2], color[3]}};
+        HudVertex b = {{x2, y2}, {color[0], color[1], color[2], color[3]}};
+        vertices.push_back(a);
+        vertices.push_back(b);
+    }
+
+    // seven segment text, 5 x 10 pixel glyphs; returns the x after the last glyph
+    float text(float x, float y, const std::string& str, const unsigned char* color) {
+        // segments a to g as bits 0 to 6, from the top clockwise, g in the middle
+        const float w = 5.0f, h = 10.0f;
+        const float segments[7][4] = {{0, 0, w, 0}, {w, 0, w, h / 2}, {w, h / 2, w, h}, {0, h, w, h},
+                                      {0, h / 2, 0, h}, {0, 0, 0, h / 2}, {0, h / 2, w, h / 2}};
+        for (size_t i = 0; i < str.size(); i++) {
+            char c = str[i];
+            if (c == '.') {
+                line(x, y + h, x + 1.0f, y + h, color);
+                x += 4.0f;
+                continue;
+            }
+            int bits = glyph(c);
+            for (int s = 0; s < 7; s++) {
+                if (bits & (1 << s))
+                    line(x + segments[s][0], y + segments[s][1], x + segments[s][2], y + segments[s][3], color);
+            }
+            x += w + 4.0f;
+        }
+        return x;
+    }
+
+    static int glyph(char c) {
+        const int digits[10] = {0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F};
+        if (c >= '0' && c <= '9')
+            return digits[c - '0'];
+        switch (c) {
+            case 'A': return 0x77;
+            case 'C': return 0x39;
+            case 'E': return 0x79;
+            case 'F': return 0x71;
+            case 'G': return 0x3D;
+            case 'H': return 0x76;
+            case 'I': return 0x30;
+            case 'L': return 0x38;
+            case 'O': return 0x3F;
+            case 'P': return 0x73;
+            case 'S': return 0x6D;
+            case 'U': return 0x3E;
+            case 'd': return 0x5E;
+            case 'n': return 0x54;
+            case 'r': return 0x50;
+            case 't': return 0x78;
+            case '-': return 0x40;
+            default: return 0;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef LIMBTRANSFORM
+#define LIMBTRANSFORM
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+// per-instance attributes of an instanced avatar part
+struct LimbInstance {
+    float axisX[2];
+    float axisY[2];
+    float offset[2];
+    float layer;
+};
+
+// batched limb transforms, structure of arrays
+// a limb spans joint (x1, y1) to joint (x2, y2) with the given width, and maps the
+// unit quad to screen space with the 2D affine transform
+//      | a  c  tx |
+//      | b  d  ty |
+// which equals translate(x1, y1) * rotate(theta) * scale(length, width) without trig:
+// the first column is the joint difference, the second its normal scaled to width
+class LimbBatch {
+public:
+    // input joint pairs
+    std::vector<float> x1, y1, x2, y2, width;
+    // owning person and limbMap index of each entry
+    std::vector<int> person, limb;
+    // output affine transforms
+    std::vector<float> a, b, c, d, tx, ty;
+
+    void clear() {
+        x1.clear(); y1.clear(); x2.clear(); y2.clear(); width.clear();
+        person.clear(); limb.clear();
+    }
+
+    void add(int p, int l, float px1, float py1, float px2, float py2, float w) {
+        x1.push_back(px1); y1.push_back(py1);
+        x2.push_back(px2); y2.push_back(py2);
+        width.push_back(w);
+        person.push_back(p);
+        limb.push_back(l);
+    }
+
+    size_t size() const {
+        return x1.size();
+    }
+
+    // fill the output arrays for every queued limb
+    void compute() {
+        size_t n = size();
+        a.resize(n); b.resize(n); c.resize(n); d.resize(n); tx.resize(n); ty.resize(n);
+        computeLimbTransforms(x1.data(), y1.data(), x2.data(), y2.data(), width.data(),
+                              a.data(), b.data(), c.data(), d.data(), tx.data(), ty.data(), n);
+    }
+
+    // column-major 4x4 model matrix of entry i, same layout as glm::mat4
+    void modelMatrix(size_t i, float* m) const {
+        m[0] = a[i];  m[1] = b[i];  m[2] = 0.0f;  m[3] = 0.0f;
+        m[4] = c[i];  m[5] = d[i];  m[6] = 0.0f;  m[7] = 0.0f;
+        m[8] = 0.0f;  m[9] = 0.0f;  m[10] = 1.0f; m[11] = 0.0f;
+        m[12] = tx[i]; m[13] = ty[i]; m[14] = 0.0f; m[15] = 1.0f;
+    }
+
+    // instance attributes of entry i
+    LimbInstance instance(size_t i, float layer) const {
+        LimbInstance inst = {{a[i], b[i]}, {c[i], d[i]}, {tx[i], ty[i]}, layer};
+        return inst;
+    }
+
+    static void computeLimbTransforms(const float* x1, const float* y1,
+                                      const float* x2, const float* y2, const float* w,
+                                      float* a, float* b, float* c, float* d,
+                                      float* tx, float* ty, size_t n) {
+        size_t i = 0;
+#if defined(__AVX__)
+        const __m256 zero = _mm256_setzero_ps();
+        for (; i + 8 <= n; i += 8) {
+            __m256 px = _mm256_loadu_ps(x1 + i);
+            __m256 py = _mm256_loadu_ps(y1 + i);
+            __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x2 + i), px);
+            __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y2 + i), py);
+            __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)));
+            // width / length, zero length limbs collapse instead of producing NaN
+            __m256 s = _mm256_div_ps(_mm256_loadu_ps(w + i), len);
+            s = _mm256_and_ps(s, _mm256_cmp_ps(len, zero, _CMP_GT_OQ));
+            _mm256_storeu_ps(a + i, dx);
+            _mm256_storeu_ps(b + i, dy);
+            _mm256_storeu_ps(c + i, _mm256_sub_ps(zero, _mm256_mul_ps(dy, s)));
+            _mm256_storeu_ps(d + i, _mm256_mul_ps(dx, s));
+            _mm256_storeu_ps(tx + i, px);
+            _mm256_storeu_ps(ty + i, py);
+        }
+#elif defined(__SSE2__)
+        const __m128 zero = _mm_setzero_ps();
+        for (; i + 4 <= n; i += 4) {
+            __m128 px = _mm_loadu_ps(x1 + i);
+            __m128 py = _mm_loadu_ps(y1 + i);
+            __m128 dx = _mm_sub_ps(_mm_loadu_ps(x2 + i), px);
+            __m128 dy = _mm_sub_ps(_mm_loadu_ps(y2 + i), py);
+            __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+            // width / length, zero length limbs collapse instead of producing NaN
+            __m128 s = _mm_div_ps(_mm_loadu_ps(w + i), len);
+            s = _mm_and_ps(s, _mm_cmpgt_ps(len, zero));
+            _mm_storeu_ps(a + i, dx);
+            _mm_storeu_ps(b + i, dy);
+            _mm_storeu_ps(c + i, _mm_sub_ps(zero, _mm_mul_ps(dy, s)));
+            _mm_storeu_ps(d + i, _mm_mul_ps(dx, s));
+            _mm_storeu_ps(tx + i, px);
+            _mm_storeu_ps(ty + i, py);
+        }
+#endif
+        // remainder
+        for (; i < n; i++) {
+            float dx = x2[i] - x1[i];
+            float dy = y2[i] - y1[i];
+            float len = std::sqrt(dx * dx + dy * dy);
+            float s = len > 0.0f ? w[i] / len : 0.0f;
+            a[i] = dx;
+            b[i] = dy;
+            c[i] = -dy * s;
+            d[i] = dx * s;
+            tx[i] = x1[i];
+            ty[i] = y1[i];
+        }
+    }
+};
+
+#endif
@@ -1,54 +1,124 @@
+// stb_image implementation in this file only, the headers include stb_image.h again
 #define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
 #include <math.h>
+#include <sstream>
 
-#include <glad/glad.h>
-#include <GLFW/glfw3.h>
+#include <gflags/gflags.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <opencv2/opencv.hpp>
 #include <openpose/headers.hpp>
 
+#include "avatar.h"
+#include "avatarswap.h"
+#include "camerabackground.h"
+#include "crowd.h"
+#include "framepacer.h"
+#include "framerecorder.h"
+#include "framestats.h"
+#include "gesture.h"
+#include "glcontext.h"
+#include "glstate.h"
+#include "handface.h"
+#include "hud.h"
+#include "limbtransform.h"
+#include "morphhead.h"
+#include "partmesh.h"
+#include "poseindex.h"
+#include "poselift.h"
+#include "posestream.h"
+#include "primitives.h"
+#include "renderscale.h"
 #include "shaderprogram.h"
-#include "stb_image.h"
-
-
-const unsigned int DISPLAY_WIDTH = 1080;
-const unsigned int DISPLAY_HEIGHT = 1080;
-const GLfloat LIMB_WIDTH = 50.0f;
-const unsigned int CIRCLE_QUALITY = 100;
-const GLfloat FACE_RADIUS = 100.0f;
-
-// rectangle limb mappings
-/*
-int limbMap[15][2] = {  {0, 1},     // neck
-                        {2, 1},     // R shoulder
-                        {3, 2},     // R bicep
-                        {4, 3},     // R forearm
-                        {1, 5},     // L shoulder
-                        {5, 6},     // L bicep
-                        {6, 7},     // L forearm
-                        {1, 8},     // torso 1
-                        {8, 1},     // torso 2
-                        {9, 8},     // R hip
-                        {10, 9},    // R thigh
-                        {11, 10},   // R calf
-                        {8, 12},    // L hip
-                        {12, 13},   // L thigh
-                        {13, 14}};  // L calf
-*/
-int limbMap[10][2] = {  {1, 8},     // 0. torso 1
-                        {8, 1},     // 1. torso 2
-                        {3, 2},     // 2. R bicep
-                        {4, 3},     // 3. R forearm
-                        {5, 6},     // 4. L bicep
-                        {6, 7},     // 5. L forearm
-                        {10, 9},    // 6. R thigh
-                        {11, 10},   // 7. R calf
-                        {12, 13},   // 8. L thigh
-                        {13, 14}};  // 9. L calf
+#include "skincache.h"
+#include "skinnedmesh.h"
+#include "texturearray.h"
+
+
+const unsigned int MAX_INSTANCES = 1024;
+const GLfloat SKIN_COLOR[4] = {0.96f, 0.96f, 0.86f, 1.0f};
+const GLfloat FEATURE_COLOR[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+
+DEFINE_string(renderer, "instanced", "Avatar draw path: legacy (one draw per part), instanced (CPU limb transforms, "
+                                     "one instanced draw), keypoints (raw keypoints, limbs built in the vertex shader), "
+                                     "skinned (one mesh per person, bent at the joints by GPU skinning) "
+                                     "or primitives (untextured circles, capsules and rounded rects)");
+DEFINE_string(background, "none", "Camera image behind the avatar: none, bgr, or yuyv (raw camera frames, "
+                                  "converted to RGB on the GPU)");
+DEFINE_bool(headless, false, "Render offscreen through EGL without a window or X server");
+DEFINE_int32(headless_width, DISPLAY_WIDTH, "Width of the headless framebuffer");
+DEFINE_int32(headless_height, DISPLAY_HEIGHT, "Height of the headless framebuffer");
+DEFINE_string(swap_interval, "vsync", "Buffer swaps wait for the vertical blank: vsync, adaptive (only when the "
+                                       "frame is on time, tearing otherwise) or off");
+DEFINE_int32(frames_in_flight, 1, "Frames the GPU may still be rendering when the CPU starts the next one, "
+                                  "0 to 3, lower values cut latency");
+DEFINE_double(fps_limit, 0.0, "Cap the frame rate by sleeping between frames, 0 for no cap");
+DEFINE_double(render_scale, 1.0, "Render the scene at this fraction of the output resolution, 0.5 to 1, and upscale it");
+DEFINE_string(upscale_filter, "bilinear", "Filter of the upscale pass: bilinear, or sharp (bilinear with contrast adaptive sharpening)");
+DEFINE_double(render_budget, 0.0, "Adjust the render scale to keep the GPU time per frame under this many ms, 0 keeps it fixed");
+DEFINE_string(video, "", "Read frames from a video file instead of the camera, stops at its end");
+DEFINE_string(record, "", "Record the rendered frames to a video file, .y4m for raw I420");
+DEFINE_double(record_fps, 30.0, "Frame rate written to the recording");
+DEFINE_int32(record_queue, 8, "Frames waiting for the encoder before new frames are dropped");
+DEFINE_bool(record_drop, true, "Drop frames when the encoder queue is full, otherwise the render loop waits");
+DEFINE_bool(stats, false, "Print draw call counts and render CPU time every 120 frames");
+DEFINE_bool(hands, false, "Estimate hand keypoints on ROIs around the wrists and draw fingers");
+DEFINE_bool(face_landmarks, false, "Estimate face keypoints on an ROI around the head and draw facial features");
+DEFINE_bool(face_morphs, false, "Show expressions on the avatar head, morph target weights fitted to the face keypoints "
+                               "of --face_landmarks, instanced renderer only");
+DEFINE_string(pose_index, "", "Pose index built by poseindex.bin, snaps live poses to the closest library pose");
+DEFINE_int32(hand_face_interval, 4, "Run hand/face estimation every N frames, interpolating in between");
+DEFINE_bool(gestures, false, "Recognize the built-in gestures (t-pose, raise-arms, wave) of the first person");
+DEFINE_string(gesture_templates, "", "Additional gesture template file, enables gesture recognition");
+DEFINE_bool(part_meshes, true, "Draw avatar parts as tight outlines traced from their alpha channel instead of full quads");
+DEFINE_bool(pose_interpolation, true, "Interpolate poses between inference results at the display rate, "
+                                     "otherwise draw each pose until the next one arrives");
+DEFINE_string(lift_model, "", "2D to 3D lifting network weights, enables depth ordering and foreshortening of limbs");
+DEFINE_string(skin_mesh, "", "Skinned avatar mesh for --renderer skinned, generated from the part textures when empty, "
+                             "a file that does not exist yet is written with the generated mesh");
+DEFINE_int32(skin_resolution, 8, "Cells along every limb of the generated skinned mesh");
+DEFINE_int32(synthetic, 0, "Animate this many procedural skeletons instead of running the camera and pose inference");
+DEFINE_int32(crowd, 0, "Seat this many avatars in stands replaying the detected or synthetic people, always instanced");
+DEFINE_double(crowd_lod, 120.0, "Crowd avatars shorter than this many view pixels are drawn with fewer, merged parts");
+DEFINE_bool(crowd_sweep, false, "Double the seated crowd every 120 frames up to --crowd, printing the frame time at each "
+                                "count, then exit");
+DEFINE_int32(frames, 0, "Exit after rendering this many frames, 0 to run until the window is closed or the video ends, "
+                        "which a headless --synthetic run never does");
+DEFINE_string(skins, "", "Directory of avatar skins, one subdirectory of part images 0.png to 10.png per skin, "
+              "kept in a fixed GPU budget and loaded on demand for the instanced renderer");
+DEFINE_int32(skin_budget, 64, "GPU memory in MB of the resident skins");
+DEFINE_int32(skin_size, 256, "Texels along each side of every part of a resident skin");
+DEFINE_int32(skin, 1, "Skin of the first person, the next people wear the following skins, 0 is the default skin");
+DEFINE_double(skin_cycle, 0.0, "Move every person on to the next skin after this many seconds, 0 to keep them");
+DEFINE_string(avatars, "", "Comma separated directories of other avatars, part images 0.png to 10.png each, "
+              "loaded in the background and swapped in with the N key");
+DEFINE_double(avatar_swap, 0.0, "Swap to the next avatar every this many seconds, 0 to swap on the N key only");
+DEFINE_bool(hud, false, "Show the performance overlay: stage timing graphs, fps, latency and the raw detected skeleton, "
+            "toggled with the H key");
+
+// primitive avatar limb mappings
+int primitiveLimbMap[15][2] = { {0, 1},     // neck
+                                {2, 1},     // R shoulder
+                                {3, 2},     // R bicep
+                                {4, 3},     // R forearm
+                                {1, 5},     // L shoulder
+                                {5, 6},     // L bicep
+                                {6, 7},     // L forearm
+                                {1, 8},     // torso 1
+                                {8, 1},     // torso 2
+                                {9, 8},     // R hip
+                                {10, 9},    // R thigh
+                                {11, 10},   // R calf
+                                {8, 12},    // L hip
+                                {12, 13},   // L thigh
+                                {13, 14}};  // L calf
 
 // view coords to normalized screen coords
 glm::mat4 projection_M = glm::ortho(static_cast<float>(DISPLAY_WIDTH), 0.0f, 
@@ -56,332 +126,859 @@ glm::mat4 projection_M = glm::ortho(static_cast<float>(DISPLAY_WIDTH), 0.0f,
                                     -1.0f, 1.0f);
 
 
-void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-void processInput(GLFWwindow *window);
-
 int main(int argc, char* argv[]) {
-    // initialize glfw
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-    // initialize OpenCV
-    cv::VideoCapture cam(0);
-    if (!cam.isOpened()) {
-        std::cout << "Cannot open camera" << std::endl;
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+    // initialize OpenCV, synthetic skeletons need no camera
+    cv::VideoCapture cam;
+    if (FLAGS_synthetic > 0)
+        std::cout << "Animating " << FLAGS_synthetic << " synthetic skeletons, camera and pose inference disabled" << std::endl;
+    else if (FLAGS_video.empty())
+        cam.open(0);
+    else
+        cam.open(FLAGS_video);
+    if (FLAGS_synthetic == 0 && !cam.isOpened()) {
+        std::cout << "Cannot open " << (FLAGS_video.empty() ? "camera" : FLAGS_video) << std::endl;
         return -1;
     }
-    cam.set(CV_CAP_PROP_FRAME_WIDTH, DISPLAY_WIDTH);
-    cam.set(CV_CAP_PROP_FRAME_HEIGHT, DISPLAY_HEIGHT);
+    if (FLAGS_synthetic == 0 && FLAGS_video.empty()) {
+        cam.set(CV_CAP_PROP_FRAME_WIDTH, DISPLAY_WIDTH);
+        cam.set(CV_CAP_PROP_FRAME_HEIGHT, DISPLAY_HEIGHT);
+    }
+    // raw YUYV frames for the background, converted on the CPU for OpenPose only
+    const bool rawYUYV = FLAGS_synthetic == 0 && FLAGS_background == "yuyv";
+    if (rawYUYV)
+        cam.set(CV_CAP_PROP_CONVERT_RGB, false);
+    const int frameRows = FLAGS_synthetic == 0 ? (int)cam.get(CV_CAP_PROP_FRAME_HEIGHT) : 0;
    
     // initialize OpenPose
     op::Wrapper opWrapper{op::ThreadManagerMode::Asynchronous};
-    opWrapper.start();
-
-    // create glfw window
-    GLFWwindow* window = glfwCreateWindow(DISPLAY_WIDTH, DISPLAY_HEIGHT, "Morpheus", NULL, NULL);
-    if (window == NULL)
-    {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
-    }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    if (FLAGS_synthetic == 0)
+        opWrapper.start();
+    SyntheticSkeletons synthetic(std::max(FLAGS_synthetic, 0));
+
+    // stands of avatars for stress tests, sized for the instance buffer below
+    Crowd crowd;
+    const bool crowdSweep = FLAGS_crowd > 0 && FLAGS_crowd_sweep;
+    if (FLAGS_crowd > 0)
+        crowd.init(FLAGS_crowd, FLAGS_crowd_lod, FLAGS_crowd_sweep);
+    const size_t maxInstances = std::max<size_t>(std::max<size_t>(MAX_INSTANCES, crowd.maxInstances()),
+                                                 std::max(FLAGS_synthetic, 0) * NUM_PARTS);
+
+    // optional hand and face estimation at a reduced cadence, synthetic skeletons have no frames to run it on
+    std::unique_ptr<HandFaceTracker> handFace;
+    if ((FLAGS_hands || FLAGS_face_landmarks) && FLAGS_synthetic > 0)
+        std::cout << "--hands and --face_landmarks are ignored with --synthetic" << std::endl;
+    else if (FLAGS_hands || FLAGS_face_landmarks)
+        handFace.reset(new HandFaceTracker(FLAGS_hands, FLAGS_face_landmarks, FLAGS_hand_face_interval));
+    const std::vector<std::pair<int, int>> faceSegs = faceSegments();
+    // expressions on the morphed head replace the drawn facial features
+    const bool morphFaces = FLAGS_face_morphs && FLAGS_face_landmarks && FLAGS_renderer == "instanced";
+    if (FLAGS_face_morphs && !morphFaces)
+        std::cout << "--face_morphs needs --face_landmarks and the instanced renderer" << std::endl;
+
+    // optional 2D to 3D pose lifting
+    PoseLifter lifter;
+    if (!FLAGS_lift_model.empty() && lifter.load(FLAGS_lift_model))
+        std::cout << "Pose lifting enabled, " << lifter.macs() << " MACs per person" << std::endl;
+
+    // library of canned avatar poses
+    PoseIndex poseIndex;
+    if (!FLAGS_pose_index.empty() && poseIndex.open(FLAGS_pose_index))
+        std::cout << "Pose index of " << poseIndex.count() << " poses loaded" << std::endl;
+    int8_t poseQuery[POSE_INDEX_DIMS];
+    GLfloat snappedJoints[2 * POSE_INDEX_JOINTS];
+
+    // gesture recognition over the keypoint stream
+    GestureEngine gestures;
+    if (FLAGS_gestures)
+        gestures.addBuiltinTemplates();
+    if (!FLAGS_gesture_templates.empty())
+        gestures.loadTemplates(FLAGS_gesture_templates);
+    gestures.onGesture = [](const std::string& name, float cost) {
+        std::cout << "Gesture: " << name << " (" << cost << ")" << std::endl;
+    };
 
-    // load OpenGL function pointers
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-        std::cout << "Failed to initialize GLAD" << std::endl;
+    // create the window, or the offscreen framebuffer when headless
+    RenderContext renderContext;
+    if (!renderContext.create(FLAGS_headless,
+                              FLAGS_headless ? FLAGS_headless_width : DISPLAY_WIDTH,
+                              FLAGS_headless ? FLAGS_headless_height : DISPLAY_HEIGHT, "Morpheus"))
         return -1;
-    }
+    // the sweep measures the frame time of each crowd size, which vsync would round up to the refresh
+    if (crowdSweep && (FLAGS_swap_interval != "off" || FLAGS_fps_limit > 0.0))
+        std::cout << "Swap interval off and no frame rate cap while sweeping the crowd" << std::endl;
+    renderContext.setSwapInterval(crowdSweep ? "off" : FLAGS_swap_interval);
 
     // create shader programs
-    ShaderProgram defaultSP("../shaders/default.vert", "../shaders/default.frag");
     ShaderProgram avatarSP("../shaders/default.vert", "../shaders/avatar.frag");
+    ShaderProgram instancedSP("../shaders/instanced.vert", "../shaders/instanced.frag");
+    ShaderProgram keypointSP("../shaders/keypoint.vert", "../shaders/instanced.frag");
+    ShaderProgram skinnedSP("../shaders/skinned.vert", "../shaders/instanced.frag");
+    ShaderProgram morphSP("../shaders/morphhead.vert", "../shaders/instanced.frag");
+    ShaderProgram sdfSP("../shaders/sdf.vert", "../shaders/sdf.frag");
+    ShaderProgram backgroundSP("../shaders/background.vert", "../shaders/background.frag");
+    ShaderProgram upscaleSP("../shaders/upscale.vert", "../shaders/upscale.frag");
+    ShaderProgram hudSP("../shaders/hud.vert", "../shaders/hud.frag");
+    ShaderProgram skeletonSP("../shaders/skeleton.vert", "../shaders/skeleton.frag");
+
+    // avatar parts packed into one texture array, bound to unit 1 for the whole run
+    std::vector<std::string> partPaths;
+    for (unsigned int i = 0; i < NUM_PARTS; i++)
+        partPaths.push_back("../textures/avatar/" + std::to_string(i) + ".png");
+    PartTextureArray avatarParts;
+    if (!avatarParts.load(partPaths)) {
+        std::cout << "Failed to load avatar textures" << std::endl;
+        return -1;
+    }
 
-    // textures
-    int texWidth, texHeight, texChannels;
-    unsigned char* texData = stbi_load("../textures/white.jpg", &texWidth, &texHeight, &texChannels, 0);
-    unsigned int blankTexture;
-    glGenTextures(1, &blankTexture);
-    glBindTexture(GL_TEXTURE_2D, blankTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, texWidth, texHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, texData);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    stbi_image_free(texData);
-
-    texData = stbi_load("../textures/skin.jpg", &texWidth, &texHeight, &texChannels, 0);
-    unsigned int skinTexture;
-    glGenTextures(1, &skinTexture);
-    glBindTexture(GL_TEXTURE_2D, skinTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, texWidth, texHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, texData);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    stbi_image_free(texData);
-
-    std::vector<unsigned int> avatarTextures;
-    for (unsigned int i = 0; i <= sizeof(limbMap) / sizeof(limbMap[0]); i++) {
-        texData = stbi_load(("../textures/avatar/" + std::to_string(i) + ".png").c_str(), &texWidth, &texHeight, &texChannels, 0);
-        unsigned int texture;
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texWidth, texHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, texData);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        avatarTextures.push_back(texture);
-        stbi_image_free(texData);
+    // skin library sharing the outlines of every part, stretched to fill their layers
+    SkinCache skinCache;
+    if (!FLAGS_skins.empty() && !skinCache.init("../textures/avatar", FLAGS_skins, FLAGS_skin_budget, FLAGS_skin_size, 1))
+        return -1;
+    const bool skinLibrary = skinCache.ID != 0;
+    std::vector<GLfloat> partScale = skinLibrary ? std::vector<GLfloat>(2 * NUM_PARTS, 1.0f) : avatarParts.uvScale;
+    const double skinStart = poseClock();
+    // skin of a person, advancing every --skin_cycle seconds
+    auto skinOf = [&](int person) {
+        long cycle = FLAGS_skin_cycle > 0.0 ? (long)((poseClock() - skinStart) / FLAGS_skin_cycle) : 0;
+        return (int)(((long)FLAGS_skin + person + cycle) % skinCache.count());
+    };
+
+    // outlines of the opaque area of every avatar part, traced once and cached in the working directory
+    PartMeshes partMeshes;
+    if (!FLAGS_part_meshes || skinLibrary || !partMeshes.load(partPaths, "avatar_parts.mesh"))
+        partMeshes.quads(NUM_PARTS);
+    if (FLAGS_stats)
+        partMeshes.report();
+
+    // one skinned mesh for the whole avatar, loaded or generated over the part outlines,
+    // empty for the other renderers
+    SkinnedMesh skinMesh;
+    if (FLAGS_renderer == "skinned") {
+        const bool skinFile = !FLAGS_skin_mesh.empty() && std::ifstream(FLAGS_skin_mesh).good();
+        if (!skinFile || !skinMesh.load(FLAGS_skin_mesh)) {
+            skinMesh.build(partMeshes, FLAGS_skin_resolution);
+            if (!FLAGS_skin_mesh.empty() && !skinFile)
+                skinMesh.save(FLAGS_skin_mesh);
+        }
     }
 
     // projection transformation, further transformations change model coords
-    defaultSP.use();
-    unsigned int projUni = glGetUniformLocation(defaultSP.ID, "projection");
-    glUniformMatrix4fv(projUni, 1, GL_FALSE, glm::value_ptr(projection_M));
-    unsigned int modelUni1 = glGetUniformLocation(defaultSP.ID, "model");
-    unsigned int colorUni = glGetUniformLocation(defaultSP.ID, "color");
-
     avatarSP.use();
-    projUni = glGetUniformLocation(avatarSP.ID, "projection");
+    unsigned int projUni = glGetUniformLocation(avatarSP.ID, "projection");
     glUniformMatrix4fv(projUni, 1, GL_FALSE, glm::value_ptr(projection_M));
     unsigned int modelUni2 = glGetUniformLocation(avatarSP.ID, "model");
+    unsigned int layerUni = glGetUniformLocation(avatarSP.ID, "layer");
+    avatarSP.setInt("parts", 1);
+
+    instancedSP.use();
+    projUni = glGetUniformLocation(instancedSP.ID, "projection");
+    glUniformMatrix4fv(projUni, 1, GL_FALSE, glm::value_ptr(projection_M));
+    instancedSP.setInt("parts", 1);
+
+    keypointSP.use();
+    projUni = glGetUniformLocation(keypointSP.ID, "projection");
+    glUniformMatrix4fv(projUni, 1, GL_FALSE, glm::value_ptr(projection_M));
+    keypointSP.setInt("parts", 1);
+    keypointSP.setInt("keypoints", 2);
+    keypointSP.setFloat("limbWidth", LIMB_WIDTH);
+    keypointSP.setFloat("faceRadius", FACE_RADIUS);
+    keypointSP.setFloat("minConfidence", 0.0f);
+    unsigned int jointsUni = glGetUniformLocation(keypointSP.ID, "joints");
+
+    skinnedSP.use();
+    projUni = glGetUniformLocation(skinnedSP.ID, "projection");
+    glUniformMatrix4fv(projUni, 1, GL_FALSE, glm::value_ptr(projection_M));
+    skinnedSP.setInt("parts", 1);
+    skinnedSP.setInt("skin", 5);
+
+    MorphHead morphHead;
+    morphHead.build();
+    morphSP.use();
+    projUni = glGetUniformLocation(morphSP.ID, "projection");
+    glUniformMatrix4fv(projUni, 1, GL_FALSE, glm::value_ptr(projection_M));
+    morphSP.setInt("parts", 1);
+    morphSP.setInt("morphs", 6);
+    morphSP.setInt("vertices", morphHead.vertexCount());
+
+    sdfSP.use();
+    projUni = glGetUniformLocation(sdfSP.ID, "projection");
+    glUniformMatrix4fv(projUni, 1, GL_FALSE, glm::value_ptr(projection_M));
+
+    skeletonSP.use();
+    projUni = glGetUniformLocation(skeletonSP.ID, "projection");
+    glUniformMatrix4fv(projUni, 1, GL_FALSE, glm::value_ptr(projection_M));
+    glUniform4f(glGetUniformLocation(skeletonSP.ID, "color"), 1.0f, 1.0f, 0.0f, 1.0f);
+
+    backgroundSP.use();
+    projUni = glGetUniformLocation(backgroundSP.ID, "projection");
+    glUniformMatrix4fv(projUni, 1, GL_FALSE, glm::value_ptr(projection_M));
+    backgroundSP.setInt("frame", 3);
+    backgroundSP.setInt("format", rawYUYV ? BACKGROUND_YUYV : BACKGROUND_BGR);
+    unsigned int frameSizeUni = glGetUniformLocation(backgroundSP.ID, "frameSize");
+
+    upscaleSP.use();
+    upscaleSP.setInt("scene", 4);
+    upscaleSP.setInt("filterMode", FLAGS_upscale_filter == "sharp" ? 1 : 0);
+    upscaleSP.setFloat("sharpness", 0.5f);
+    unsigned int regionScaleUni = glGetUniformLocation(upscaleSP.ID, "regionScale");
 
     // create buffers and buffer data
-    unsigned int rectVAO, circVAO, rectVBO, circVBO;
-    glGenVertexArrays(1, &rectVAO);
-    glGenVertexArrays(1, &circVAO);
-    glGenBuffers(1, &rectVBO);
-    glGenBuffers(1, &circVBO);
-
-    glBindVertexArray(rectVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, rectVBO);
+    unsigned int partVAO, sdfVAO, partVBO, instanceVBO, sdfVBO;
+    glGenVertexArrays(1, &partVAO);
+    glGenVertexArrays(1, &sdfVAO);
+    glGenBuffers(1, &partVBO);
+    glGenBuffers(1, &instanceVBO);
+    glGenBuffers(1, &sdfVBO);
+
+    glBindVertexArray(partVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, partVBO);
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (void*)0);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (void*)(2 * sizeof(GLfloat)));
     glEnableVertexAttribArray(1);
-    // rectangle primitive
-    std::vector<GLfloat> rectVerts = {
-        0.0f, 1.0f,    0.0f, 0.0f,    // bottom left
-        1.0f, 1.0f,    1.0f, 0.0f,    // bottom right
-        0.0f, 0.0f,    0.0f, 1.0f,    // top left
-        1.0f, 0.0f,    1.0f, 1.0f     // top right
+
+    // part scales and outlines of the current avatar in every program drawing parts, again after every swap
+    auto applyAvatar = [&]() {
+        if (!skinLibrary)
+            partScale = avatarParts.uvScale;
+        ShaderProgram* partPrograms[] = {&avatarSP, &instancedSP, &keypointSP, &skinnedSP, &morphSP};
+        for (ShaderProgram* program : partPrograms) {
+            program->use();
+            glUniform2fv(glGetUniformLocation(program->ID, "partScale"), NUM_PARTS, partScale.data());
+            glUniform2fv(glGetUniformLocation(program->ID, "partMesh"), NUM_PARTS * PART_MESH_VERTS, partMeshes.vertices.data());
+        }
+
+        // part outline fans, PART_MESH_VERTS vertices per part as position and texel,
+        // the position is the texel flipped vertically into the unit square of the part
+        std::vector<GLfloat> partVerts;
+        for (size_t i = 0; i < partMeshes.vertices.size(); i += 2) {
+            GLfloat u = partMeshes.vertices[i], v = partMeshes.vertices[i + 1];
+            partVerts.insert(partVerts.end(), {u, 1.0f - v, u, v});
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, partVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * partVerts.size(), partVerts.data(), GL_STATIC_DRAW);
     };
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * rectVerts.size(), rectVerts.data(), GL_DYNAMIC_DRAW);
+    applyAvatar();
+
+    // per-instance part transforms, streamed every frame, the instanced shaders take the
+    // outline vertices from the partMesh uniform instead of the vertex attributes
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(LimbInstance) * maxInstances, NULL, GL_STREAM_DRAW);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(LimbInstance), (void*)offsetof(LimbInstance, axisX));
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(LimbInstance), (void*)offsetof(LimbInstance, axisY));
+    glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(LimbInstance), (void*)offsetof(LimbInstance, offset));
+    glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, sizeof(LimbInstance), (void*)offsetof(LimbInstance, layer));
+    for (unsigned int i = 2; i <= 5; i++) {
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisor(i, 1);
+    }
 
-    glBindVertexArray(circVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, circVBO);
+    // procedural primitives, quads come from gl_VertexID, attributes are per instance
+    glBindVertexArray(sdfVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, sdfVBO);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(SDFPrimitive), (void*)offsetof(SDFPrimitive, a));
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(SDFPrimitive), (void*)offsetof(SDFPrimitive, b));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(SDFPrimitive), (void*)offsetof(SDFPrimitive, radius));
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(SDFPrimitive), (void*)offsetof(SDFPrimitive, color));
+    for (unsigned int i = 0; i <= 3; i++) {
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisor(i, 1);
+    }
+
+    // raw keypoints of all people as a buffer texture on unit 2, part outlines come from gl_VertexID
+    unsigned int keypointVAO, keypointTBO, keypointTexture;
+    glGenVertexArrays(1, &keypointVAO);
+    glGenBuffers(1, &keypointTBO);
+    glGenTextures(1, &keypointTexture);
+    glBindBuffer(GL_TEXTURE_BUFFER, keypointTBO);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(GLfloat) * 25 * 3, NULL, GL_STREAM_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, keypointTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, keypointTBO);
+
+    // skinned avatar mesh, static, and the bone transforms of all people as a buffer texture on unit 5
+    unsigned int skinVAO, skinVBO, skinEBO, skinTBO, skinTexture;
+    glGenVertexArrays(1, &skinVAO);
+    glGenBuffers(1, &skinVBO);
+    glGenBuffers(1, &skinEBO);
+    glGenBuffers(1, &skinTBO);
+    glGenTextures(1, &skinTexture);
+    glBindVertexArray(skinVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, skinVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(SkinVertex) * skinMesh.vertices.size(), skinMesh.vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, skinEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * skinMesh.indices.size(), skinMesh.indices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(SkinVertex), (void*)offsetof(SkinVertex, position));
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(SkinVertex), (void*)offsetof(SkinVertex, texel));
+    glVertexAttribIPointer(2, SKIN_INFLUENCES, GL_UNSIGNED_BYTE, sizeof(SkinVertex), (void*)offsetof(SkinVertex, bones));
+    glVertexAttribPointer(3, SKIN_INFLUENCES, GL_FLOAT, GL_FALSE, sizeof(SkinVertex), (void*)offsetof(SkinVertex, weights));
+    for (unsigned int i = 0; i <= 3; i++)
+        glEnableVertexAttribArray(i);
+    glBindBuffer(GL_TEXTURE_BUFFER, skinTBO);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(GLfloat) * SKIN_BONES * SKIN_BONE_FLOATS, NULL, GL_STREAM_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, skinTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, skinTBO);
+    std::vector<GLfloat> skinTransforms;
+
+    // morphed head mesh and its targets, static, the targets as a buffer texture on unit 6;
+    // per-instance head transforms and target weights, streamed every frame
+    unsigned int morphVAO, morphVBO, morphEBO, morphInstanceVBO, morphTBO, morphTexture;
+    glGenVertexArrays(1, &morphVAO);
+    glGenBuffers(1, &morphVBO);
+    glGenBuffers(1, &morphEBO);
+    glGenBuffers(1, &morphInstanceVBO);
+    glGenBuffers(1, &morphTBO);
+    glGenTextures(1, &morphTexture);
+    glBindVertexArray(morphVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, morphVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * morphHead.texels.size(), morphHead.texels.data(), GL_STATIC_DRAW);
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (void*)0);
     glEnableVertexAttribArray(0);
-    // circle primitive
-    glm::vec2 circleLoc = glm::vec2(0.0f, 0.0f);
-    std::vector<GLfloat> circleVerts = {circleLoc.x, circleLoc.y};
-    for (int i = 0; i <= CIRCLE_QUALITY; i++) {
-        GLfloat theta = i * (360.0f / CIRCLE_QUALITY) * (M_PI / 180);
-        GLfloat x = circleLoc.x + cos(theta);
-        GLfloat y = circleLoc.y + sin(theta);
-
-        circleVerts.push_back(x);
-        circleVerts.push_back(y);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, morphEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * morphHead.indices.size(), morphHead.indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, morphInstanceVBO);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(MorphHeadInstance), (void*)offsetof(MorphHeadInstance, axisX));
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(MorphHeadInstance), (void*)offsetof(MorphHeadInstance, axisY));
+    glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(MorphHeadInstance), (void*)offsetof(MorphHeadInstance, offset));
+    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(MorphHeadInstance), (void*)offsetof(MorphHeadInstance, weights));
+    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(MorphHeadInstance), (void*)(offsetof(MorphHeadInstance, weights) + 4 * sizeof(GLfloat)));
+    for (unsigned int i = 2; i <= 6; i++) {
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisor(i, 1);
     }
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * circleVerts.size(), circleVerts.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, morphTBO);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(GLfloat) * morphHead.displacements.size(), morphHead.displacements.data(), GL_STATIC_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, morphTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32F, morphTBO);
+    std::vector<MorphHeadInstance> morphInstances;
+    GLfloat morphWeights[MORPH_TARGETS];
+
+    // setup touched GL state directly, bind the persistent textures through the state cache:
+    // avatar parts on unit 1, keypoints on unit 2, the camera background on unit 3, the scaled scene on unit 4,
+    // skin transforms on unit 5, morph targets on unit 6
+    glState().invalidate();
+    glState().bindTexture(1, GL_TEXTURE_2D_ARRAY, skinLibrary ? skinCache.ID : avatarParts.ID);
+    glState().bindTexture(2, GL_TEXTURE_BUFFER, keypointTexture);
+    glState().bindTexture(5, GL_TEXTURE_BUFFER, skinTexture);
+    glState().bindTexture(6, GL_TEXTURE_BUFFER, morphTexture);
+    // other avatars, loaded by a worker thread with its own context and swapped in between frames
+    std::vector<std::string> avatarDirs(1, "../textures/avatar");
+    std::stringstream avatarList(FLAGS_avatars);
+    for (std::string dir; std::getline(avatarList, dir, ',');) {
+        if (!dir.empty())
+            avatarDirs.push_back(dir);
+    }
+    AvatarSwap avatarSwap;
+    size_t avatarIndex = 0;
+    double nextAvatarSwap = poseClock() + FLAGS_avatar_swap;
+    if (avatarDirs.size() > 1) {
+        if (skinLibrary)
+            std::cout << "--avatars is ignored with --skins, skins already change at runtime" << std::endl;
+        else
+            avatarSwap.start(renderContext, FLAGS_part_meshes);
+    }
+    // performance overlay, timing the stages of every frame even while hidden
+    PerfHud hud;
+    hud.init(FLAGS_hud);
+    // streamed camera frames, allocated for the size of the first frame
+    CameraBackground background;
+    // empty VAO for the attribute-less background and upscale quads
+    unsigned int quadVAO;
+    glGenVertexArrays(1, &quadVAO);
+    // scene at a reduced, optionally dynamic, resolution
+    RenderScale renderScale;
+    renderScale.init(FLAGS_render_scale, FLAGS_render_budget, 4);
+
+    // batched limb transforms of all people in the frame
+    LimbBatch limbBatch;
+    // procedural primitives of all people: the primitive avatar, fingers and facial features
+    PrimitiveBatch primitives;
+    std::vector<float> detailPoints(FACE_POINTS * 3);
+    // lifted joint depths and the depth sorted limbs of one person
+    GLfloat jointDepth[LIFT_JOINTS];
+    std::vector<std::pair<GLfloat, unsigned int>> limbOrder;
+    // avatar parts of all people, drawn with one instanced draw
+    std::vector<LimbInstance> instances;
+
+    FrameStats stats(120);
+    // bounded GPU queue depth and the optional frame rate cap
+    FramePacer pacer(FLAGS_frames_in_flight, crowdSweep ? 0.0 : FLAGS_fps_limit);
+
+    // optional recording of the rendered frames
+    FrameRecorder recorder;
+    if (!FLAGS_record.empty() &&
+        !recorder.start(FLAGS_record, renderContext.width, renderContext.height,
+                        FLAGS_record_fps, FLAGS_record_queue, FLAGS_record_drop))
+        return -1;
 
     // draw in wireframe polygons
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
-    // render loop
-    while (!glfwWindowShouldClose(window)) {
+    // capture and inference run on their own thread from here on
+    PoseStream poseStream(cam, opWrapper, rawYUYV, frameRows);
+    PoseHistory history;
+    op::Array<float> keypoints;
+    if (FLAGS_synthetic == 0)
+        poseStream.start();
+
+    // render loop, the HUD stages follow each other from here on
+    hud.mark();
+    for (int frame = 0; renderContext.running() && (FLAGS_frames <= 0 || frame < FLAGS_frames); frame++) {
+        if (renderContext.keyPressed(GLFW_KEY_H))
+            hud.visible = !hud.visible;
+        int outputWidth, outputHeight;
+        renderContext.framebufferSize(outputWidth, outputHeight);
+        renderScale.begin(outputWidth, outputHeight);
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
-        // keyboard input
-        processInput(window);
+        // the next avatar is requested on N or at its interval, and replaces the current one
+        // at the start of the first frame after it is resident
+        if (avatarSwap.enabled()) {
+            if (renderContext.keyPressed(GLFW_KEY_N) || (FLAGS_avatar_swap > 0.0 && poseClock() >= nextAvatarSwap)) {
+                avatarIndex = (avatarIndex + 1) % avatarDirs.size();
+                avatarSwap.request(avatarDirs[avatarIndex], avatarIndex == 0 ? std::string("avatar_parts.mesh")
+                                                            : "avatar_parts_" + std::to_string(avatarIndex) + ".mesh");
+                nextAvatarSwap = poseClock() + FLAGS_avatar_swap;
+            }
+            AvatarAssets assets;
+            if (avatarSwap.take(assets)) {
+                glState().bindTexture(1, GL_TEXTURE_2D_ARRAY, assets.parts.ID);
+                avatarParts.free();
+                avatarParts = assets.parts;
+                partMeshes = assets.meshes;
+                applyAvatar();
+            }
+        }
+
+        hud.lap(HUD_UPLOAD);
+
+        // newest inference result, if one finished since the last frame
+        PoseSample sample;
+        if (FLAGS_synthetic == 0 && poseStream.take(sample)) {
+            hud.pose(sample);
+            // queue the upload of the frame the pose was computed on
+            if (FLAGS_background != "none") {
+                stats.beginUpload();
+                if (background.texture == 0) {
+                    if (!background.init(sample.raw.cols, sample.raw.rows, rawYUYV ? BACKGROUND_YUYV : BACKGROUND_BGR, 3))
+                        break;
+                    backgroundSP.use();
+                    glUniform2f(frameSizeUni, background.width, background.height);
+                }
+                if (sample.raw.cols == background.width && sample.raw.rows == background.height)
+                    background.upload(sample.raw.data, sample.raw.step);
+                stats.endUpload();
+            }
+            hud.lap(HUD_UPLOAD);
+
+            // snap detected joints to the closest library pose, in the live position and scale
+            op::Array<float>& detected = sample.keypoints;
+            if (poseIndex.isOpen()) {
+                for (int p = 0; p < detected.getSize(0); p++) {
+                    GLfloat cx, cy, scale;
+                    if (!poseDescriptor(detected.getConstPtr() + p * detected.getSize(1) * 3, poseQuery, cx, cy, scale))
+                        continue;
+                    auto nearest = poseIndex.search(poseQuery, 1);
+                    if (nearest.empty())
+                        continue;
+                    poseFromDescriptor(poseIndex.descriptor(nearest[0].second), snappedJoints);
+                    for (int j = 0; j < POSE_INDEX_JOINTS; j++) {
+                        if (detected[{p, j, 2}] != 0) {
+                            detected[{p, j, 0}] = cx + snappedJoints[2 * j] * scale;
+                            detected[{p, j, 1}] = cy + snappedJoints[2 * j + 1] * scale;
+                        }
+                    }
+                }
+            }
+
+            // people in the order of the previous poses, every consumer below sees the same person at the same index
+            history.push(sample.time, detected);
+
+            // gestures of the first person
+            if (gestures.templateCount() > 0) {
+                if (detected.getSize(0) != 0)
+                    gestures.update(detected.getConstPtr());
+                else
+                    gestures.reset();
+            }
 
-        // read frame
-        cv::Mat frame;
-        cam >> frame;
-        if (frame.empty()) {
-            std::cout << "Cannot read frame" << std::endl;
+            // hands and face on the frame they were detected in
+            if (handFace)
+                handFace->update(sample.frame, detected);
+            hud.skeleton(detected);
+        } else if (poseStream.finished()) {
             break;
         }
 
-        // pose inference
-        const op::Matrix op_frame = OP_CV2OPCONSTMAT(frame);
-        auto data = opWrapper.emplaceAndPop(op_frame);
-        if (data != nullptr && !data->empty()) {
+        // camera background, the last uploaded frame until the next result arrives
+        if (background.texture != 0) {
+            backgroundSP.use();
+            glState().bindVertexArray(quadVAO);
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+            stats.drawCalls++;
+        }
 
-            const auto& keypoints = data->at(0)->poseKeypoints;
-            
+        // pose at the render time, between the inference results around it, or the synthetic skeletons
+        if (FLAGS_synthetic > 0) {
+            synthetic.pose(poseClock(), keypoints);
+            hud.skeleton(keypoints);
+        } else if (!history.empty()) {
+            history.sample(poseClock(), FLAGS_pose_interpolation, keypoints);
+        }
+        // every frame, so the render stage never also holds the pose work of a frame without poses
+        hud.lap(HUD_POSE);
+
+        if (FLAGS_synthetic > 0 || !history.empty()) {
             // if person detected
+            stats.beginRender();
             if (keypoints.getSize(0) != 0) {
 
-                glBindVertexArray(rectVAO);
                 glm::mat4 model_M;
+                int people = keypoints.getSize(0);
+                // hands and faces are indexed like the newest pose, held older poses may have other people
+                const bool detailsInOrder = people == history.newestPeople();
+                primitives.clear();
+
+                // bounded upload of the skins requested last frame, then the skins of the next
+                // cycle and of the next person to appear are loaded in the background
+                if (skinLibrary) {
+                    skinCache.update();
+                    for (int p = 0; p <= people; p++)
+                        skinCache.prefetch(FLAGS_skin_cycle > 0.0 ? skinOf(p + 1) : skinOf(p));
+                }
 
-                // scale dimensions by nose-ear distance
-                GLfloat limbWidth = LIMB_WIDTH;
-                GLfloat faceRadius = FACE_RADIUS;
-                if (keypoints[{0, 0, 2}] != 0) {
-
-                    glm::vec2 noseLoc = glm::vec2(keypoints[{0, 0, 0}], 
-                                                  keypoints[{0, 0, 1}]);
-
-                    if (keypoints[{0, 17, 2}] != 0) {
-                        // right ear detected
-                        glm::vec2 earLoc = glm::vec2(keypoints[{0, 17, 0}], 
-                                                        keypoints[{0, 17, 1}]);
-                        faceRadius = glm::distance(noseLoc, earLoc);
-                        limbWidth = faceRadius / 2;
-                    } else if (keypoints[{0, 18, 2}] != 0) {
-                        // left ear detected
-                        glm::vec2 earLoc = glm::vec2(keypoints[{0, 18, 0}], 
-                                                        keypoints[{0, 18, 1}]);
-                        faceRadius = glm::distance(noseLoc, earLoc);
-                        limbWidth = faceRadius / 2;
+                if (crowd.enabled()) {
+                    // culled and level of detail selected on the CPU, one instanced draw
+                    crowd.build(keypoints, poseClock(), limbBatch, instances);
+                    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+                    glBufferData(GL_ARRAY_BUFFER, sizeof(LimbInstance) * maxInstances, NULL, GL_STREAM_DRAW);
+                    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(LimbInstance) * instances.size(), instances.data());
+                    stats.bufferUploads++;
+
+                    instancedSP.use();
+                    glState().bindVertexArray(partVAO);
+                    glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, PART_MESH_VERTS, instances.size());
+                    stats.drawCalls++;
+                } else if (FLAGS_renderer == "keypoints") {
+                    // upload the raw keypoints once, the vertex shader builds every part
+                    glBindBuffer(GL_TEXTURE_BUFFER, keypointTBO);
+                    glBufferData(GL_TEXTURE_BUFFER, sizeof(GLfloat) * keypoints.getVolume(), keypoints.getConstPtr(), GL_STREAM_DRAW);
+                    stats.bufferUploads++;
+
+                    keypointSP.use();
+                    glUniform1i(jointsUni, keypoints.getSize(1));
+                    glState().bindVertexArray(keypointVAO);
+                    glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, PART_MESH_VERTS, people * NUM_PARTS);
+                    stats.uniformUploads++;
+                    stats.drawCalls++;
+                } else if (FLAGS_renderer == "skinned") {
+                    // bone transforms once per frame, the vertex shader blends them over the mesh
+                    skinMesh.skin(keypoints, limbBatch, skinTransforms);
+                    glBindBuffer(GL_TEXTURE_BUFFER, skinTBO);
+                    glBufferData(GL_TEXTURE_BUFFER, sizeof(GLfloat) * skinTransforms.size(), skinTransforms.data(), GL_STREAM_DRAW);
+                    stats.bufferUploads++;
+
+                    skinnedSP.use();
+                    glState().bindVertexArray(skinVAO);
+                    glDrawElementsInstanced(GL_TRIANGLES, skinMesh.indices.size(), GL_UNSIGNED_INT, 0, people);
+                    stats.drawCalls++;
+                } else if (FLAGS_renderer == "primitives") {
+                    // untextured avatar, drawn with the fingers and facial features below
+                    for (int p = 0; p < people; p++) {
+                        GLfloat faceRadius, limbWidth;
+                        avatarScale(keypoints, p, faceRadius, limbWidth);
+
+                        // limbs, torso as one wider rounded rect
+                        for (unsigned int i = 0; i < sizeof(primitiveLimbMap) / sizeof(primitiveLimbMap[0]); i++) {
+                            int idx1 = primitiveLimbMap[i][0];
+                            int idx2 = primitiveLimbMap[i][1];
+                            if (i == 8 || keypoints[{p, idx1, 2}] == 0 || keypoints[{p, idx2, 2}] == 0)
+                                continue;
+                            if (i == 7)
+                                primitives.roundedRect(keypoints[{p, idx1, 0}], keypoints[{p, idx1, 1}],
+                                                       keypoints[{p, idx2, 0}], keypoints[{p, idx2, 1}],
+                                                       limbWidth, limbWidth / 2, SKIN_COLOR);
+                            else
+                                primitives.capsule(keypoints[{p, idx1, 0}], keypoints[{p, idx1, 1}],
+                                                   keypoints[{p, idx2, 0}], keypoints[{p, idx2, 1}],
+                                                   limbWidth / 2, SKIN_COLOR);
+                        }
+
+                        // head and eyes
+                        if (keypoints[{p, 0, 2}] != 0) {
+                            primitives.circle(keypoints[{p, 0, 0}], keypoints[{p, 0, 1}], faceRadius, SKIN_COLOR);
+                            for (int i = 15; i <= 16; i++) {
+                                if (keypoints[{p, i, 2}] != 0)
+                                    primitives.circle(keypoints[{p, i, 0}], keypoints[{p, i, 1}], faceRadius / 5, FEATURE_COLOR);
+                            }
+                        }
                     }
-                }
+                } else {
+                    glState().bindVertexArray(partVAO);
+
+                    // queue the limbs of every person, transforms are computed in one batch
+                    std::vector<GLfloat> faceRadii(people);
+                    limbBatch.clear();
+                    for (int p = 0; p < people; p++) {
+
+                        // scale dimensions by nose-ear distance
+                        GLfloat faceRadius, limbWidth;
+                        avatarScale(keypoints, p, faceRadius, limbWidth);
+                        faceRadii[p] = faceRadius;
+
+                        // joint depths from the optional lifting stage
+                        GLfloat torso = 0.0f;
+                        bool lifted = lifter.enabled() &&
+                                      lifter.lift(keypoints.getConstPtr() + p * keypoints.getSize(1) * 3, jointDepth, torso);
+
+                        // limbs, back to front when depth is known
+                        limbOrder.clear();
+                        for (unsigned int i = 0; i < sizeof(limbMap) / sizeof(limbMap[0]); i++) {
+                            int idx1 = limbMap[i][0];
+                            int idx2 = limbMap[i][1];
+
+                            if (keypoints[{p, idx1, 2}] != 0 && keypoints[{p, idx2, 2}] != 0) {
+                                GLfloat depth = lifted ? (jointDepth[idx1] + jointDepth[idx2]) / 2 : 0.0f;
+                                limbOrder.push_back(std::make_pair(depth, i));
+                            }
+                        }
+                        std::stable_sort(limbOrder.begin(), limbOrder.end(),
+                                         [](const std::pair<GLfloat, unsigned int>& a, const std::pair<GLfloat, unsigned int>& b) {
+                                             return a.first > b.first;
+                                         });
+
+                        for (size_t k = 0; k < limbOrder.size(); k++) {
+                            unsigned int i = limbOrder[k].second;
+                            int idx1 = limbMap[i][0];
+                            int idx2 = limbMap[i][1];
+                            glm::vec2 coord1 = glm::vec2(keypoints[{p, idx1, 0}], keypoints[{p, idx1, 1}]);
+                            glm::vec2 coord2 = glm::vec2(keypoints[{p, idx2, 0}], keypoints[{p, idx2, 1}]);
+
+                            // make torso wider
+                            GLfloat width = (i == 0 || i == 1) ? limbWidth * 2 : limbWidth;
+                            if (lifted) {
+                                // perspective scale, nearer limbs are wider
+                                GLfloat scale = LIFT_CAMERA_DISTANCE / (LIFT_CAMERA_DISTANCE + limbOrder[k].first / torso);
+                                width *= glm::clamp(scale, 0.5f, 2.0f);
+
+                                // limbs pointing at the camera keep at least their cross-section
+                                GLfloat length = glm::distance(coord1, coord2);
+                                if (length > 0.0f && length < width)
+                                    coord2 = coord1 + (coord2 - coord1) * (width / length);
+                            }
+                            limbBatch.add(p, i, coord1.x, coord1.y, coord2.x, coord2.y, width);
+                        }
+                    }
+                    limbBatch.compute();
+
+                    if (FLAGS_renderer == "instanced") {
+                        // limbs then head of every person, in draw order, morphed heads are drawn
+                        // after all limbs with the weights fitted to the face keypoints
+                        instances.clear();
+                        morphInstances.clear();
+                        size_t limb = 0;
+                        for (int p = 0; p < people && instances.size() < maxInstances - NUM_PARTS; p++) {
+                            // every person wears the first layer of their skin, or the default skin until it is resident
+                            int skinLayer = skinLibrary ? skinCache.layer(skinOf(p)) : 0;
+                            for (; limb < limbBatch.size() && limbBatch.person[limb] == p; limb++)
+                                instances.push_back(limbBatch.instance(limb, skinLayer + limbBatch.limb[limb]));
+
+                            if (keypoints[{p, 0, 2}] == 0)
+                                continue;
+                            LimbInstance head = headInstance(keypoints[{p, 0, 0}], keypoints[{p, 0, 1}], faceRadii[p]);
+                            head.layer += skinLayer;
+                            if (morphFaces) {
+                                // face keypoints in the matched order of the pose, neutral on held poses of other people
+                                if (!handFace || !detailsInOrder || !handFace->faceKeypoints(p, detailPoints.data()) ||
+                                    !MorphHead::solve(detailPoints.data(), morphWeights))
+                                    std::fill(morphWeights, morphWeights + MORPH_TARGETS, 0.0f);
+                                morphInstances.push_back(MorphHead::instance(head, morphWeights));
+                            } else {
+                                instances.push_back(head);
+                            }
+                        }
 
-                avatarSP.use();
-
-                // limbs
-                for (unsigned int i = 0; i < sizeof(limbMap) / sizeof(limbMap[0]); i++) {
-                    int idx1 = limbMap[i][0];
-                    int idx2 = limbMap[i][1];
-
-                    if (keypoints[{0, idx1, 2}] != 0 && keypoints[{0, idx2, 2}] != 0) {
-                        glm::vec2 coord1 = glm::vec2(keypoints[{0, idx1, 0}], 
-                                                     keypoints[{0, idx1, 1}]);
-                        glm::vec2 coord2 = glm::vec2(keypoints[{0, idx2, 0}], 
-                                                     keypoints[{0, idx2, 1}]);
-                        GLfloat length = glm::distance(coord1, coord2);
-                        GLfloat theta = atan2(coord2.y - coord1.y, coord2.x - coord1.x);
-
-                        model_M = glm::mat4(1.0f);
-                        model_M = glm::translate(model_M, glm::vec3(coord1.x, coord1.y, 0.0f));
-                        model_M = glm::rotate(model_M, theta, glm::vec3(0.0f, 0.0f, 1.0f));
-                        // make torso wider
-                        if (i == 0 || i == 1) {
-                            model_M = glm::scale(model_M, glm::vec3(length, limbWidth * 2, 1.0f));
-                        } else {
-                            model_M = glm::scale(model_M, glm::vec3(length, limbWidth, 1.0f));
+                        // orphan and refill the instance buffer
+                        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+                        glBufferData(GL_ARRAY_BUFFER, sizeof(LimbInstance) * maxInstances, NULL, GL_STREAM_DRAW);
+                        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(LimbInstance) * instances.size(), instances.data());
+                        stats.bufferUploads++;
+
+                        instancedSP.use();
+                        glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, PART_MESH_VERTS, instances.size());
+                        stats.drawCalls++;
+
+                        if (!morphInstances.empty()) {
+                            glBindBuffer(GL_ARRAY_BUFFER, morphInstanceVBO);
+                            glBufferData(GL_ARRAY_BUFFER, sizeof(MorphHeadInstance) * morphInstances.size(),
+                                         morphInstances.data(), GL_STREAM_DRAW);
+                            stats.bufferUploads++;
+
+                            morphSP.use();
+                            glState().bindVertexArray(morphVAO);
+                            glDrawElementsInstanced(GL_TRIANGLES, morphHead.indices.size(), GL_UNSIGNED_INT, 0, morphInstances.size());
+                            stats.drawCalls++;
+                        }
+                    } else {
+                        avatarSP.use();
+
+                        size_t limb = 0;
+                        for (int p = 0; p < people; p++) {
+                            // limbs
+                            for (; limb < limbBatch.size() && limbBatch.person[limb] == p; limb++) {
+                                limbBatch.modelMatrix(limb, glm::value_ptr(model_M));
+                                glUniformMatrix4fv(modelUni2, 1, GL_FALSE, glm::value_ptr(model_M));
+                                glUniform1i(layerUni, limbBatch.limb[limb]);
+                                glDrawArrays(GL_TRIANGLE_FAN, limbBatch.limb[limb] * PART_MESH_VERTS, PART_MESH_VERTS);
+                                stats.uniformUploads += 2;
+                                stats.drawCalls++;
+                            }
+
+                            // avatar head
+                            if (keypoints[{p, 0, 2}] != 0) {
+                                glm::vec2 noseLoc = glm::vec2(keypoints[{p, 0, 0}], 
+                                                              keypoints[{p, 0, 1}]);
+                                GLfloat faceRadius = faceRadii[p];
+
+                                model_M = glm::mat4(1.0f);
+                                model_M = glm::translate(model_M, glm::vec3(noseLoc.x - faceRadius, 
+                                                                            noseLoc.y - faceRadius, 
+                                                                            0.0f));
+                                model_M = glm::scale(model_M, glm::vec3(2 * faceRadius, 2 * faceRadius, 1.0f));
+                                glUniformMatrix4fv(modelUni2, 1, GL_FALSE, glm::value_ptr(model_M));
+                                glUniform1i(layerUni, 10);
+                                glDrawArrays(GL_TRIANGLE_FAN, 10 * PART_MESH_VERTS, PART_MESH_VERTS);
+                                stats.uniformUploads += 2;
+                                stats.drawCalls++;
+                            }
                         }
-                        glUniformMatrix4fv(modelUni2, 1, GL_FALSE, glm::value_ptr(model_M));
-                        glBindTexture(GL_TEXTURE_2D, avatarTextures[i]);
-                        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
                     }
                 }
 
-                // avatar head
-                if (keypoints[{0, 0, 2}] != 0) {
-                    glm::vec2 noseLoc = glm::vec2(keypoints[{0, 0, 0}], 
-                                                  keypoints[{0, 0, 1}]);
-
-                    model_M = glm::mat4(1.0f);
-                    model_M = glm::translate(model_M, glm::vec3(noseLoc.x - faceRadius, 
-                                                                noseLoc.y - faceRadius, 
-                                                                0.0f));
-                    model_M = glm::scale(model_M, glm::vec3(2 * faceRadius, 2 * faceRadius, 1.0f));
-                    glUniformMatrix4fv(modelUni2, 1, GL_FALSE, glm::value_ptr(model_M));
-                    glBindTexture(GL_TEXTURE_2D, avatarTextures[10]);
-                    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-                }
+                // fingers and facial features, drawn as thin capsules, not on the crowd
+                if (handFace && detailsInOrder && !crowd.enabled()) {
+                    for (int p = 0; p < people; p++) {
+                        GLfloat faceRadius, limbWidth;
+                        avatarScale(keypoints, p, faceRadius, limbWidth);
+                        GLfloat fingerRadius = faceRadius / 20;
+                        for (int side = 0; side < 2; side++) {
+                            if (!handFace->handKeypoints(p, side, detailPoints.data()))
+                                continue;
+                            for (unsigned int i = 0; i < sizeof(handBones) / sizeof(handBones[0]); i++) {
+                                const float* j1 = &detailPoints[handBones[i][0] * 3];
+                                const float* j2 = &detailPoints[handBones[i][1] * 3];
+                                if (j1[2] != 0 && j2[2] != 0)
+                                    primitives.capsule(j1[0], j1[1], j2[0], j2[1], fingerRadius, SKIN_COLOR);
+                            }
+                        }
 
-                /*
-                defaultSP.use();
-
-                // limbs
-                for (unsigned int i = 0; i < sizeof(limbMap) / sizeof(limbMap[0]); i++) {
-                    int idx1 = limbMap[i][0];
-                    int idx2 = limbMap[i][1];
-
-                    if (keypoints[{0, idx1, 2}] != 0 && keypoints[{0, idx2, 2}] != 0) {
-                        glm::vec2 coord1 = glm::vec2(keypoints[{0, idx1, 0}], 
-                                                     keypoints[{0, idx1, 1}]);
-                        glm::vec2 coord2 = glm::vec2(keypoints[{0, idx2, 0}], 
-                                                     keypoints[{0, idx2, 1}]);
-                        GLfloat length = glm::distance(coord1, coord2);
-                        GLfloat theta = atan2(coord2.y - coord1.y, coord2.x - coord1.x);
-
-                        model_M = glm::mat4(1.0f);
-                        model_M = glm::translate(model_M, glm::vec3(coord1.x + LIMB_WIDTH / 2, 
-                                                                    coord1.y + LIMB_WIDTH / 2, 
-                                                                    0.0f));
-                        model_M = glm::rotate(model_M, theta, glm::vec3(0.0f, 0.0f, 1.0f));
-                        // make torso wider
-                        if (i == 7 || i == 8) {
-                            model_M = glm::scale(model_M, glm::vec3(length, limbWidth * 1.5, 1.0f));
-                        } else {
-                            model_M = glm::scale(model_M, glm::vec3(length, limbWidth, 1.0f));
+                        if (morphFaces || !handFace->faceKeypoints(p, detailPoints.data()))
+                            continue;
+                        GLfloat featureRadius = faceRadius / 40;
+                        for (size_t i = 0; i < faceSegs.size(); i++) {
+                            const float* j1 = &detailPoints[faceSegs[i].first * 3];
+                            const float* j2 = &detailPoints[faceSegs[i].second * 3];
+                            if (j1[2] != 0 && j2[2] != 0)
+                                primitives.capsule(j1[0], j1[1], j2[0], j2[1], featureRadius, FEATURE_COLOR);
                         }
-                        glUniformMatrix4fv(modelUni1, 1, GL_FALSE, glm::value_ptr(model_M));
-                        //glUniform4f(colorUni, 0.96f, 0.96f, 0.86f, 1.0f);
-                        glUniform4f(colorUni, 1.0f, 1.0f, 1.0f, 1.0f);
-                        glBindTexture(GL_TEXTURE_2D, skinTexture);
-                        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
                     }
                 }
 
-                // head
-                glBindVertexArray(circVAO);
-                if (keypoints[{0, 0, 2}] != 0) {
-                    glm::vec2 noseLoc = glm::vec2(keypoints[{0, 0, 0}], 
-                                                  keypoints[{0, 0, 1}]);
-
-                    model_M = glm::mat4(1.0f);
-                    model_M = glm::translate(model_M, glm::vec3(noseLoc.x - circleLoc.x, 
-                                                                noseLoc.y - circleLoc.y, 
-                                                                0.0f));
-                    model_M = glm::scale(model_M, glm::vec3(faceRadius, faceRadius, faceRadius));
-                    glUniformMatrix4fv(modelUni1, 1, GL_FALSE, glm::value_ptr(model_M));
-                    glUniform4f(colorUni, 0.96f, 0.96f, 0.86f, 1.0f);
-                    glBindTexture(GL_TEXTURE_2D, blankTexture);
-                    glDrawArrays(GL_TRIANGLE_FAN, 0, CIRCLE_QUALITY + 2);
-
-                    // eyes
-                    for (int i = 15; i <= 16; i++) {
-                        if (keypoints[{0, i, 2}] != 0) {
-                            model_M = glm::mat4(1.0f);
-                            glm::vec2 eyeLoc = glm::vec2(keypoints[{0, i, 0}], 
-                                                         keypoints[{0, i, 1}]);
-
-                            model_M = glm::translate(model_M, glm::vec3(eyeLoc.x - circleLoc.x, 
-                                                                        eyeLoc.y - circleLoc.y, 
-                                                                        0.0f));
-                            model_M = glm::scale(model_M, glm::vec3(faceRadius / 5, faceRadius / 5, faceRadius / 5));
-                            glUniformMatrix4fv(modelUni1, 1, GL_FALSE, glm::value_ptr(model_M));
-                            glUniform4f(colorUni, 0.0f, 0.0f, 0.0f, 1.0f);
-                            glBindTexture(GL_TEXTURE_2D, blankTexture);
-                            glDrawArrays(GL_TRIANGLE_FAN, 0, CIRCLE_QUALITY + 2);
-                        }
-                    }
+                // all procedural primitives in one instanced draw, blended for the anti-aliased edges
+                if (primitives.size() != 0) {
+                    glBindBuffer(GL_ARRAY_BUFFER, sdfVBO);
+                    glBufferData(GL_ARRAY_BUFFER, sizeof(SDFPrimitive) * primitives.size(), primitives.items.data(), GL_STREAM_DRAW);
+                    stats.bufferUploads++;
+
+                    sdfSP.use();
+                    glState().bindVertexArray(sdfVAO);
+                    glState().setBlend(true);
+                    glState().blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, primitives.size());
+                    glState().setBlend(false);
+                    stats.drawCalls++;
                 }
-                */
             }
-        } else {
-            std::cout << "Null or empty processed data" << std::endl;
+            stats.endRender();
         }
+        if (renderScale.isEnabled()) {
+            renderScale.end(renderContext.framebuffer, upscaleSP, regionScaleUni, quadVAO);
+            stats.drawCalls++;
+        }
+        hud.lap(HUD_RENDER);
+        hud.gpu(renderScale.gpuTime());
+        stats.stateCalls = glState().issued;
+        stats.stateSkipped = glState().skipped;
+        glState().resetCounters();
+        recorder.capture();
+        // after the capture, the recording stays clean
+        hud.draw(hudSP, skeletonSP, outputWidth, outputHeight);
+        bool report = stats.endFrame(FLAGS_stats) && FLAGS_stats;
+        if (report && recorder.isOpen())
+            recorder.report();
+
+        hud.lap(HUD_OUTPUT);
 
         // swap buffers, poll IO events
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        renderContext.present();
+        pacer.endFrame();
+        hud.lap(HUD_SWAP);
+        hud.endFrame();
+        if (crowd.enabled())
+            crowd.endFrame(FLAGS_stats);
+        if (report) {
+            pacer.report();
+            renderScale.report();
+            if (skinLibrary)
+                skinCache.report();
+        }
+        if (crowd.sweepDone())
+            break;
     }
 
     // de-allocate resources
+    poseStream.stop();
+    avatarSwap.stop();
     cam.release();
-    glDeleteVertexArrays(1, &rectVAO);
-    glDeleteVertexArrays(1, &circVAO);
-    glDeleteBuffers(1, &rectVBO);
-    glDeleteBuffers(1, &circVBO);
-    defaultSP.free();
+    glDeleteVertexArrays(1, &partVAO);
+    glDeleteVertexArrays(1, &sdfVAO);
+    glDeleteVertexArrays(1, &quadVAO);
+    glDeleteBuffers(1, &partVBO);
+    glDeleteBuffers(1, &instanceVBO);
+    glDeleteBuffers(1, &sdfVBO);
+    glDeleteVertexArrays(1, &keypointVAO);
+    glDeleteBuffers(1, &keypointTBO);
+    glDeleteTextures(1, &keypointTexture);
+    glDeleteVertexArrays(1, &skinVAO);
+    glDeleteBuffers(1, &skinVBO);
+    glDeleteBuffers(1, &skinEBO);
+    glDeleteBuffers(1, &skinTBO);
+    glDeleteTextures(1, &skinTexture);
+    glDeleteVertexArrays(1, &morphVAO);
+    glDeleteBuffers(1, &morphVBO);
+    glDeleteBuffers(1, &morphEBO);
+    glDeleteBuffers(1, &morphInstanceVBO);
+    glDeleteBuffers(1, &morphTBO);
+    glDeleteTextures(1, &morphTexture);
     avatarSP.free();
-    glfwTerminate();
+    instancedSP.free();
+    keypointSP.free();
+    skinnedSP.free();
+    morphSP.free();
+    sdfSP.free();
+    hudSP.free();
+    skeletonSP.free();
+    hud.free();
+    backgroundSP.free();
+    upscaleSP.free();
+    background.free();
+    renderScale.free();
+    avatarParts.free();
+    skinCache.free();
+    recorder.close();
+    pacer.free();
+    renderContext.destroy();
     return 0;
 }
-
-// process keyboard input
-void processInput(GLFWwindow *window) {
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-        glfwSetWindowShouldClose(window, true);
-}
-
-// glfw: window resize callback function
-void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
-    // set viewport to window dimensions
-    glViewport(0, 0, width, height);
-}
@@ -0,0 +1,245 @@
+#ifndef MORPHHEAD
+#define MORPHHEAD
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "avatar.h"
+#include "limbtransform.h"
+
+// expressions of the avatar head: jaw open, smile, frown, right blink, left blink, brows up
+const int MORPH_TARGETS = 6;
+// cells along each side of the head mesh
+const int MORPH_GRID = 16;
+// landmark features the weights are fitted to
+const int MORPH_FEATURES = 6;
+
+// features of a neutral face in inter-ocular distances, and the change of every feature at
+// full weight of each target: mouth opening, mouth width, mouth corner lift, right eye
+// opening, left eye opening, brow height above the eyes
+const float morphNeutral[MORPH_FEATURES] = {0.02f, 0.80f, 0.0f, 0.13f, 0.13f, 0.35f};
+const float morphBasis[MORPH_TARGETS][MORPH_FEATURES] = {
+    {0.45f, -0.08f, -0.03f, 0.0f, 0.0f, 0.02f},       // jaw open
+    {0.02f, 0.20f, 0.10f, -0.02f, -0.02f, 0.0f},      // smile
+    {0.0f, -0.05f, -0.08f, 0.0f, 0.0f, -0.10f},       // frown
+    {0.0f, 0.0f, 0.0f, -0.12f, 0.0f, -0.02f},         // right blink
+    {0.0f, 0.0f, 0.0f, 0.0f, -0.12f, -0.02f},         // left blink
+    {0.0f, 0.0f, 0.0f, 0.03f, 0.03f, 0.12f}};         // brows up
+// features of the head texture in texel coords
+const float MORPH_MOUTH_V = 0.17f;
+const float MORPH_MOUTH_RIGHT_U = 0.38f;
+const float MORPH_MOUTH_LEFT_U = 0.62f;
+const float MORPH_EYE_V = 0.335f;
+const float MORPH_EYE_RIGHT_U = 0.34f;
+const float MORPH_EYE_LEFT_U = 0.61f;
+const float MORPH_BROW_V = 0.41f;
+// ridge term keeping the fit stable when targets move the same features
+const float MORPH_RIDGE = 1e-3f;
+
+// per-instance attributes of a morphed head: its head part transform and the target weights
+struct MorphHeadInstance {
+    float axisX[2];
+    float axisY[2];
+    float offset[2];
+    float weights[8];
+};
+
+
+// the head part as a grid mesh whose texels are displaced by morph targets in the vertex
+// shader; displacements are in the texel space of the head texture, which is stored upside
+// down, so up on the face is +v and the right eye of the person is at the smaller u
+// per frame only the target weights are solved on the CPU, by a non-negative least squares
+// fit of the targets to a few features of the face landmarks
+class MorphHead {
+public:
+    // texel coords per vertex
+    std::vector<float> texels;
+    std::vector<unsigned int> indices;
+    // displacement of every vertex per target, target-major, two floats per vertex
+    std::vector<float> displacements;
+
+    void build() {
+        texels.clear();
+        indices.clear();
+        for (int j = 0; j <= MORPH_GRID; j++) {
+            for (int i = 0; i <= MORPH_GRID; i++) {
+                texels.push_back(i / (float)MORPH_GRID);
+                texels.push_back(j / (float)MORPH_GRID);
+            }
+        }
+        for (int j = 0; j < MORPH_GRID; j++) {
+            for (int i = 0; i < MORPH_GRID; i++) {
+                unsigned int v00 = j * (MORPH_GRID + 1) + i, v10 = v00 + 1;
+                unsigned int v01 = v00 + MORPH_GRID + 1, v11 = v01 + 1;
+                indices.insert(indices.end(), {v00, v10, v11, v00, v11, v01});
+            }
+        }
+
+        size_t count = texels.size() / 2;
+        displacements.assign(MORPH_TARGETS * count * 2, 0.0f);
+        for (size_t v = 0; v < count; v++) {
+            float u = texels[2 * v], t = texels[2 * v + 1];
+            float* d;
+
+            // jaw open: the face below the mouth drops
+            d = &displacements[(0 * count + v) * 2];
+            d[1] = -0.06f * falloff(u, 0.5f, 0.18f) * std::min(1.0f, std::max(0.0f, (MORPH_MOUTH_V + 0.02f - t) / 0.04f));
+
+            // smile and frown: the mouth corners move up and out, or down
+            for (int side = 0; side < 2; side++) {
+                float cornerU = side == 0 ? MORPH_MOUTH_RIGHT_U : MORPH_MOUTH_LEFT_U;
+                float g = falloff(u, cornerU, 0.06f) * falloff(t, MORPH_MOUTH_V, 0.06f);
+                displacements[(1 * count + v) * 2] += (side == 0 ? -0.02f : 0.02f) * g;
+                displacements[(1 * count + v) * 2 + 1] += 0.03f * g;
+                displacements[(2 * count + v) * 2 + 1] += -0.025f * g;
+            }
+            // frown: the brows move down and in
+            for (int side = 0; side < 2; side++) {
+                float browU = side == 0 ? MORPH_EYE_RIGHT_U : MORPH_EYE_LEFT_U;
+                float g = falloff(u, browU, 0.08f) * falloff(t, MORPH_BROW_V, 0.05f);
+                displacements[(2 * count + v) * 2] += (side == 0 ? 0.015f : -0.015f) * g;
+                displacements[(2 * count + v) * 2 + 1] += -0.02f * g;
+            }
+
+            // blinks: each eye is squashed onto its middle line
+            for (int side = 0; side < 2; side++) {
+                float eyeU = side == 0 ? MORPH_EYE_RIGHT_U : MORPH_EYE_LEFT_U;
+                d = &displacements[((3 + side) * count + v) * 2];
+                d[1] = -0.8f * (t - MORPH_EYE_V) * falloff(u, eyeU, 0.08f) * falloff(t, MORPH_EYE_V, 0.06f);
+            }
+
+            // brows up: the brows and the forehead above them rise
+            d = &displacements[(5 * count + v) * 2];
+            for (int side = 0; side < 2; side++)
+                d[1] += 0.03f * falloff(u, side == 0 ? MORPH_EYE_RIGHT_U : MORPH_EYE_LEFT_U, 0.09f) * falloff(t, MORPH_BROW_V, 0.06f);
+        }
+    }
+
+    size_t vertexCount() const {
+        return texels.size() / 2;
+    }
+
+    // target weights from the 70 face keypoints (x, y, conf) of a person, all zero when the
+    // landmarks the features need were not detected
+    static bool solve(const float* face, float* weights) {
+        std::fill(weights, weights + MORPH_TARGETS, 0.0f);
+        float features[MORPH_FEATURES];
+        if (!measure(face, features))
+            return false;
+
+        // non-negative least squares by active set: solve the ridge normal equations over
+        // the free targets, pin the most negative weight to zero, repeat
+        float residual[MORPH_FEATURES];
+        for (int f = 0; f < MORPH_FEATURES; f++)
+            residual[f] = features[f] - morphNeutral[f];
+        bool free[MORPH_TARGETS];
+        std::fill(free, free + MORPH_TARGETS, true);
+        for (int pass = 0; pass < MORPH_TARGETS; pass++) {
+            float a[MORPH_TARGETS][MORPH_TARGETS + 1];
+            for (int i = 0; i < MORPH_TARGETS; i++) {
+                for (int j = 0; j < MORPH_TARGETS; j++) {
+                    float sum = 0.0f;
+                    for (int f = 0; f < MORPH_FEATURES; f++)
+                        sum += morphBasis[i][f] * morphBasis[j][f];
+                    a[i][j] = free[i] && free[j] ? sum + (i == j ? MORPH_RIDGE : 0.0f) : (i == j ? 1.0f : 0.0f);
+                }
+                float rhs = 0.0f;
+                for (int f = 0; f < MORPH_FEATURES; f++)
+                    rhs += morphBasis[i][f] * residual[f];
+                a[i][MORPH_TARGETS] = free[i] ? rhs : 0.0f;
+            }
+            gauss(a, weights);
+
+            int worst = -1;
+            for (int i = 0; i < MORPH_TARGETS; i++) {
+                if (free[i] && weights[i] < 0.0f && (worst < 0 || weights[i] < weights[worst]))
+                    worst = i;
+            }
+            if (worst < 0)
+                break;
+            free[worst] = false;
+        }
+        // smile and frown pull the mouth corners opposite ways, only their difference shows
+        float corners = weights[1] - weights[2];
+        weights[1] = std::max(corners, 0.0f);
+        weights[2] = std::max(-corners, 0.0f);
+        for (int i = 0; i < MORPH_TARGETS; i++)
+            weights[i] = std::min(1.0f, std::max(0.0f, weights[i]));
+        return true;
+    }
+
+    static MorphHeadInstance instance(const LimbInstance& head, const float* weights) {
+        MorphHeadInstance inst = {{head.axisX[0], head.axisX[1]}, {head.axisY[0], head.axisY[1]},
+                                  {head.offset[0], head.offset[1]}, {0.0f}};
+        std::copy(weights, weights + MORPH_TARGETS, inst.weights);
+        return inst;
+    }
+
+private:
+    static float falloff(float x, float center, float radius) {
+        float d = (x - center) / radius;
+        return std::exp(-d * d);
+    }
+
+    // features in a face frame from the right to the left eye, scaled by their distance
+    static bool measure(const float* face, float* features) {
+        const int used[] = {17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 36, 37, 38, 39, 40, 41,
+                            42, 43, 44, 45, 46, 47, 48, 51, 54, 57, 62, 66};
+        for (unsigned int i = 0; i < sizeof(used) / sizeof(used[0]); i++) {
+            if (face[used[i] * 3 + 2] == 0)
+                return false;
+        }
+        float rx = 0.0f, ry = 0.0f, lx = 0.0f, ly = 0.0f;
+        for (int i = 0; i < 6; i++) {
+            rx += face[(36 + i) * 3] / 6;
+            ry += face[(36 + i) * 3 + 1] / 6;
+            lx += face[(42 + i) * 3] / 6;
+            ly += face[(42 + i) * 3 + 1] / 6;
+        }
+        float iod = std::sqrt((lx - rx) * (lx - rx) + (ly - ry) * (ly - ry));
+        if (iod <= 0.0f)
+            return false;
+        // x towards the left eye, y down the face
+        float ex = (lx - rx) / iod, ey = (ly - ry) / iod;
+        auto fx = [&](int p) { return ((face[p * 3] - rx) * ex + (face[p * 3 + 1] - ry) * ey) / iod; };
+        auto fy = [&](int p) { return (-(face[p * 3] - rx) * ey + (face[p * 3 + 1] - ry) * ex) / iod; };
+
+        features[0] = std::max(0.0f, fy(66) - fy(62));
+        features[1] = fx(54) - fx(48);
+        features[2] = (fy(51) + fy(57)) / 2 - (fy(48) + fy(54)) / 2;
+        features[3] = (fy(41) - fy(37) + fy(40) - fy(38)) / 2;
+        features[4] = (fy(47) - fy(43) + fy(46) - fy(44)) / 2;
+        float brow = 0.0f;
+        for (int p = 17; p <= 26; p++)
+            brow -= fy(p) / 10;
+        features[5] = brow;
+        return true;
+    }
+
+    // gaussian elimination with partial pivoting of the augmented system
+    static void gauss(float a[MORPH_TARGETS][MORPH_TARGETS + 1], float* x) {
+        for (int c = 0; c < MORPH_TARGETS; c++) {
+            int pivot = c;
+            for (int r = c + 1; r < MORPH_TARGETS; r++) {
+                if (std::fabs(a[r][c]) > std::fabs(a[pivot][c]))
+                    pivot = r;
+            }
+            for (int k = 0; k <= MORPH_TARGETS; k++)
+                std::swap(a[c][k], a[pivot][k]);
+            for (int r = c + 1; r < MORPH_TARGETS; r++) {
+                float f = a[r][c] / a[c][c];
+                for (int k = c; k <= MORPH_TARGETS; k++)
+                    a[r][k] -= f * a[c][k];
+            }
+        }
+        for (int r = MORPH_TARGETS - 1; r >= 0; r--) {
+            float sum = a[r][MORPH_TARGETS];
+            for (int k = r + 1; k < MORPH_TARGETS; k++)
+                sum -= a[r][k] * x[k];
+            x[r] = sum / a[r][r];
+        }
+    }
+};
+
+#endif
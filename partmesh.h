@@ -0,0 +1,252 @@
+#ifndef PARTMESH
+#define PARTMESH
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "stb_image.h"
+
+// vertices of every part outline, drawn as a triangle fan, shorter outlines repeat their last vertex
+const int PART_MESH_VERTS = 12;
+// texels below this alpha are discarded by the fragment shaders
+const unsigned char PART_MESH_ALPHA = 26;
+
+
+// tight convex outlines of the avatar parts, traced from the alpha channel so the
+// transparent corners of the quads are never rasterized
+// vertices are in the texel space of each part, (0, 0) is the top left of the image
+class PartMeshes {
+public:
+    // PART_MESH_VERTS texel coords per part
+    std::vector<float> vertices;
+    // fraction of the quad covered by the outline and by opaque texels, per part
+    std::vector<float> meshCoverage;
+    std::vector<float> opaqueCoverage;
+
+    // trace the outlines of the part images, reusing the cache while the images are unchanged
+    bool load(const std::vector<std::string>& paths, const std::string& cachePath) {
+        int parts = paths.size();
+        vertices.assign(parts * PART_MESH_VERTS * 2, 0.0f);
+        meshCoverage.assign(parts, 1.0f);
+        opaqueCoverage.assign(parts, 1.0f);
+
+        std::vector<std::string> keys(parts);
+        for (int i = 0; i < parts; i++) {
+            struct stat info;
+            if (stat(paths[i].c_str(), &info) != 0) {
+                std::cout << "ERROR::PARTMESH::FILE_NOT_FOUND " << paths[i] << std::endl;
+                return false;
+            }
+            std::ostringstream key;
+            key << info.st_size << "_" << info.st_mtime;
+            keys[i] = key.str();
+        }
+
+        if (readCache(cachePath, keys))
+            return true;
+
+        for (int i = 0; i < parts; i++) {
+            int width, height, channels;
+            unsigned char* image = stbi_load(paths[i].c_str(), &width, &height, &channels, 4);
+            if (image == NULL) {
+                std::cout << "ERROR::PARTMESH::FILE_NOT_SUCCESFULLY_READ " << paths[i] << std::endl;
+                return false;
+            }
+            trace(image, width, height, i);
+            stbi_image_free(image);
+        }
+        writeCache(cachePath, keys);
+        return true;
+    }
+
+    // plain quads for every part, for comparison against the traced outlines
+    void quads(int parts) {
+        const float corners[4][2] = {{0.0f, 0.0f}, {0.0f, 1.0f}, {1.0f, 1.0f}, {1.0f, 0.0f}};
+        vertices.resize(parts * PART_MESH_VERTS * 2);
+        meshCoverage.assign(parts, 1.0f);
+        opaqueCoverage.assign(parts, 1.0f);
+        for (int p = 0; p < parts; p++) {
+            for (int v = 0; v < PART_MESH_VERTS; v++) {
+                vertices[(p * PART_MESH_VERTS + v) * 2] = corners[std::min(v, 3)][0];
+                vertices[(p * PART_MESH_VERTS + v) * 2 + 1] = corners[std::min(v, 3)][1];
+            }
+        }
+    }
+
+    // fragments saved per part compared to full quads
+    void report() const {
+        for (size_t p = 0; p < meshCoverage.size(); p++) {
+            std::cout << "part " << p << ": outline covers " << 100.0f * meshCoverage[p]
+                      << "% of the quad (" << 100.0f * opaqueCoverage[p] << "% opaque), "
+                      << 100.0f * (1.0f - meshCoverage[p]) << "% fewer fragments" << std::endl;
+        }
+    }
+
+private:
+    struct Point {
+        double x, y;
+    };
+
+    static double cross(const Point& o, const Point& a, const Point& b) {
+        return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+    }
+
+    static double area(const std::vector<Point>& poly) {
+        double sum = 0.0;
+        for (size_t i = 0; i < poly.size(); i++) {
+            const Point& a = poly[i];
+            const Point& b = poly[(i + 1) % poly.size()];
+            sum += a.x * b.y - b.x * a.y;
+        }
+        return sum / 2;
+    }
+
+    // convex hull of the opaque texels, then reduced to PART_MESH_VERTS without uncovering any of them
+    void trace(const unsigned char* image, int width, int height, int part) {
+        // outer corners of the first and last opaque texel of every row, grown by half a texel
+        // so filtering at the edges stays inside the outline
+        std::vector<Point> points;
+        long opaque = 0;
+        for (int y = 0; y < height; y++) {
+            int first = -1, last = -1;
+            for (int x = 0; x < width; x++) {
+                if (image[(y * width + x) * 4 + 3] >= PART_MESH_ALPHA) {
+                    if (first < 0)
+                        first = x;
+                    last = x;
+                    opaque++;
+                }
+            }
+            if (first < 0)
+                continue;
+            double top = std::max(0.0, y - 0.5), bottom = std::min((double)height, y + 1.5);
+            double left = std::max(0.0, first - 0.5), right = std::min((double)width, last + 1.5);
+            points.push_back({left, top});
+            points.push_back({left, bottom});
+            points.push_back({right, top});
+            points.push_back({right, bottom});
+        }
+
+        std::vector<Point> hull = convexHull(points);
+        reduce(hull, width, height);
+        if (hull.size() < 3 || (int)hull.size() > PART_MESH_VERTS) {
+            // nothing to trace or no tight enough outline, keep the whole quad
+            hull = {{0.0, 0.0}, {0.0, (double)height}, {(double)width, (double)height}, {(double)width, 0.0}};
+        }
+
+        meshCoverage[part] = std::fabs(area(hull)) / ((double)width * height);
+        opaqueCoverage[part] = opaque / ((double)width * height);
+        for (int v = 0; v < PART_MESH_VERTS; v++) {
+            const Point& p = hull[std::min(v, (int)hull.size() - 1)];
+            vertices[(part * PART_MESH_VERTS + v) * 2] = p.x / width;
+            vertices[(part * PART_MESH_VERTS + v) * 2 + 1] = p.y / height;
+        }
+    }
+
+    // monotone chain, counter-clockwise in image coords
+    static std::vector<Point> convexHull(std::vector<Point> points) {
+        std::sort(points.begin(), points.end(), [](const Point& a, const Point& b) {
+            return a.x < b.x || (a.x == b.x && a.y < b.y);
+        });
+        if (points.size() < 3)
+            return points;
+        std::vector<Point> hull(2 * points.size());
+        size_t k = 0;
+        for (size_t i = 0; i < points.size(); i++) {
+            while (k >= 2 && cross(hull[k - 2], hull[k - 1], points[i]) <= 0)
+                k--;
+            hull[k++] = points[i];
+        }
+        for (size_t i = points.size() - 1, t = k + 1; i > 0; i--) {
+            while (k >= t && cross(hull[k - 2], hull[k - 1], points[i - 1]) <= 0)
+                k--;
+            hull[k++] = points[i - 1];
+        }
+        hull.resize(k - 1);
+        return hull;
+    }
+
+    // repeatedly replace the edge whose removal adds the least area by the meeting point of its
+    // neighbouring edges, the outline only grows so no opaque texel is cut off
+    static void reduce(std::vector<Point>& poly, int width, int height) {
+        while ((int)poly.size() > PART_MESH_VERTS) {
+            size_t n = poly.size();
+            double bestArea = -1.0;
+            size_t best = 0;
+            Point bestPoint = {0.0, 0.0};
+            for (size_t i = 0; i < n; i++) {
+                const Point& a = poly[(i + n - 1) % n];
+                const Point& b = poly[i];
+                const Point& c = poly[(i + 1) % n];
+                const Point& d = poly[(i + 2) % n];
+                // lines a-b and d-c must meet beyond b and c
+                double denom = (b.x - a.x) * (c.y - d.y) - (b.y - a.y) * (c.x - d.x);
+                if (std::fabs(denom) < 1e-12)
+                    continue;
+                double t = ((c.x - a.x) * (c.y - d.y) - (c.y - a.y) * (c.x - d.x)) / denom;
+                double s = -((b.x - a.x) * (d.y - a.y) - (b.y - a.y) * (d.x - a.x)) / denom;
+                if (t < 1.0 || s < 1.0)
+                    continue;
+                Point meet = {a.x + t * (b.x - a.x), a.y + t * (b.y - a.y)};
+                if (meet.x < 0.0 || meet.y < 0.0 || meet.x > width || meet.y > height)
+                    continue;
+                double added = std::fabs(cross(b, meet, c)) / 2;
+                if (bestArea < 0.0 || added < bestArea) {
+                    bestArea = added;
+                    best = i;
+                    bestPoint = meet;
+                }
+            }
+            if (bestArea < 0.0)
+                return;
+            poly[best] = bestPoint;
+            poly.erase(poly.begin() + (best + 1) % n);
+        }
+    }
+
+    bool readCache(const std::string& path, const std::vector<std::string>& keys) {
+        std::ifstream file(path);
+        if (!file.is_open())
+            return false;
+        std::string magic;
+        int parts, verts;
+        if (!(file >> magic >> parts >> verts) || magic != "PARTMESH" ||
+            parts != (int)keys.size() || verts != PART_MESH_VERTS)
+            return false;
+        for (int p = 0; p < parts; p++) {
+            std::string key;
+            if (!(file >> key >> meshCoverage[p] >> opaqueCoverage[p]) || key != keys[p])
+                return false;
+            for (int v = 0; v < 2 * PART_MESH_VERTS; v++) {
+                if (!(file >> vertices[p * PART_MESH_VERTS * 2 + v]))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    void writeCache(const std::string& path, const std::vector<std::string>& keys) const {
+        std::ofstream file(path);
+        if (!file.is_open()) {
+            std::cout << "ERROR::PARTMESH::CACHE_NOT_WRITTEN " << path << std::endl;
+            return;
+        }
+        file.precision(9);
+        file << "PARTMESH " << keys.size() << " " << PART_MESH_VERTS << "\n";
+        for (size_t p = 0; p < keys.size(); p++) {
+            file << keys[p] << " " << meshCoverage[p] << " " << opaqueCoverage[p];
+            for (int v = 0; v < 2 * PART_MESH_VERTS; v++)
+                file << " " << vertices[p * PART_MESH_VERTS * 2 + v];
+            file << "\n";
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,326 @@
+// offline pose index tool
+//      poseindex.bin build <keypoints.txt> <index.idx>     build an index from recorded keypoints
+//      poseindex.bin eval <index.idx> [queries]            recall and latency against brute force
+//
+// keypoint files hold one pose per line: clip frame x0 y0 c0 ... x24 y24 c24
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "poseindex.h"
+
+
+const uint32_t INDEX_M = 16;
+const uint32_t INDEX_M0 = 32;
+const uint32_t EF_CONSTRUCTION = 128;
+const unsigned int EVAL_K = 10;
+
+
+class PoseIndexBuilder {
+public:
+    PoseIndexBuilder() : entry(-1), maxLevel(0), mL(1.0 / log((double)INDEX_M)), rng(42), visitMark(0) {}
+
+    void add(const int8_t* descriptor, uint32_t clip, uint32_t frame) {
+        descriptors.insert(descriptors.end(), descriptor, descriptor + POSE_INDEX_DIMS);
+        labels.push_back(clip);
+        labels.push_back(frame);
+    }
+
+    uint32_t count() const {
+        return labels.size() / 2;
+    }
+
+    void build() {
+        links.assign(count(), std::vector<std::vector<uint32_t>>());
+        visited.assign(count(), 0);
+        for (uint32_t i = 0; i < count(); i++) {
+            insert(i);
+            if ((i + 1) % 50000 == 0)
+                std::cout << "inserted " << i + 1 << " / " << count() << std::endl;
+        }
+    }
+
+    bool write(const std::string& path) const {
+        std::ofstream file(path, std::ios::binary);
+        if (!file) {
+            std::cout << "Cannot write " << path << std::endl;
+            return false;
+        }
+
+        PoseIndexHeader header;
+        memcpy(header.magic, "MPIX", 4);
+        header.count = count();
+        header.m0 = INDEX_M0;
+        header.m = INDEX_M;
+        header.maxLevel = maxLevel;
+        header.entry = entry < 0 ? 0 : entry;
+
+        std::vector<int32_t> links0((size_t)count() * INDEX_M0, -1);
+        std::vector<uint32_t> upperOffset(count()), levels(count());
+        std::vector<int32_t> upperLinks;
+        for (uint32_t i = 0; i < count(); i++) {
+            for (size_t n = 0; n < links[i][0].size(); n++)
+                links0[(size_t)i * INDEX_M0 + n] = links[i][0][n];
+            levels[i] = links[i].size() - 1;
+            upperOffset[i] = upperLinks.size() / INDEX_M;
+            for (size_t l = 1; l < links[i].size(); l++) {
+                size_t start = upperLinks.size();
+                upperLinks.resize(start + INDEX_M, -1);
+                for (size_t n = 0; n < links[i][l].size(); n++)
+                    upperLinks[start + n] = links[i][l][n];
+            }
+        }
+        header.upperLists = upperLinks.size() / INDEX_M;
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(descriptors.data()), descriptors.size());
+        file.write(reinterpret_cast<const char*>(labels.data()), labels.size() * sizeof(uint32_t));
+        file.write(reinterpret_cast<const char*>(links0.data()), links0.size() * sizeof(int32_t));
+        file.write(reinterpret_cast<const char*>(upperOffset.data()), upperOffset.size() * sizeof(uint32_t));
+        file.write(reinterpret_cast<const char*>(levels.data()), levels.size() * sizeof(uint32_t));
+        file.write(reinterpret_cast<const char*>(upperLinks.data()), upperLinks.size() * sizeof(int32_t));
+        return (bool)file;
+    }
+
+private:
+    typedef std::pair<int32_t, uint32_t> Candidate;
+
+    std::vector<int8_t> descriptors;
+    std::vector<uint32_t> labels;
+    // neighbors of every node on every level it lives on
+    std::vector<std::vector<std::vector<uint32_t>>> links;
+    int64_t entry;
+    uint32_t maxLevel;
+    double mL;
+    std::mt19937 rng;
+    // visited stamps of the current level search
+    mutable std::vector<uint32_t> visited;
+    mutable uint32_t visitMark;
+
+    const int8_t* descriptor(uint32_t i) const {
+        return descriptors.data() + (size_t)i * POSE_INDEX_DIMS;
+    }
+
+    int32_t distance(uint32_t a, uint32_t b) const {
+        return descriptorDistance(descriptor(a), descriptor(b));
+    }
+
+    void insert(uint32_t node) {
+        std::uniform_real_distribution<double> uniform(1e-9, 1.0);
+        uint32_t level = (uint32_t)floor(-log(uniform(rng)) * mL);
+        links[node].resize(level + 1);
+        if (entry < 0) {
+            entry = node;
+            maxLevel = level;
+            return;
+        }
+
+        uint32_t current = entry;
+        for (uint32_t l = maxLevel; l > level; l--)
+            current = greedy(node, current, l);
+
+        for (int l = std::min(level, maxLevel); l >= 0; l--) {
+            std::vector<Candidate> found = searchLevel(node, current, EF_CONSTRUCTION, l);
+            uint32_t cap = l == 0 ? INDEX_M0 : INDEX_M;
+            links[node][l] = selectNeighbors(found, INDEX_M);
+            for (size_t n = 0; n < links[node][l].size(); n++) {
+                std::vector<uint32_t>& back = links[links[node][l][n]][l];
+                back.push_back(node);
+                if (back.size() > cap)
+                    shrink(links[node][l][n], back, cap);
+            }
+            current = found.front().second;
+        }
+
+        if (level > maxLevel) {
+            entry = node;
+            maxLevel = level;
+        }
+    }
+
+    uint32_t greedy(uint32_t node, uint32_t current, uint32_t level) const {
+        int32_t currentDist = distance(node, current);
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            const std::vector<uint32_t>& neighbors = links[current][level];
+            for (size_t i = 0; i < neighbors.size(); i++) {
+                int32_t d = distance(node, neighbors[i]);
+                if (d < currentDist) {
+                    currentDist = d;
+                    current = neighbors[i];
+                    changed = true;
+                }
+            }
+        }
+        return current;
+    }
+
+    // ef closest nodes on a level, sorted by distance
+    std::vector<Candidate> searchLevel(uint32_t node, uint32_t start, uint32_t ef, uint32_t level) const {
+        visitMark++;
+        std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> candidates;
+        std::priority_queue<Candidate> best;
+        int32_t d = distance(node, start);
+        candidates.push(Candidate(d, start));
+        best.push(Candidate(d, start));
+        visited[start] = visitMark;
+        while (!candidates.empty()) {
+            Candidate c = candidates.top();
+            if (c.first > best.top().first && best.size() >= ef)
+                break;
+            candidates.pop();
+            const std::vector<uint32_t>& neighbors = links[c.second][level];
+            for (size_t i = 0; i < neighbors.size(); i++) {
+                if (visited[neighbors[i]] == visitMark)
+                    continue;
+                visited[neighbors[i]] = visitMark;
+                d = distance(node, neighbors[i]);
+                if (best.size() < ef || d < best.top().first) {
+                    candidates.push(Candidate(d, neighbors[i]));
+                    best.push(Candidate(d, neighbors[i]));
+                    if (best.size() > ef)
+                        best.pop();
+                }
+            }
+        }
+        std::vector<Candidate> result;
+        while (!best.empty()) {
+            result.push_back(best.top());
+            best.pop();
+        }
+        std::reverse(result.begin(), result.end());
+        return result;
+    }
+
+    // prefer candidates that are closer to the node than to any already selected neighbor,
+    // which spreads the links over different directions
+    std::vector<uint32_t> selectNeighbors(const std::vector<Candidate>& sorted, uint32_t m) const {
+        std::vector<uint32_t> selected;
+        for (size_t i = 0; i < sorted.size() && selected.size() < m; i++) {
+            bool keep = true;
+            for (size_t s = 0; s < selected.size() && keep; s++)
+                keep = distance(sorted[i].second, selected[s]) > sorted[i].first;
+            if (keep)
+                selected.push_back(sorted[i].second);
+        }
+        // fill up with the closest pruned candidates so the graph stays connected
+        for (size_t i = 0; i < sorted.size() && selected.size() < m; i++) {
+            if (std::find(selected.begin(), selected.end(), sorted[i].second) == selected.end())
+                selected.push_back(sorted[i].second);
+        }
+        return selected;
+    }
+
+    void shrink(uint32_t node, std::vector<uint32_t>& neighbors, uint32_t cap) const {
+        std::vector<Candidate> sorted;
+        for (size_t i = 0; i < neighbors.size(); i++)
+            sorted.push_back(Candidate(distance(node, neighbors[i]), neighbors[i]));
+        std::sort(sorted.begin(), sorted.end());
+        neighbors = selectNeighbors(sorted, cap);
+    }
+};
+
+
+int build(const std::string& input, const std::string& output) {
+    std::ifstream file(input);
+    if (!file) {
+        std::cout << "Cannot read " << input << std::endl;
+        return -1;
+    }
+
+    PoseIndexBuilder builder;
+    std::string line;
+    float keypoints[25 * 3];
+    int8_t descriptor[POSE_INDEX_DIMS];
+    while (std::getline(file, line)) {
+        std::istringstream values(line);
+        uint32_t clip, frame;
+        if (!(values >> clip >> frame))
+            continue;
+        for (int i = 0; i < 25 * 3; i++)
+            values >> keypoints[i];
+        float cx, cy, scale;
+        if (values && poseDescriptor(keypoints, descriptor, cx, cy, scale))
+            builder.add(descriptor, clip, frame);
+    }
+    std::cout << "building index of " << builder.count() << " poses" << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    builder.build();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "built in " << elapsed.count() << " s" << std::endl;
+    return builder.write(output) ? 0 : -1;
+}
+
+int eval(const std::string& path, unsigned int queries) {
+    PoseIndex index;
+    if (!index.open(path))
+        return -1;
+    if (index.count() == 0 || queries == 0) {
+        std::cout << "Cannot evaluate " << path << " with " << index.count() << " poses and " << queries
+                  << " queries" << std::endl;
+        return -1;
+    }
+
+    // stored poses with quantization-scale noise as queries
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<uint32_t> pick(0, index.count() - 1);
+    std::uniform_int_distribution<int> noise(-6, 6);
+    std::vector<int8_t> queryDescriptors((size_t)queries * POSE_INDEX_DIMS);
+    for (unsigned int q = 0; q < queries; q++) {
+        const int8_t* d = index.descriptor(pick(rng));
+        for (int i = 0; i < 2 * POSE_INDEX_JOINTS; i++)
+            queryDescriptors[q * POSE_INDEX_DIMS + i] = (int8_t)std::max(-127, std::min(127, d[i] + noise(rng)));
+    }
+
+    std::vector<std::vector<std::pair<int32_t, uint32_t>>> truth(queries);
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int q = 0; q < queries; q++)
+        truth[q] = index.bruteForce(&queryDescriptors[q * POSE_INDEX_DIMS], EVAL_K);
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << index.count() << " poses, " << queries << " queries, k = " << EVAL_K << std::endl;
+    std::cout << "method\trecall\tus/query" << std::endl;
+    std::cout << "brute\t1\t" << elapsed.count() / queries << std::endl;
+
+    unsigned int efs[] = {10, 16, 32, 64, 128, 256};
+    for (unsigned int ef : efs) {
+        unsigned int hits = 0;
+        std::vector<std::vector<std::pair<int32_t, uint32_t>>> found(queries);
+        start = std::chrono::steady_clock::now();
+        for (unsigned int q = 0; q < queries; q++)
+            found[q] = index.search(&queryDescriptors[q * POSE_INDEX_DIMS], EVAL_K, ef);
+        elapsed = std::chrono::steady_clock::now() - start;
+
+        // a result counts when it is no farther than the k-th true neighbor, ties are equal
+        for (unsigned int q = 0; q < queries; q++) {
+            int32_t kth = truth[q].back().first;
+            for (size_t i = 0; i < found[q].size(); i++)
+                hits += found[q][i].first <= kth;
+        }
+        std::cout << "hnsw ef=" << ef << "\t" << hits / (double)(queries * EVAL_K) << "\t"
+                  << elapsed.count() / queries << std::endl;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    std::string command = argc > 1 ? argv[1] : "";
+    if (command == "build" && argc == 4)
+        return build(argv[2], argv[3]);
+    if (command == "eval" && argc >= 3)
+        return eval(argv[2], argc > 3 ? atoi(argv[3]) : 1000);
+
+    std::cout << "usage: " << argv[0] << " build <keypoints.txt> <index.idx>" << std::endl;
+    std::cout << "       " << argv[0] << " eval <index.idx> [queries]" << std::endl;
+    return -1;
+}
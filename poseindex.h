@@ -0,0 +1,357 @@
+#ifndef POSEINDEX
+#define POSEINDEX
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <math.h>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+// body joints in a pose descriptor (BODY_25 0-14)
+const int POSE_INDEX_JOINTS = 15;
+// descriptor dimension, x and y of each joint padded to 32 bytes
+const int POSE_INDEX_DIMS = 32;
+// normalized coordinates in [-POSE_INDEX_RANGE, POSE_INDEX_RANGE] map to int8
+const float POSE_INDEX_RANGE = 3.0f;
+
+// quantized pose descriptor: detected joints relative to their centroid, divided by their
+// RMS distance to it, so the descriptor is invariant to translation and scale
+// undetected joints sit on the centroid; false if fewer than 3 joints are detected
+inline bool poseDescriptor(const float* keypoints, int8_t* descriptor, float& cx, float& cy, float& scale) {
+    int found = 0;
+    cx = cy = 0.0f;
+    for (int j = 0; j < POSE_INDEX_JOINTS; j++) {
+        if (keypoints[j * 3 + 2] == 0)
+            continue;
+        cx += keypoints[j * 3];
+        cy += keypoints[j * 3 + 1];
+        found++;
+    }
+    if (found < 3)
+        return false;
+    cx /= found;
+    cy /= found;
+
+    float sum = 0.0f;
+    for (int j = 0; j < POSE_INDEX_JOINTS; j++) {
+        if (keypoints[j * 3 + 2] == 0)
+            continue;
+        float dx = keypoints[j * 3] - cx, dy = keypoints[j * 3 + 1] - cy;
+        sum += dx * dx + dy * dy;
+    }
+    scale = sqrtf(sum / found);
+    if (scale <= 0.0f)
+        return false;
+
+    memset(descriptor, 0, POSE_INDEX_DIMS);
+    for (int j = 0; j < POSE_INDEX_JOINTS; j++) {
+        if (keypoints[j * 3 + 2] == 0)
+            continue;
+        for (int c = 0; c < 2; c++) {
+            float v = (keypoints[j * 3 + c] - (c == 0 ? cx : cy)) / scale * (127.0f / POSE_INDEX_RANGE);
+            descriptor[2 * j + c] = (int8_t)std::max(-127.0f, std::min(127.0f, roundf(v)));
+        }
+    }
+    return true;
+}
+
+// normalized joint coordinates of a descriptor
+inline void poseFromDescriptor(const int8_t* descriptor, float* joints) {
+    for (int d = 0; d < 2 * POSE_INDEX_JOINTS; d++)
+        joints[d] = descriptor[d] * (POSE_INDEX_RANGE / 127.0f);
+}
+
+// squared L2 distance of two 32 byte descriptors
+inline int32_t descriptorDistance(const int8_t* a, const int8_t* b) {
+#if defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128();
+    for (int i = 0; i < POSE_INDEX_DIMS; i += 16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        // sign extend to 16 bits, subtract, multiply-add pairs into 32 bits
+        __m128i lo = _mm_sub_epi16(_mm_srai_epi16(_mm_unpacklo_epi8(va, va), 8),
+                                   _mm_srai_epi16(_mm_unpacklo_epi8(vb, vb), 8));
+        __m128i hi = _mm_sub_epi16(_mm_srai_epi16(_mm_unpackhi_epi8(va, va), 8),
+                                   _mm_srai_epi16(_mm_unpackhi_epi8(vb, vb), 8));
+        acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(acc);
+#else
+    int32_t sum = 0;
+    for (int i = 0; i < POSE_INDEX_DIMS; i++)
+        sum += (a[i] - b[i]) * (a[i] - b[i]);
+    return sum;
+#endif
+}
+
+
+// on-disk layout, every section 4 byte aligned
+//      PoseIndexHeader
+//      int8    descriptors[count][POSE_INDEX_DIMS]
+//      uint32  labels[count][2]            clip and frame of each pose
+//      int32   links0[count][m0]           level 0 neighbors, -1 padded
+//      uint32  upperOffset[count]          first upper level list of each node
+//      uint32  levels[count]               number of levels above 0 of each node
+//      int32   upperLinks[upperLists][m]   neighbors on levels 1 and up, -1 padded
+struct PoseIndexHeader {
+    char magic[4];
+    uint32_t count, m0, m, maxLevel, entry, upperLists;
+};
+
+// hierarchical navigable small world graph over pose descriptors, memory-mapped read-only
+// built offline by poseindex.bin
+class PoseIndex {
+public:
+    PoseIndex() : data(nullptr), size(0) {}
+
+    ~PoseIndex() {
+        close();
+    }
+
+    bool open(const std::string& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(PoseIndexHeader)) {
+            std::cout << "ERROR::POSEINDEX::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+            if (fd >= 0)
+                ::close(fd);
+            return false;
+        }
+        size = st.st_size;
+        data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            data = nullptr;
+            std::cout << "ERROR::POSEINDEX::MMAP_FAILED " << path << std::endl;
+            return false;
+        }
+
+        // the magic first, then every section against what is left of the file, so the counts
+        // of a foreign or truncated file are never used to address past its end
+        header = static_cast<const PoseIndexHeader*>(data);
+        size_t offset = sizeof(PoseIndexHeader);
+        if (memcmp(header->magic, "MPIX", 4) != 0 ||
+            !section(offset, header->count, POSE_INDEX_DIMS) ||
+            !section(offset, header->count, 2 * sizeof(uint32_t)) ||
+            !section(offset, header->count, (uint64_t)header->m0 * sizeof(int32_t)) ||
+            !section(offset, header->count, sizeof(uint32_t)) ||
+            !section(offset, header->count, sizeof(uint32_t)) ||
+            !section(offset, header->upperLists, (uint64_t)header->m * sizeof(int32_t)) ||
+            (header->count > 0 && header->entry >= header->count)) {
+            std::cout << "ERROR::POSEINDEX::INVALID_INDEX " << path << std::endl;
+            close();
+            return false;
+        }
+
+        const char* p = static_cast<const char*>(data) + sizeof(PoseIndexHeader);
+        descriptors = reinterpret_cast<const int8_t*>(p);
+        p += (size_t)header->count * POSE_INDEX_DIMS;
+        labels = reinterpret_cast<const uint32_t*>(p);
+        p += (size_t)header->count * 2 * sizeof(uint32_t);
+        links0 = reinterpret_cast<const int32_t*>(p);
+        p += (size_t)header->count * header->m0 * sizeof(int32_t);
+        upperOffset = reinterpret_cast<const uint32_t*>(p);
+        p += (size_t)header->count * sizeof(uint32_t);
+        levels = reinterpret_cast<const uint32_t*>(p);
+        p += (size_t)header->count * sizeof(uint32_t);
+        upperLinks = reinterpret_cast<const int32_t*>(p);
+
+        if (!validGraph()) {
+            std::cout << "ERROR::POSEINDEX::INVALID_GRAPH " << path << std::endl;
+            close();
+            return false;
+        }
+        visited.assign(header->count, 0);
+        visitMark = 0;
+        return true;
+    }
+
+    void close() {
+        if (data != nullptr)
+            munmap(data, size);
+        data = nullptr;
+        size = 0;
+    }
+
+    bool isOpen() const {
+        return data != nullptr;
+    }
+
+    uint32_t count() const {
+        return header->count;
+    }
+
+    const int8_t* descriptor(uint32_t i) const {
+        return descriptors + (size_t)i * POSE_INDEX_DIMS;
+    }
+
+    uint32_t clip(uint32_t i) const {
+        return labels[2 * i];
+    }
+
+    uint32_t frame(uint32_t i) const {
+        return labels[2 * i + 1];
+    }
+
+    // approximate k nearest neighbors, ef is the level 0 beam width
+    // results are (distance, pose) sorted by distance
+    std::vector<std::pair<int32_t, uint32_t>> search(const int8_t* query, unsigned int k, unsigned int ef = 64) {
+        std::vector<std::pair<int32_t, uint32_t>> result;
+        if (!isOpen() || header->count == 0)
+            return result;
+
+        // greedy descent through the upper levels
+        uint32_t current = header->entry;
+        int32_t currentDist = descriptorDistance(query, descriptor(current));
+        for (int level = header->maxLevel; level > 0; level--) {
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                const int32_t* links = upperList(current, level);
+                for (uint32_t i = 0; links != nullptr && i < header->m && links[i] >= 0; i++) {
+                    int32_t d = descriptorDistance(query, descriptor(links[i]));
+                    if (d < currentDist) {
+                        currentDist = d;
+                        current = links[i];
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        // beam search on level 0
+        ef = std::max(ef, k);
+        nextVisitMark();
+        typedef std::pair<int32_t, uint32_t> Candidate;
+        std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> candidates;
+        std::priority_queue<Candidate> best;
+        candidates.push(Candidate(currentDist, current));
+        best.push(Candidate(currentDist, current));
+        visited[current] = visitMark;
+        while (!candidates.empty()) {
+            Candidate c = candidates.top();
+            if (c.first > best.top().first && best.size() >= ef)
+                break;
+            candidates.pop();
+            const int32_t* links = links0 + (size_t)c.second * header->m0;
+            for (uint32_t i = 0; i < header->m0 && links[i] >= 0; i++) {
+                uint32_t n = links[i];
+                if (visited[n] == visitMark)
+                    continue;
+                visited[n] = visitMark;
+                int32_t d = descriptorDistance(query, descriptor(n));
+                if (best.size() < ef || d < best.top().first) {
+                    candidates.push(Candidate(d, n));
+                    best.push(Candidate(d, n));
+                    if (best.size() > ef)
+                        best.pop();
+                }
+            }
+        }
+
+        while (!best.empty()) {
+            result.push_back(best.top());
+            best.pop();
+        }
+        std::reverse(result.begin(), result.end());
+        if (result.size() > k)
+            result.resize(k);
+        return result;
+    }
+
+    // exact k nearest neighbors by linear scan, the baseline for recall and latency
+    std::vector<std::pair<int32_t, uint32_t>> bruteForce(const int8_t* query, unsigned int k) const {
+        typedef std::pair<int32_t, uint32_t> Candidate;
+        std::priority_queue<Candidate> best;
+        for (uint32_t i = 0; i < header->count; i++) {
+            int32_t d = descriptorDistance(query, descriptor(i));
+            if (best.size() < k || d < best.top().first) {
+                best.push(Candidate(d, i));
+                if (best.size() > k)
+                    best.pop();
+            }
+        }
+        std::vector<Candidate> result;
+        while (!best.empty()) {
+            result.push_back(best.top());
+            best.pop();
+        }
+        std::reverse(result.begin(), result.end());
+        return result;
+    }
+
+private:
+    void* data;
+    size_t size;
+    const PoseIndexHeader* header;
+    const int8_t* descriptors;
+    const uint32_t* labels;
+    const int32_t* links0;
+    const uint32_t* upperOffset;
+    const uint32_t* levels;
+    const int32_t* upperLinks;
+
+    // visited stamps of the current search
+    std::vector<uint32_t> visited;
+    uint32_t visitMark;
+
+    // step offset over a section of rows * rowBytes bytes, false if it runs past the end of the file;
+    // compared by division, so a corrupt count cannot wrap the section size around
+    bool section(size_t& offset, uint64_t rows, uint64_t rowBytes) const {
+        if (rowBytes != 0 && rows > (size - offset) / rowBytes)
+            return false;
+        offset += rows * rowBytes;
+        return true;
+    }
+
+    // every neighbor a pose or -1 padding and every upper level list inside the upper links,
+    // checked once here so the searches can follow the links unchecked
+    bool validGraph() const {
+        for (uint64_t i = 0; i < (uint64_t)header->count * header->m0; i++) {
+            if (links0[i] < -1 || links0[i] >= (int64_t)header->count)
+                return false;
+        }
+        for (uint64_t i = 0; i < (uint64_t)header->upperLists * header->m; i++) {
+            if (upperLinks[i] < -1 || upperLinks[i] >= (int64_t)header->count)
+                return false;
+        }
+        for (uint32_t i = 0; i < header->count; i++) {
+            if (levels[i] > header->maxLevel || (uint64_t)upperOffset[i] + levels[i] > header->upperLists)
+                return false;
+        }
+        return true;
+    }
+
+    const int32_t* upperList(uint32_t node, int level) const {
+        if ((uint32_t)level > levels[node])
+            return nullptr;
+        return upperLinks + (size_t)(upperOffset[node] + level - 1) * header->m;
+    }
+
+    void nextVisitMark() {
+        if (++visitMark == 0) {
+            std::fill(visited.begin(), visited.end(), 0);
+            visitMark = 1;
+        }
+    }
+};
+
+#endif
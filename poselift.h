@@ -0,0 +1,249 @@
+#ifndef POSELIFT
+#define POSELIFT
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <math.h>
+#include <string>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+const int LIFT_JOINTS = 25;
+// camera distance in torso lengths, used for perspective scaling of limbs
+const float LIFT_CAMERA_DISTANCE = 4.0f;
+// widest layer a model file may hold
+const int LIFT_MAX_WIDTH = 4096;
+
+// 2D to 3D pose lifting with a small fully-connected network
+// input is the 25 body keypoints relative to the mid hip and divided by the torso length,
+// output the 25 joint depths in the same units, positive away from the camera
+//
+// model file layout (little endian):
+//      char[4] "MPLF", int32 layer count
+//      per layer: int32 outputs, int32 inputs, float weights[outputs][inputs], float bias[outputs]
+// all layers but the last use ReLU
+class PoseLifter {
+public:
+    bool load(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        char magic[4];
+        int32_t count = 0;
+        if (!file.read(magic, 4) || std::string(magic, 4) != "MPLF" ||
+            !file.read(reinterpret_cast<char*>(&count), sizeof(count)) || count <= 0) {
+            std::cout << "ERROR::POSELIFT::INVALID_MODEL " << path << std::endl;
+            return false;
+        }
+
+        layers.clear();
+        for (int32_t l = 0; l < count; l++) {
+            int32_t dims[2];
+            if (!file.read(reinterpret_cast<char*>(dims), sizeof(dims))) {
+                std::cout << "ERROR::POSELIFT::TRUNCATED_MODEL " << path << std::endl;
+                layers.clear();
+                return false;
+            }
+            // each layer takes the outputs of the one before, the first the normalized keypoints
+            const int32_t expected = l == 0 ? 2 * LIFT_JOINTS : layers.back().outputs;
+            if (dims[0] <= 0 || dims[0] > LIFT_MAX_WIDTH || dims[1] != expected) {
+                std::cout << "ERROR::POSELIFT::UNEXPECTED_SHAPE " << path << " layer " << l << " "
+                          << dims[0] << "x" << dims[1] << std::endl;
+                layers.clear();
+                return false;
+            }
+            std::vector<float> weights(dims[0] * dims[1]), bias(dims[0]);
+            file.read(reinterpret_cast<char*>(weights.data()), weights.size() * sizeof(float));
+            file.read(reinterpret_cast<char*>(bias.data()), bias.size() * sizeof(float));
+            if (!file) {
+                std::cout << "ERROR::POSELIFT::TRUNCATED_MODEL " << path << std::endl;
+                layers.clear();
+                return false;
+            }
+            addLayer(dims[0], dims[1], weights.data(), bias.data());
+        }
+        if (layers.back().outputs != LIFT_JOINTS) {
+            std::cout << "ERROR::POSELIFT::UNEXPECTED_SHAPE " << path << std::endl;
+            layers.clear();
+            return false;
+        }
+        return true;
+    }
+
+    // random weights of the default shape, for benchmarking
+    void randomInit(int hidden = 256) {
+        layers.clear();
+        int shape[4] = {2 * LIFT_JOINTS, hidden, hidden, LIFT_JOINTS};
+        for (int l = 0; l < 3; l++) {
+            std::vector<float> weights(shape[l + 1] * shape[l]), bias(shape[l + 1], 0.0f);
+            for (size_t i = 0; i < weights.size(); i++)
+                weights[i] = (rand() / (float)RAND_MAX - 0.5f) / sqrtf((float)shape[l]);
+            addLayer(shape[l + 1], shape[l], weights.data(), bias.data());
+        }
+    }
+
+    bool enabled() const {
+        return !layers.empty();
+    }
+
+    // multiply-adds per person
+    long macs() const {
+        long total = 0;
+        for (size_t l = 0; l < layers.size(); l++)
+            total += (long)layers[l].outputs * layers[l].inputs;
+        return total;
+    }
+
+    // joint depths in pixels relative to the mid hip for 25 keypoints (x, y, conf)
+    // and the torso length used for normalization; false if the torso is not visible
+    bool lift(const float* keypoints, float* depth, float& torso) {
+        const float* neck = keypoints + 1 * 3;
+        const float* hip = keypoints + 8 * 3;
+        if (neck[2] == 0 || hip[2] == 0)
+            return false;
+        torso = sqrtf((neck[0] - hip[0]) * (neck[0] - hip[0]) + (neck[1] - hip[1]) * (neck[1] - hip[1]));
+        if (torso <= 0.0f)
+            return false;
+
+        // missing joints are fed as zero, the network is trained with dropped joints
+        input.assign(2 * LIFT_JOINTS, 0.0f);
+        for (int j = 0; j < LIFT_JOINTS; j++) {
+            if (keypoints[j * 3 + 2] == 0)
+                continue;
+            input[2 * j] = (keypoints[j * 3] - hip[0]) / torso;
+            input[2 * j + 1] = (keypoints[j * 3 + 1] - hip[1]) / torso;
+        }
+
+        const float* x = input.data();
+        for (size_t l = 0; l < layers.size(); l++) {
+            const Layer& layer = layers[l];
+            std::vector<float>& y = (l % 2 == 0) ? hiddenA : hiddenB;
+            y.resize(layer.rowsPadded);
+            gemv(layer.weights.data(), layer.bias.data(), layer.rowsPadded, layer.inputs,
+                 x, y.data(), l + 1 < layers.size());
+            x = y.data();
+        }
+        for (int j = 0; j < LIFT_JOINTS; j++)
+            depth[j] = x[j] * torso;
+        return true;
+    }
+
+    // y = W x + b with W stored column-major and rows padded to the SIMD width,
+    // so every input broadcasts over a contiguous column and no horizontal sums are needed
+    static void gemv(const float* w, const float* bias, int rows, int cols,
+                     const float* x, float* y, bool relu) {
+        int r = 0;
+#if defined(__AVX__)
+        const __m256 zero = _mm256_setzero_ps();
+        for (; r + 32 <= rows; r += 32) {
+            __m256 acc0 = _mm256_loadu_ps(bias + r);
+            __m256 acc1 = _mm256_loadu_ps(bias + r + 8);
+            __m256 acc2 = _mm256_loadu_ps(bias + r + 16);
+            __m256 acc3 = _mm256_loadu_ps(bias + r + 24);
+            for (int c = 0; c < cols; c++) {
+                const float* col = w + (size_t)c * rows + r;
+                __m256 xc = _mm256_set1_ps(x[c]);
+                acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(col), xc));
+                acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(col + 8), xc));
+                acc2 = _mm256_add_ps(acc2, _mm256_mul_ps(_mm256_loadu_ps(col + 16), xc));
+                acc3 = _mm256_add_ps(acc3, _mm256_mul_ps(_mm256_loadu_ps(col + 24), xc));
+            }
+            if (relu) {
+                acc0 = _mm256_max_ps(acc0, zero);
+                acc1 = _mm256_max_ps(acc1, zero);
+                acc2 = _mm256_max_ps(acc2, zero);
+                acc3 = _mm256_max_ps(acc3, zero);
+            }
+            _mm256_storeu_ps(y + r, acc0);
+            _mm256_storeu_ps(y + r + 8, acc1);
+            _mm256_storeu_ps(y + r + 16, acc2);
+            _mm256_storeu_ps(y + r + 24, acc3);
+        }
+        for (; r + 8 <= rows; r += 8) {
+            __m256 acc = _mm256_loadu_ps(bias + r);
+            for (int c = 0; c < cols; c++)
+                acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(w + (size_t)c * rows + r),
+                                                       _mm256_set1_ps(x[c])));
+            if (relu)
+                acc = _mm256_max_ps(acc, zero);
+            _mm256_storeu_ps(y + r, acc);
+        }
+#elif defined(__SSE2__)
+        const __m128 zero = _mm_setzero_ps();
+        for (; r + 16 <= rows; r += 16) {
+            __m128 acc0 = _mm_loadu_ps(bias + r);
+            __m128 acc1 = _mm_loadu_ps(bias + r + 4);
+            __m128 acc2 = _mm_loadu_ps(bias + r + 8);
+            __m128 acc3 = _mm_loadu_ps(bias + r + 12);
+            for (int c = 0; c < cols; c++) {
+                const float* col = w + (size_t)c * rows + r;
+                __m128 xc = _mm_set1_ps(x[c]);
+                acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(col), xc));
+                acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(col + 4), xc));
+                acc2 = _mm_add_ps(acc2, _mm_mul_ps(_mm_loadu_ps(col + 8), xc));
+                acc3 = _mm_add_ps(acc3, _mm_mul_ps(_mm_loadu_ps(col + 12), xc));
+            }
+            if (relu) {
+                acc0 = _mm_max_ps(acc0, zero);
+                acc1 = _mm_max_ps(acc1, zero);
+                acc2 = _mm_max_ps(acc2, zero);
+                acc3 = _mm_max_ps(acc3, zero);
+            }
+            _mm_storeu_ps(y + r, acc0);
+            _mm_storeu_ps(y + r + 4, acc1);
+            _mm_storeu_ps(y + r + 8, acc2);
+            _mm_storeu_ps(y + r + 12, acc3);
+        }
+        for (; r + 4 <= rows; r += 4) {
+            __m128 acc = _mm_loadu_ps(bias + r);
+            for (int c = 0; c < cols; c++)
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(w + (size_t)c * rows + r),
+                                                 _mm_set1_ps(x[c])));
+            if (relu)
+                acc = _mm_max_ps(acc, zero);
+            _mm_storeu_ps(y + r, acc);
+        }
+#endif
+        // remainder
+        for (; r < rows; r++) {
+            float acc = bias[r];
+            for (int c = 0; c < cols; c++)
+                acc += w[(size_t)c * rows + r] * x[c];
+            y[r] = (relu && acc < 0.0f) ? 0.0f : acc;
+        }
+    }
+
+private:
+    struct Layer {
+        int outputs, inputs, rowsPadded;
+        std::vector<float> weights;     // column-major, rowsPadded x inputs
+        std::vector<float> bias;        // rowsPadded
+    };
+
+    std::vector<Layer> layers;
+    std::vector<float> input, hiddenA, hiddenB;
+
+    // transpose row-major weights into padded column-major storage
+    void addLayer(int outputs, int inputs, const float* weights, const float* bias) {
+        Layer layer;
+        layer.outputs = outputs;
+        layer.inputs = inputs;
+        layer.rowsPadded = (outputs + 7) / 8 * 8;
+        layer.weights.assign((size_t)layer.rowsPadded * inputs, 0.0f);
+        layer.bias.assign(layer.rowsPadded, 0.0f);
+        for (int r = 0; r < outputs; r++) {
+            for (int c = 0; c < inputs; c++)
+                layer.weights[(size_t)c * layer.rowsPadded + r] = weights[(size_t)r * inputs + c];
+            layer.bias[r] = bias[r];
+        }
+        layers.push_back(layer);
+    }
+};
+
+#endif
@@ -0,0 +1,313 @@
+#ifndef POSESTREAM
+#define POSESTREAM
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include <openpose/headers.hpp>
+
+// samples kept for interpolation, the segment around the render time and one before it
+const int POSE_HISTORY = 4;
+// longer gaps between samples are held instead of interpolated, in seconds
+const double POSE_MAX_GAP = 0.5;
+
+
+// seconds on the steady clock, shared time base of capture and render
+inline double poseClock() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// one inference result with the frame it was computed on
+struct PoseSample {
+    // capture time of the frame
+    double time = 0.0;
+    // BGR frame given to OpenPose, and the frame as captured (raw YUYV or the same BGR frame)
+    cv::Mat frame;
+    cv::Mat raw;
+    op::Array<float> keypoints;
+    // time spent reading and converting the frame, and in inference, in ms
+    float captureMs = 0.0f;
+    float inferenceMs = 0.0f;
+};
+
+// camera capture and pose inference on their own thread, so the render loop is not
+// held to the inference rate; the render loop picks up the newest result when it is ready
+class PoseStream {
+public:
+    PoseStream(cv::VideoCapture& cam, op::Wrapper& opWrapper, bool rawYUYV, int frameRows)
+        : cam(cam), opWrapper(opWrapper), rawYUYV(rawYUYV), frameRows(frameRows) {}
+
+    ~PoseStream() {
+        stop();
+    }
+
+    void start() {
+        worker = std::thread(&PoseStream::run, this);
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        if (worker.joinable())
+            worker.join();
+    }
+
+    // newest result not yet taken, older unread results are skipped
+    bool take(PoseSample& sample) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!ready)
+            return false;
+        sample = latest;
+        ready = false;
+        return true;
+    }
+
+    // the input ended and every result was taken
+    bool finished() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return ended && !ready;
+    }
+
+private:
+    cv::VideoCapture& cam;
+    op::Wrapper& opWrapper;
+    bool rawYUYV;
+    int frameRows;
+
+    std::thread worker;
+    std::mutex mutex;
+    PoseSample latest;
+    bool ready = false;
+    bool ended = false;
+    bool stopping = false;
+
+    void run() {
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (stopping)
+                    return;
+            }
+
+            PoseSample sample;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            cam >> sample.raw;
+            sample.time = poseClock();
+            if (sample.raw.empty()) {
+                std::cout << "Cannot read frame" << std::endl;
+                std::lock_guard<std::mutex> lock(mutex);
+                ended = true;
+                return;
+            }
+            if (rawYUYV) {
+                // packed YUYV may arrive as one row of bytes
+                sample.raw = sample.raw.reshape(2, frameRows);
+                cv::cvtColor(sample.raw, sample.frame, cv::COLOR_YUV2BGR_YUYV);
+            } else {
+                sample.frame = sample.raw;
+            }
+            std::chrono::steady_clock::time_point captured = std::chrono::steady_clock::now();
+            sample.captureMs = std::chrono::duration<float, std::milli>(captured - start).count();
+
+            // pose inference
+            const op::Matrix op_frame = OP_CV2OPCONSTMAT(sample.frame);
+            auto data = opWrapper.emplaceAndPop(op_frame);
+            sample.inferenceMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - captured).count();
+            if (data == nullptr || data->empty()) {
+                std::cout << "Null or empty processed data" << std::endl;
+                continue;
+            }
+            sample.keypoints = data->at(0)->poseKeypoints.clone();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            latest = sample;
+            ready = true;
+        }
+    }
+};
+
+// recent timestamped poses, sampled at any time in between with cubic Hermite interpolation
+// of every joint; the render time trails the newest pose by about one inference interval,
+// so there is normally a pose on both sides of it, and it holds the nearest pose when the
+// people changed, a joint was lost or the gap is too long to interpolate
+class PoseHistory {
+public:
+    // the people of keypoints are reordered in place to follow the previous pose, so hands,
+    // faces and gestures computed from them index the same people as the sampled poses
+    void push(double time, op::Array<float>& keypoints) {
+        Entry entry;
+        entry.time = time;
+        entry.people = keypoints.getSize(0);
+        entry.joints = entry.people ? keypoints.getSize(1) : 0;
+        entry.points.assign(keypoints.getConstPtr(), keypoints.getConstPtr() + keypoints.getVolume());
+        if (!entries.empty()) {
+            double interval = time - entries.back().time;
+            if (interval < POSE_MAX_GAP) {
+                if (meanInterval == 0.0)
+                    meanInterval = interval;
+                jitter = 0.9 * jitter + 0.1 * std::fabs(interval - meanInterval);
+                meanInterval = 0.9 * meanInterval + 0.1 * interval;
+            }
+            if (matchPeople(entries.back(), entry))
+                std::copy(entry.points.begin(), entry.points.end(), keypoints.getPtr());
+        }
+        entries.push_back(entry);
+        if (entries.size() > POSE_HISTORY)
+            entries.pop_front();
+    }
+
+    bool empty() const {
+        return entries.empty();
+    }
+
+    // people of the newest pose, sampled poses with another count are not in its order
+    int newestPeople() const {
+        return entries.empty() ? 0 : entries.back().people;
+    }
+
+    // pose at time now, or the newest pose when interpolation is off
+    void sample(double now, bool interpolate, op::Array<float>& keypoints) const {
+        const Entry& newest = entries.back();
+        // trail by a little more than one interval so a late pose does not leave a gap
+        double t = now - meanInterval - 2 * jitter;
+        if (!interpolate || entries.size() < 2 || t >= newest.time) {
+            copy(newest, keypoints);
+            return;
+        }
+
+        // segment i - 1 .. i around the render time
+        size_t i = entries.size() - 1;
+        while (i > 1 && entries[i - 1].time > t)
+            i--;
+        const Entry& a = entries[i - 1];
+        const Entry& b = entries[i];
+        if (t <= a.time || b.time - a.time > POSE_MAX_GAP || a.people != b.people || a.joints != b.joints) {
+            copy(t <= a.time ? a : b, keypoints);
+            return;
+        }
+        const Entry* before = i >= 2 ? &entries[i - 2] : NULL;
+        if (before != NULL && (before->people != a.people || a.time - before->time > POSE_MAX_GAP))
+            before = NULL;
+        const Entry* after = i + 1 < entries.size() ? &entries[i + 1] : NULL;
+        if (after != NULL && (after->people != b.people || after->time - b.time > POSE_MAX_GAP))
+            after = NULL;
+
+        resize(keypoints, b.people, b.joints);
+        float* out = keypoints.getPtr();
+        double dt = b.time - a.time;
+        double u = (t - a.time) / dt;
+        // cubic Hermite basis, tangents are scaled to the segment duration
+        double h00 = (1 + 2 * u) * (1 - u) * (1 - u);
+        double h10 = u * (1 - u) * (1 - u);
+        double h01 = u * u * (3 - 2 * u);
+        double h11 = u * u * (u - 1);
+        for (size_t k = 0; k < b.points.size(); k += 3) {
+            // joints missing on either side hold the newer value
+            if (a.points[k + 2] == 0 || b.points[k + 2] == 0) {
+                for (int c = 0; c < 3; c++)
+                    out[k + c] = b.points[k + c];
+                continue;
+            }
+            for (int c = 0; c < 2; c++) {
+                double p0 = a.points[k + c];
+                double p1 = b.points[k + c];
+                double secant = (p1 - p0) / dt;
+                // Catmull-Rom tangents from the neighbouring samples, the secant at the ends
+                double m0 = secant, m1 = secant;
+                if (before != NULL && before->points[k + 2] != 0)
+                    m0 = (p1 - before->points[k + c]) / (b.time - before->time);
+                if (after != NULL && after->points[k + 2] != 0)
+                    m1 = (after->points[k + c] - p0) / (after->time - a.time);
+                out[k + c] = h00 * p0 + h10 * dt * m0 + h01 * p1 + h11 * dt * m1;
+            }
+            out[k + 2] = a.points[k + 2] + (b.points[k + 2] - a.points[k + 2]) * u;
+        }
+    }
+
+private:
+    struct Entry {
+        double time;
+        int people;
+        int joints;
+        std::vector<float> points;
+    };
+
+    std::deque<Entry> entries;
+    // average time between poses and its mean deviation, the render time trails the newest pose by them
+    double meanInterval = 0.0;
+    double jitter = 0.0;
+
+    static void resize(op::Array<float>& keypoints, int people, int joints) {
+        if (people == 0) {
+            if (!keypoints.empty())
+                keypoints.reset();
+            return;
+        }
+        if (keypoints.getSize(0) != people || keypoints.getSize(1) != joints)
+            keypoints.reset({people, joints, 3});
+    }
+
+    static void copy(const Entry& entry, op::Array<float>& keypoints) {
+        resize(keypoints, entry.people, entry.joints);
+        if (entry.people != 0)
+            std::copy(entry.points.begin(), entry.points.end(), keypoints.getPtr());
+    }
+
+    // reorder the people of a new pose to follow the previous one, OpenPose gives no stable order;
+    // false when the pose was left as it is
+    static bool matchPeople(const Entry& previous, Entry& entry) {
+        if (previous.people != entry.people || previous.joints != entry.joints || entry.people < 2)
+            return false;
+        int stride = entry.joints * 3;
+        std::vector<float> reordered(entry.points.size());
+        std::vector<bool> used(entry.people, false);
+        for (int p = 0; p < previous.people; p++) {
+            float px, py, qx, qy;
+            centroid(&previous.points[p * stride], entry.joints, px, py);
+            int best = -1;
+            float bestDistance = 0.0f;
+            for (int q = 0; q < entry.people; q++) {
+                if (used[q])
+                    continue;
+                centroid(&entry.points[q * stride], entry.joints, qx, qy);
+                float distance = (px - qx) * (px - qx) + (py - qy) * (py - qy);
+                if (best < 0 || distance < bestDistance) {
+                    best = q;
+                    bestDistance = distance;
+                }
+            }
+            used[best] = true;
+            std::copy(entry.points.begin() + best * stride, entry.points.begin() + (best + 1) * stride,
+                      reordered.begin() + p * stride);
+        }
+        entry.points.swap(reordered);
+        return true;
+    }
+
+    static void centroid(const float* joints, int count, float& x, float& y) {
+        float sum = 0.0f;
+        x = y = 0.0f;
+        for (int j = 0; j < count; j++) {
+            if (joints[j * 3 + 2] == 0)
+                continue;
+            x += joints[j * 3];
+            y += joints[j * 3 + 1];
+            sum += 1.0f;
+        }
+        if (sum > 0.0f) {
+            x /= sum;
+            y /= sum;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef PRIMITIVES
+#define PRIMITIVES
+
+#include <cstddef>
+#include <vector>
+
+
+// shapes of the signed distance field primitives, matching sdf.frag
+const float SDF_CIRCLE = 0.0f;
+const float SDF_CAPSULE = 1.0f;
+const float SDF_ROUNDED_RECT = 2.0f;
+
+// per-instance attributes of a procedural primitive, drawn on one quad around segment a-b
+// circles have a == b, capsules and rounded rects extend radius to each side of the segment
+struct SDFPrimitive {
+    float a[2];
+    float b[2];
+    float radius;
+    float corner;
+    float shape;
+    float color[4];
+};
+
+// primitives of all people in the frame, drawn with one instanced draw
+class PrimitiveBatch {
+public:
+    std::vector<SDFPrimitive> items;
+
+    void clear() {
+        items.clear();
+    }
+
+    size_t size() const {
+        return items.size();
+    }
+
+    void circle(float x, float y, float radius, const float color[4]) {
+        add(x, y, x, y, radius, 0.0f, SDF_CIRCLE, color);
+    }
+
+    void capsule(float x1, float y1, float x2, float y2, float radius, const float color[4]) {
+        add(x1, y1, x2, y2, radius, 0.0f, SDF_CAPSULE, color);
+    }
+
+    // rectangle from (x1, y1) to (x2, y2), halfWidth to each side, corners rounded by corner
+    void roundedRect(float x1, float y1, float x2, float y2, float halfWidth, float corner, const float color[4]) {
+        add(x1, y1, x2, y2, halfWidth, corner, SDF_ROUNDED_RECT, color);
+    }
+
+private:
+    void add(float x1, float y1, float x2, float y2, float radius, float corner, float shape, const float color[4]) {
+        SDFPrimitive p = {{x1, y1}, {x2, y2}, radius, corner, shape, {color[0], color[1], color[2], color[3]}};
+        items.push_back(p);
+    }
+};
+
+#endif
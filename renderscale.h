@@ -0,0 +1,189 @@
+#ifndef RENDERSCALE
+#define RENDERSCALE
+
+#include <iostream>
+
+#include <glad/glad.h>
+
+#include "glstate.h"
+#include "shaderprogram.h"
+
+// lowest scale the dynamic mode goes to, and its step per adjustment
+const float RENDER_SCALE_MIN = 0.5f;
+const float RENDER_SCALE_STEP = 0.05f;
+// timer queries in flight, a result is read RENDER_TIMER_RING - 1 frames after it was issued
+const int RENDER_TIMER_RING = 3;
+// frames averaged before each dynamic adjustment
+const int RENDER_SCALE_WINDOW = 15;
+
+
+// renders the scene at a fraction of the output resolution and upscales it in one pass
+// the scene goes to the lower left region of an offscreen texture allocated at the full
+// output size, so changing the scale only changes the viewport; in dynamic mode the scale
+// follows the GPU time of the frame, measured with timer queries read a few frames later
+// so they never stall, down while the frame is over budget and up while well under it
+class RenderScale {
+public:
+    float scale = 1.0f;
+
+    // dynamic mode targets budgetMs of GPU time per frame, 0 keeps the scale fixed
+    void init(float initialScale, float budgetMs, unsigned int textureUnit) {
+        scale = initialScale < RENDER_SCALE_MIN ? RENDER_SCALE_MIN : initialScale > 1.0f ? 1.0f : initialScale;
+        budget = budgetMs;
+        unit = textureUnit;
+        enabled = scale < 1.0f || budget > 0.0f;
+        if (!enabled)
+            return;
+
+        glGenFramebuffers(1, &framebuffer);
+        glGenTextures(1, &texture);
+        if (budget > 0.0f) {
+            glGenQueries(RENDER_TIMER_RING, queries);
+            for (int i = 0; i < RENDER_TIMER_RING; i++)
+                pending[i] = false;
+        }
+    }
+
+    // start rendering the scene for an output of width x height
+    void begin(int width, int height) {
+        if (!enabled)
+            return;
+        if (width != outWidth || height != outHeight)
+            allocate(width, height);
+        if (budget > 0.0f)
+            glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glState().viewport(0, 0, regionWidth(), regionHeight());
+    }
+
+    // upscale the scene into the output framebuffer with the upscale shader on an empty vertex array,
+    // regionScaleUni is the location of its regionScale uniform
+    void end(unsigned int outputFramebuffer, ShaderProgram& upscaleSP, unsigned int regionScaleUni, unsigned int emptyVAO) {
+        if (!enabled)
+            return;
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+        glState().viewport(0, 0, outWidth, outHeight);
+        glState().bindTexture(unit, GL_TEXTURE_2D, texture);
+        upscaleSP.use();
+        glUniform2f(regionScaleUni, regionWidth() / (float)outWidth, regionHeight() / (float)outHeight);
+        glState().bindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+        if (budget > 0.0f) {
+            glEndQuery(GL_TIME_ELAPSED);
+            pending[next] = true;
+            next = (next + 1) % RENDER_TIMER_RING;
+            if (pending[next])
+                collect(next);
+        }
+    }
+
+    bool isEnabled() const {
+        return enabled;
+    }
+
+    // GPU time of the newest measured frame, 0 without a budget or before the first result
+    float gpuTime() const {
+        return lastTime;
+    }
+
+    // average GPU time and scale since the last report
+    void report() {
+        if (!enabled)
+            return;
+        std::cout << "render scale: " << scale << " (" << regionWidth() << "x" << regionHeight() << ")";
+        if (reportFrames > 0)
+            std::cout << ", " << reportTime / reportFrames << " ms GPU per frame, budget " << budget << " ms";
+        std::cout << std::endl;
+        reportTime = 0.0;
+        reportFrames = 0;
+    }
+
+    void free() {
+        if (!enabled)
+            return;
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteTextures(1, &texture);
+        if (budget > 0.0f)
+            glDeleteQueries(RENDER_TIMER_RING, queries);
+    }
+
+private:
+    bool enabled = false;
+    float budget = 0.0f;
+    unsigned int unit = 0;
+    unsigned int framebuffer = 0;
+    unsigned int texture = 0;
+    int outWidth = 0;
+    int outHeight = 0;
+
+    unsigned int queries[RENDER_TIMER_RING];
+    bool pending[RENDER_TIMER_RING];
+    int next = 0;
+    bool measured = false;
+    float lastTime = 0.0f;
+    double windowTime = 0.0;
+    int windowFrames = 0;
+    double reportTime = 0.0;
+    int reportFrames = 0;
+
+    int regionWidth() const {
+        return (int)(outWidth * scale + 0.5f);
+    }
+
+    int regionHeight() const {
+        return (int)(outHeight * scale + 0.5f);
+    }
+
+    void allocate(int width, int height) {
+        outWidth = width;
+        outHeight = height;
+        glState().bindTexture(unit, GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::RENDERSCALE::FRAMEBUFFER_NOT_COMPLETE" << std::endl;
+    }
+
+    // read a finished timer query and adjust the scale once a window of frames is measured
+    void collect(int slot) {
+        // a result still not available is dropped, the query is reused next
+        pending[slot] = false;
+        GLint available = 0;
+        glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &elapsed);
+        // llvmpipe measures the first query from context creation
+        if (!measured) {
+            measured = true;
+            return;
+        }
+        double ms = elapsed / 1e6;
+        lastTime = (float)ms;
+        windowTime += ms;
+        windowFrames++;
+        reportTime += ms;
+        reportFrames++;
+        if (windowFrames < RENDER_SCALE_WINDOW)
+            return;
+
+        // one step adds at most about 20% of the pixels, less than the gap between the
+        // two thresholds, so the scale settles instead of oscillating
+        double average = windowTime / windowFrames;
+        if (average > budget && scale > RENDER_SCALE_MIN)
+            scale = scale - RENDER_SCALE_STEP < RENDER_SCALE_MIN ? RENDER_SCALE_MIN : scale - RENDER_SCALE_STEP;
+        else if (average < 0.7 * budget && scale < 1.0f)
+            scale = scale + RENDER_SCALE_STEP > 1.0f ? 1.0f : scale + RENDER_SCALE_STEP;
+        windowTime = 0.0;
+        windowFrames = 0;
+    }
+};
+
+#endif
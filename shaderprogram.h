@@ -8,6 +8,8 @@
 
 #include <glad/glad.h>
 
+#include "glstate.h"
+
 
 class ShaderProgram {
 public:
@@ -68,13 +70,14 @@ public:
         glDeleteShader(fragment);
     }
 
-    // activate shader program
+    // activate shader program, skipped if it is already active
     void use() { 
-        glUseProgram(ID); 
+        glState().useProgram(ID); 
     }
 
     // delete shader program
     void free() {
+        glState().forgetProgram(ID);
         glDeleteProgram(ID);
     }
 
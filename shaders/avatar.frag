@@ -3,12 +3,15 @@ out vec4 FragColor;
 
 in vec2 texel;
 
-uniform sampler2D textureMap;
+// avatar parts, one per layer, padded to the largest part
+uniform sampler2DArray parts;
+uniform vec2 partScale[11];
+uniform int layer;
 
 void main() {
-    vec4 texColor = texture(textureMap, texel);
+    vec4 texColor = texture(parts, vec3(texel * partScale[layer], layer));
     if (texColor.a < 0.1)
         discard;
 
-    FragColor = texColor; 
+    FragColor = texColor;
 }
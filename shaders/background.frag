@@ -0,0 +1,29 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 pixel;
+
+// raw camera bytes: BGR as three single channel texels per pixel, or YUYV as one (Y0, U, Y1, V) texel per pixel pair
+uniform sampler2D frame;
+// 0 BGR, 1 YUYV
+uniform int format;
+
+void main() {
+    ivec2 p = ivec2(pixel);
+    vec3 rgb;
+    if (format == 1) {
+        vec4 pair = texelFetch(frame, ivec2(p.x / 2, p.y), 0);
+        float y = (p.x & 1) == 0 ? pair.r : pair.b;
+        // BT.601 limited range
+        float c = 1.164f * (y - 0.0625f);
+        float u = pair.g - 0.5f;
+        float v = pair.a - 0.5f;
+        rgb = vec3(c + 1.596f * v, c - 0.392f * u - 0.813f * v, c + 2.017f * u);
+    } else {
+        int x = 3 * p.x;
+        rgb = vec3(texelFetch(frame, ivec2(x + 2, p.y), 0).r,
+                   texelFetch(frame, ivec2(x + 1, p.y), 0).r,
+                   texelFetch(frame, ivec2(x, p.y), 0).r);
+    }
+    FragColor = vec4(clamp(rgb, 0.0f, 1.0f), 1.0f);
+}
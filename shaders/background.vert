@@ -0,0 +1,15 @@
+#version 330 core
+// camera frame on a quad covering its pixel coords, the strip vertex picks the corner
+
+// position in frame pixels
+out vec2 pixel;
+
+uniform mat4 projection;
+uniform vec2 frameSize;
+
+void main() {
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    pixel = corner * frameSize;
+    // same projection as the keypoints, so the avatar lines up with the person
+    gl_Position = projection * vec4(pixel, 0.0f, 1.0f);
+}
@@ -0,0 +1,13 @@
+#version 330 core
+// overlay lines in pixels from the top left of the framebuffer
+layout (location = 0) in vec2 position;
+layout (location = 1) in vec4 color;
+
+out vec4 lineColor;
+
+uniform vec2 viewport;
+
+void main() {
+    lineColor = color;
+    gl_Position = vec4(2.0f * position.x / viewport.x - 1.0f, 1.0f - 2.0f * position.y / viewport.y, 0.0f, 1.0f);
+}
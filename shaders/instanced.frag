@@ -0,0 +1,17 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 texel;
+flat in int part;
+
+// avatar parts, one per layer, padded to the largest part, one skin every 11 layers
+uniform sampler2DArray parts;
+uniform vec2 partScale[11];
+
+void main() {
+    vec4 texColor = texture(parts, vec3(texel * partScale[part % 11], part));
+    if (texColor.a < 0.1)
+        discard;
+
+    FragColor = texColor;
+}
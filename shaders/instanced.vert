@@ -0,0 +1,24 @@
+#version 330 core
+// per-instance 2D affine transform and avatar part
+layout (location = 2) in vec2 axisX;
+layout (location = 3) in vec2 axisY;
+layout (location = 4) in vec2 offset;
+layout (location = 5) in float layer;
+
+out vec2 texel;
+flat out int part;
+
+uniform mat4 projection;
+// outline fan of every part in texel coords, drawn with MESH_VERTS vertices per instance
+const int MESH_VERTS = 12;
+uniform vec2 partMesh[11 * MESH_VERTS];
+
+void main() {
+    // layers past the first NUM_PARTS belong to other skins of the same parts
+    part = int(layer);
+    texel = partMesh[(part % 11) * MESH_VERTS + gl_VertexID];
+    // texel to the unit square of the rectangle primitive
+    vec2 position = vec2(texel.x, 1.0f - texel.y);
+    vec2 world = offset + axisX * position.x + axisY * position.y;
+    gl_Position = projection * vec4(world, 0.0f, 1.0f);
+}
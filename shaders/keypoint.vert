@@ -0,0 +1,87 @@
+#version 330 core
+// avatar parts built from raw keypoints, no vertex attributes
+// instance i draws part i % 11 of person i / 11, the vertex picks the corner of the part outline
+
+out vec2 texel;
+flat out int part;
+
+uniform mat4 projection;
+// x, y, conf of every keypoint of every person, one float per texel
+uniform samplerBuffer keypoints;
+uniform int joints;
+uniform float limbWidth;
+uniform float faceRadius;
+uniform float minConfidence;
+// outline fan of every part in texel coords, drawn with MESH_VERTS vertices per instance
+const int MESH_VERTS = 12;
+uniform vec2 partMesh[11 * MESH_VERTS];
+
+// rectangle limb mappings, same order as the part textures
+const ivec2 limbMap[10] = ivec2[10](ivec2(1, 8),      // 0. torso 1
+                                    ivec2(8, 1),      // 1. torso 2
+                                    ivec2(3, 2),      // 2. R bicep
+                                    ivec2(4, 3),      // 3. R forearm
+                                    ivec2(5, 6),      // 4. L bicep
+                                    ivec2(6, 7),      // 5. L forearm
+                                    ivec2(10, 9),     // 6. R thigh
+                                    ivec2(11, 10),    // 7. R calf
+                                    ivec2(12, 13),    // 8. L thigh
+                                    ivec2(13, 14));   // 9. L calf
+
+vec3 joint(int person, int j) {
+    int base = (person * joints + j) * 3;
+    return vec3(texelFetch(keypoints, base).r,
+                texelFetch(keypoints, base + 1).r,
+                texelFetch(keypoints, base + 2).r);
+}
+
+void main() {
+    int person = gl_InstanceID / 11;
+    part = gl_InstanceID % 11;
+    // outline vertex in the unit square, same layout as the rectangle primitive
+    texel = partMesh[part * MESH_VERTS + gl_VertexID];
+    vec2 corner = vec2(texel.x, 1.0f - texel.y);
+
+    // scale dimensions by nose-ear distance
+    vec3 nose = joint(person, 0);
+    float radius = faceRadius;
+    float width = limbWidth;
+    if (nose.z > minConfidence) {
+        vec3 rEar = joint(person, 17);
+        vec3 lEar = joint(person, 18);
+        if (rEar.z > minConfidence) {
+            radius = distance(nose.xy, rEar.xy);
+            width = radius / 2.0f;
+        } else if (lEar.z > minConfidence) {
+            radius = distance(nose.xy, lEar.xy);
+            width = radius / 2.0f;
+        }
+    }
+
+    vec2 world;
+    if (part == 10) {
+        // avatar head, collapsed when the nose is not detected
+        if (nose.z <= minConfidence) {
+            gl_Position = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+            return;
+        }
+        world = nose.xy - radius + corner * 2.0f * radius;
+    } else {
+        ivec2 pair = limbMap[part];
+        vec3 a = joint(person, pair.x);
+        vec3 b = joint(person, pair.y);
+        // limbs below the threshold collapse to a point and produce no fragments
+        if (a.z <= minConfidence || b.z <= minConfidence) {
+            gl_Position = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+            return;
+        }
+        // make torso wider
+        if (part < 2)
+            width *= 2.0f;
+        vec2 axis = b.xy - a.xy;
+        float len = length(axis);
+        vec2 normal = len > 0.0f ? vec2(-axis.y, axis.x) * (width / len) : vec2(0.0f);
+        world = a.xy + axis * corner.x + normal * corner.y;
+    }
+    gl_Position = projection * vec4(world, 0.0f, 1.0f);
+}
@@ -0,0 +1,34 @@
+#version 330 core
+// avatar head mesh, instance i is the head of one person
+// texels keep their place in the head texture, positions move by the weighted morph targets
+layout (location = 0) in vec2 restTexel;
+layout (location = 2) in vec2 axisX;
+layout (location = 3) in vec2 axisY;
+layout (location = 4) in vec2 offset;
+layout (location = 5) in vec4 weightsA;
+layout (location = 6) in vec4 weightsB;
+
+out vec2 texel;
+flat out int part;
+
+uniform mat4 projection;
+// texel displacement of every vertex per target, target-major
+uniform samplerBuffer morphs;
+uniform int vertices;
+const int TARGETS = 6;
+const int HEAD_PART = 10;
+
+void main() {
+    part = HEAD_PART;
+    texel = restTexel;
+    vec2 moved = restTexel;
+    for (int k = 0; k < TARGETS; k++) {
+        float weight = k < 4 ? weightsA[k] : weightsB[k - 4];
+        if (weight != 0.0f)
+            moved += weight * texelFetch(morphs, k * vertices + gl_VertexID).xy;
+    }
+    // texel to the unit square of the head part
+    vec2 position = vec2(moved.x, 1.0f - moved.y);
+    vec2 world = offset + axisX * position.x + axisY * position.y;
+    gl_Position = projection * vec4(world, 0.0f, 1.0f);
+}
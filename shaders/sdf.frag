@@ -0,0 +1,32 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 local;
+flat in vec3 size;
+flat in int kind;
+flat in vec4 fillColor;
+
+void main() {
+    float len = size.x;
+    float radius = size.y;
+    float corner = size.z;
+
+    // signed distance to the shape edge, negative inside
+    float d;
+    if (kind == 2) {
+        // rounded rectangle spanning the segment
+        vec2 halfSize = vec2(len / 2.0f, radius);
+        vec2 q = abs(local - vec2(len / 2.0f, 0.0f)) - halfSize + corner;
+        d = length(max(q, 0.0f)) + min(max(q.x, q.y), 0.0f) - corner;
+    } else {
+        // capsule around the segment, circles have zero length
+        d = length(vec2(local.x - clamp(local.x, 0.0f, len), local.y)) - radius;
+    }
+
+    // pixel coverage from the screen space distance gradient
+    float coverage = clamp(0.5f - d / max(fwidth(d), 0.0001f), 0.0f, 1.0f);
+    if (coverage <= 0.0f)
+        discard;
+
+    FragColor = vec4(fillColor.rgb, fillColor.a * coverage);
+}
@@ -0,0 +1,33 @@
+#version 330 core
+// procedural primitives, one quad around each segment, the strip vertex picks the corner
+layout (location = 0) in vec2 a;
+layout (location = 1) in vec2 b;
+// radius, corner radius, shape
+layout (location = 2) in vec3 shape;
+layout (location = 3) in vec4 color;
+
+// position in the segment frame: x along a-b from a, y across
+out vec2 local;
+// segment length, radius, corner radius
+flat out vec3 size;
+flat out int kind;
+flat out vec4 fillColor;
+
+uniform mat4 projection;
+
+void main() {
+    vec2 axis = b - a;
+    float len = length(axis);
+    vec2 dir = len > 0.0f ? axis / len : vec2(1.0f, 0.0f);
+    vec2 normal = vec2(-dir.y, dir.x);
+    // one pixel of margin for the anti-aliased edge
+    float margin = shape.x + 1.0f;
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    local = vec2(mix(-margin, len + margin, corner.x), mix(-margin, margin, corner.y));
+    vec2 world = a + dir * local.x + normal * local.y;
+    gl_Position = projection * vec4(world, 0.0f, 1.0f);
+
+    size = vec3(len, shape.x, shape.y);
+    kind = int(shape.z);
+    fillColor = color;
+}
@@ -0,0 +1,12 @@
+#version 330 core
+out vec4 FragColor;
+
+in float detected;
+
+uniform vec4 color;
+
+void main() {
+    if (detected < 0.999f)
+        discard;
+    FragColor = color;
+}
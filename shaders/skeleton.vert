@@ -0,0 +1,13 @@
+#version 330 core
+// raw keypoint as x, y, confidence, indexed into bone lines
+layout (location = 0) in vec3 keypoint;
+
+// 1 at detected joints, bones to a missing joint interpolate below 1 and are discarded
+out float detected;
+
+uniform mat4 projection;
+
+void main() {
+    detected = keypoint.z > 0.0f ? 1.0f : 0.0f;
+    gl_Position = projection * vec4(keypoint.xy, 0.0f, 1.0f);
+}
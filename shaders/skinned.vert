@@ -0,0 +1,49 @@
+#version 330 core
+// skinned avatar mesh, instance i is person i
+// rest pose vertices are blended by up to four bones, linear blend skinning
+layout (location = 0) in vec2 restPosition;
+layout (location = 1) in vec2 restTexel;
+layout (location = 2) in uvec4 bones;
+layout (location = 3) in vec4 weights;
+
+out vec2 texel;
+flat out int part;
+
+uniform mat4 projection;
+// skin transforms of every person, BONES per person and two texels per bone: the 2x2
+// matrix by columns, then the translation and 1 when the bone was detected
+uniform samplerBuffer skin;
+const int BONES = 11;
+
+void main() {
+    part = int(bones.x);
+    texel = restTexel;
+    int base = gl_InstanceID * BONES;
+
+    // parts whose own bone was not detected collapse and produce no fragments
+    if (texelFetch(skin, (base + part) * 2 + 1).z == 0.0f) {
+        gl_Position = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        return;
+    }
+
+    // undetected neighbours drop out of the blend
+    vec2 world = vec2(0.0f);
+    float total = 0.0f;
+    for (int i = 0; i < 4; i++) {
+        if (weights[i] <= 0.0f)
+            continue;
+        int bone = (base + int(bones[i])) * 2;
+        vec4 m = texelFetch(skin, bone);
+        vec4 t = texelFetch(skin, bone + 1);
+        if (t.z == 0.0f)
+            continue;
+        world += weights[i] * (mat2(m.xy, m.zw) * restPosition + t.xy);
+        total += weights[i];
+    }
+    // no detected bone left, e.g. a loaded mesh with no weight on the own bone
+    if (total == 0.0f) {
+        gl_Position = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        return;
+    }
+    gl_Position = projection * vec4(world / total, 0.0f, 1.0f);
+}
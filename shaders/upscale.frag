@@ -0,0 +1,35 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 uv;
+
+// scene rendered at the reduced resolution, sampled with bilinear filtering
+uniform sampler2D scene;
+// 0 bilinear, 1 bilinear with contrast adaptive sharpening
+uniform int filterMode;
+// 0 to 1, strength of the sharpening
+uniform float sharpness;
+// edge of the rendered region, neighbours are not taken from outside it
+uniform vec2 regionScale;
+
+void main() {
+    // the last output pixels fall past the last texel center of the region, clamped so
+    // filtering never mixes in the cleared texels outside it
+    vec2 texel = 1.0f / vec2(textureSize(scene, 0));
+    vec2 limit = regionScale - 0.5f * texel;
+    vec2 center = min(uv, limit);
+    vec3 c = texture(scene, center).rgb;
+    if (filterMode == 1) {
+        vec3 n = texture(scene, min(center + vec2(0.0f, texel.y), limit)).rgb;
+        vec3 s = texture(scene, center - vec2(0.0f, texel.y)).rgb;
+        vec3 e = texture(scene, min(center + vec2(texel.x, 0.0f), limit)).rgb;
+        vec3 w = texture(scene, center - vec2(texel.x, 0.0f)).rgb;
+        // sharpen less where the local contrast is already high, so edges do not ring
+        vec3 lo = min(c, min(min(n, s), min(e, w)));
+        vec3 hi = max(c, max(max(n, s), max(e, w)));
+        vec3 amount = sqrt(clamp(min(lo, 1.0f - hi) / max(hi, 1e-4f), 0.0f, 1.0f));
+        vec3 weight = -amount / mix(8.0f, 5.0f, sharpness);
+        c = clamp((c + weight * (n + s + e + w)) / (1.0f + 4.0f * weight), 0.0f, 1.0f);
+    }
+    FragColor = vec4(c, 1.0f);
+}
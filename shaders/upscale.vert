@@ -0,0 +1,14 @@
+#version 330 core
+// full screen quad over the output, the strip vertex picks the corner
+
+// texture coords inside the low resolution region
+out vec2 uv;
+
+// size of the rendered region relative to the scene texture
+uniform vec2 regionScale;
+
+void main() {
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    uv = corner * regionScale;
+    gl_Position = vec4(corner * 2.0f - 1.0f, 0.0f, 1.0f);
+}
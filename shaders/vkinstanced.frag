@@ -0,0 +1,16 @@
+#version 450
+layout (location = 0) out vec4 FragColor;
+
+layout (location = 0) in vec2 uv;
+layout (location = 1) flat in int part;
+
+// avatar parts, one per layer, padded to the largest part
+layout (set = 0, binding = 2) uniform sampler2DArray parts;
+
+void main() {
+    vec4 texColor = texture(parts, vec3(uv, part));
+    if (texColor.a < 0.1)
+        discard;
+
+    FragColor = texColor;
+}
@@ -0,0 +1,35 @@
+#version 450
+// instanced.vert for the Vulkan renderer, the per-instance transforms come from the
+// frame's region of a dynamic uniform buffer instead of vertex attributes
+const int MAX_INSTANCES = 512;
+// outline fan of every part in texel coords, drawn with MESH_VERTS vertices per instance
+const int MESH_VERTS = 12;
+
+layout (std140, set = 0, binding = 0) uniform Instances {
+    // axisX and axisY, then offset and layer
+    vec4 instances[2 * MAX_INSTANCES];
+};
+layout (std140, set = 0, binding = 1) uniform Parts {
+    vec4 partMesh[11 * MESH_VERTS];
+    // part size in its padded layer
+    vec4 partScale[11];
+};
+layout (push_constant) uniform View {
+    vec2 viewSize;
+};
+
+layout (location = 0) out vec2 uv;
+layout (location = 1) flat out int part;
+
+void main() {
+    vec4 axes = instances[2 * gl_InstanceIndex];
+    vec4 offsetLayer = instances[2 * gl_InstanceIndex + 1];
+    part = int(offsetLayer.z);
+    vec2 texel = partMesh[part * MESH_VERTS + gl_VertexIndex].xy;
+    uv = texel * partScale[part].xy;
+    // texel to the unit square of the rectangle primitive
+    vec2 position = vec2(texel.x, 1.0f - texel.y);
+    vec2 world = offsetLayer.xy + axes.xy * position.x + axes.zw * position.y;
+    // the GL projection mirrors x, and Vulkan clip space y points down
+    gl_Position = vec4(1.0f - 2.0f * world.x / viewSize.x, 2.0f * world.y / viewSize.y - 1.0f, 0.0f, 1.0f);
+}
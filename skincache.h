@@ -0,0 +1,419 @@
+#ifndef SKINCACHE
+#define SKINCACHE
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <glad/glad.h>
+
+#include "avatar.h"
+#include "glstate.h"
+#include "stb_image.h"
+
+// bytes uploaded into the cache per frame, the rest of a skin follows on the next frames
+const size_t SKIN_UPLOAD_BYTES = 1 << 20;
+// decoded skins waiting for upload, the worker pauses when this many are ready
+const size_t SKIN_DECODED_MAX = 2;
+// frames a skin stays undrawn before a prefetched skin may evict it
+const unsigned long SKIN_PREFETCH_AGE = 120;
+
+
+// avatar skins of a library resident in a fixed budget of GPU memory
+// one GL_TEXTURE_2D_ARRAY holds slots of NUM_PARTS layers, every part resampled to the
+// square slot size so all skins share one uv scale of 1; skin 0 is the default skin, always
+// resident in slot 0, the others are decoded with their mip chains on a worker thread and
+// uploaded through a pixel buffer a bounded number of bytes per frame, evicting the least
+// recently drawn skin when every slot is taken; until a skin is resident its wearers are
+// drawn with the default skin, so a switch never waits on the disk or a large upload
+class SkinCache {
+public:
+    unsigned int ID = 0;
+    int size = 0;
+    int slots = 0;
+    unsigned int unit = 0;
+
+    // default skin directory, library directory of one subdirectory per skin with the part
+    // images 0.png to 10.png, the budget in MB and the slot size in texels; the array is
+    // bound to textureUnit through the state cache
+    bool init(const std::string& defaultDir, const std::string& libraryDir, int budget, int slotSize,
+              unsigned int textureUnit) {
+        unit = textureUnit;
+        size = std::max(slotSize, 1);
+        levels = 1;
+        while ((size >> levels) > 0)
+            levels++;
+        slotBytes = 0;
+        for (int l = 0; l < levels; l++)
+            slotBytes += (size_t)levelSize(l) * levelSize(l) * 4 * NUM_PARTS;
+        slots = (int)((size_t)budget * 1024 * 1024 / slotBytes);
+        if (slots < 2) {
+            std::cout << "ERROR::SKINCACHE::BUDGET_TOO_SMALL " << budget << " MB holds " << slots
+                      << " skins of " << size << " texels" << std::endl;
+            return false;
+        }
+
+        dirs.push_back(defaultDir);
+        DIR* dir = opendir(libraryDir.c_str());
+        if (dir == NULL) {
+            std::cout << "ERROR::SKINCACHE::DIRECTORY_NOT_FOUND " << libraryDir << std::endl;
+            return false;
+        }
+        std::vector<std::string> names;
+        while (dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            struct stat info;
+            if (name[0] != '.' && stat((libraryDir + "/" + name + "/0.png").c_str(), &info) == 0)
+                names.push_back(name);
+        }
+        closedir(dir);
+        std::sort(names.begin(), names.end());
+        for (size_t i = 0; i < names.size(); i++)
+            dirs.push_back(libraryDir + "/" + names[i]);
+
+        glGenTextures(1, &ID);
+        glState().bindTexture(unit, GL_TEXTURE_2D_ARRAY, ID);
+        for (int l = 0; l < levels; l++)
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, l, GL_RGBA8, levelSize(l), levelSize(l), slots * NUM_PARTS, 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glGenBuffers(1, &pbo);
+
+        slotSkin.assign(slots, -1);
+        slotUsed.assign(slots, 0);
+        skinSlot.assign(dirs.size(), -1);
+        skinState.assign(dirs.size(), SKIN_IDLE);
+        skinRequested.assign(dirs.size(), false);
+
+        // the default skin is loaded before the first frame and never evicted
+        Decoded first;
+        first.skin = 0;
+        if (!decode(first)) {
+            free();
+            return false;
+        }
+        beginUpload(first, 0);
+        while (uploading)
+            upload((size_t)-1);
+
+        running = true;
+        worker = std::thread(&SkinCache::run, this);
+        std::cout << "Skin cache: " << count() << " skins, " << slots << " slots of "
+                  << slotBytes / (1024.0 * 1024.0) << " MB" << std::endl;
+        return true;
+    }
+
+    int count() const {
+        return dirs.size();
+    }
+
+    // first layer of a skin for this frame, queued for loading ahead of any prefetch and
+    // replaced by the default skin until it is resident
+    int layer(int skin) {
+        if (skin <= 0 || skin >= count())
+            return 0;
+        if (skinSlot[skin] >= 0) {
+            slotUsed[skinSlot[skin]] = frame;
+            hits++;
+            return skinSlot[skin] * NUM_PARTS;
+        }
+        misses++;
+        skinRequested[skin] = true;
+        queue(skin, true);
+        slotUsed[0] = frame;
+        return 0;
+    }
+
+    // load a skin likely to be drawn soon, after the skins already requested, into a free
+    // slot or one that has not been drawn for a while
+    void prefetch(int skin) {
+        if (skin > 0 && skin < count() && skinSlot[skin] < 0 && victim(SKIN_PREFETCH_AGE) >= 0)
+            queue(skin, false);
+    }
+
+    // once per frame before drawing: continues the upload in progress within the per-frame
+    // budget, or starts the next decoded skin
+    void update() {
+        frame++;
+        if (!uploading) {
+            Decoded next;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (decoded.empty())
+                    return;
+                next = std::move(decoded.front());
+                decoded.pop_front();
+            }
+            cv.notify_one();
+            if (!next.ok) {
+                // unreadable skins stay on the default skin
+                skinState[next.skin] = SKIN_FAILED;
+                return;
+            }
+            // a skin that became resident while this copy was decoded is not uploaded twice
+            if (skinSlot[next.skin] >= 0)
+                return;
+            int slot = victim(skinRequested[next.skin] ? 1 : SKIN_PREFETCH_AGE);
+            if (slot < 0 && !skinRequested[next.skin]) {
+                // prefetches never push out skins in use
+                skinState[next.skin] = SKIN_IDLE;
+                return;
+            }
+            if (slot < 0) {
+                // every slot was drawn last frame, retry on the next one
+                std::lock_guard<std::mutex> lock(mutex);
+                decoded.push_front(std::move(next));
+                return;
+            }
+            if (slotSkin[slot] >= 0) {
+                skinSlot[slotSkin[slot]] = -1;
+                skinState[slotSkin[slot]] = SKIN_IDLE;
+                evictions++;
+            }
+            beginUpload(next, slot);
+        }
+        upload(SKIN_UPLOAD_BYTES);
+    }
+
+    void report() {
+        int resident = 0;
+        for (int s = 0; s < slots; s++)
+            resident += slotSkin[s] >= 0;
+        std::cout << "skins: " << resident << "/" << slots << " slots resident, " << loads << " loads, "
+                  << evictions << " evictions, " << uploaded / (1024.0 * 1024.0) << " MB uploaded, "
+                  << misses << " of " << hits + misses << " draws waiting on the default skin" << std::endl;
+        hits = misses = 0;
+        uploaded = 0;
+    }
+
+    void free() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        cv.notify_all();
+        if (worker.joinable())
+            worker.join();
+        glDeleteBuffers(1, &pbo);
+        glDeleteTextures(1, &ID);
+        pbo = ID = 0;
+    }
+
+private:
+    enum SkinState { SKIN_IDLE, SKIN_QUEUED, SKIN_LOADING, SKIN_FAILED };
+
+    // every layer of a skin with its mip chain, layer-major
+    struct Decoded {
+        int skin = -1;
+        bool ok = false;
+        std::vector<unsigned char> pixels;
+    };
+
+    std::vector<std::string> dirs;
+    int levels = 1;
+    size_t slotBytes = 0;
+    unsigned int pbo = 0;
+
+    // render thread state
+    std::vector<int> slotSkin;
+    std::vector<unsigned long> slotUsed;
+    std::vector<int> skinSlot;
+    std::vector<SkinState> skinState;
+    std::vector<bool> skinRequested;
+    unsigned long frame = 0;
+    bool uploading = false;
+    Decoded current;
+    int currentSlot = 0;
+    size_t currentOffset = 0;
+    unsigned long hits = 0, misses = 0, loads = 0, evictions = 0;
+    size_t uploaded = 0;
+
+    // shared with the worker
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<int> requests;
+    std::deque<Decoded> decoded;
+    bool running = false;
+    std::thread worker;
+
+    int levelSize(int level) const {
+        return std::max(size >> level, 1);
+    }
+
+    void queue(int skin, bool front) {
+        if (skinState[skin] == SKIN_LOADING || skinState[skin] == SKIN_FAILED)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (skinState[skin] == SKIN_QUEUED) {
+                // a skin the worker already took is being decoded or waits for upload, and a
+                // prefetched skin now drawn moves ahead of the other requests
+                std::deque<int>::iterator request = std::find(requests.begin(), requests.end(), skin);
+                if (!front || request == requests.end())
+                    return;
+                requests.erase(request);
+            }
+            if (front)
+                requests.push_front(skin);
+            else
+                requests.push_back(skin);
+        }
+        skinState[skin] = SKIN_QUEUED;
+        cv.notify_one();
+    }
+
+    // free slot, or the least recently drawn skin not drawn in the last age frames, never slot 0
+    int victim(unsigned long age) const {
+        int best = -1;
+        for (int s = 1; s < slots; s++) {
+            if (slotSkin[s] < 0 && !(uploading && s == currentSlot))
+                return s;
+            if (slotSkin[s] < 0 || slotUsed[s] + age >= frame)
+                continue;
+            if (best < 0 || slotUsed[s] < slotUsed[best])
+                best = s;
+        }
+        return best;
+    }
+
+    void beginUpload(Decoded& skin, int slot) {
+        current = std::move(skin);
+        currentSlot = slot;
+        currentOffset = 0;
+        uploading = true;
+        slotSkin[slot] = -1;
+        skinState[current.skin] = SKIN_LOADING;
+    }
+
+    // next rows of the current skin through the pixel buffer, bands of whole rows of a mip
+    // level until the byte budget is used up, at least one row per call
+    void upload(size_t budget) {
+        glState().bindTexture(unit, GL_TEXTURE_2D_ARRAY, ID);
+        glState().activeTexture(unit);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        size_t sent = 0;
+        while (currentOffset < current.pixels.size() && sent < budget) {
+            // position of the offset in the layer-major chain
+            size_t layerBytes = slotBytes / NUM_PARTS, within = currentOffset % layerBytes;
+            int layer = currentOffset / layerBytes, level = 0;
+            while (within >= (size_t)levelSize(level) * levelSize(level) * 4) {
+                within -= (size_t)levelSize(level) * levelSize(level) * 4;
+                level++;
+            }
+            size_t rowBytes = (size_t)levelSize(level) * 4;
+            int row = within / rowBytes;
+            int rows = std::min((size_t)(levelSize(level) - row), (budget - sent) / rowBytes);
+            if (rows == 0 && sent > 0)
+                break;
+            rows = std::max(rows, 1);
+            size_t bytes = rows * rowBytes;
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, &current.pixels[currentOffset], GL_STREAM_DRAW);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, row, currentSlot * NUM_PARTS + layer,
+                            levelSize(level), rows, 1, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+            currentOffset += bytes;
+            sent += bytes;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        uploaded += sent;
+
+        if (currentOffset >= current.pixels.size()) {
+            slotSkin[currentSlot] = current.skin;
+            slotUsed[currentSlot] = frame;
+            skinSlot[current.skin] = currentSlot;
+            skinState[current.skin] = SKIN_IDLE;
+            skinRequested[current.skin] = false;
+            current.pixels = std::vector<unsigned char>();
+            uploading = false;
+            loads++;
+        }
+    }
+
+    void run() {
+        while (true) {
+            Decoded skin;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this] { return !running || (!requests.empty() && decoded.size() < SKIN_DECODED_MAX); });
+                if (!running)
+                    return;
+                skin.skin = requests.front();
+                requests.pop_front();
+            }
+            decode(skin);
+            std::lock_guard<std::mutex> lock(mutex);
+            decoded.push_back(std::move(skin));
+        }
+    }
+
+    // part images resampled to the slot size, then box filtered down to 1 x 1
+    bool decode(Decoded& skin) const {
+        skin.pixels.resize(slotBytes);
+        skin.ok = true;
+        size_t offset = 0;
+        for (unsigned int part = 0; part < NUM_PARTS; part++) {
+            std::string path = dirs[skin.skin] + "/" + std::to_string(part) + ".png";
+            int width, height, channels;
+            unsigned char* image = stbi_load(path.c_str(), &width, &height, &channels, 4);
+            if (image == NULL) {
+                std::cout << "ERROR::SKINCACHE::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+                skin.ok = false;
+                return false;
+            }
+            unsigned char* level = &skin.pixels[offset];
+            resample(image, width, height, level, size);
+            stbi_image_free(image);
+            offset += (size_t)size * size * 4;
+            for (int l = 1; l < levels; l++) {
+                unsigned char* next = &skin.pixels[offset];
+                halve(level, levelSize(l - 1), next, levelSize(l));
+                level = next;
+                offset += (size_t)levelSize(l) * levelSize(l) * 4;
+            }
+        }
+        return true;
+    }
+
+    // bilinear, texel centers of the source stretched over the square
+    static void resample(const unsigned char* src, int width, int height, unsigned char* dst, int size) {
+        for (int y = 0; y < size; y++) {
+            float sy = std::max(0.0f, (y + 0.5f) * height / size - 0.5f);
+            int y0 = std::min((int)sy, height - 1), y1 = std::min(y0 + 1, height - 1);
+            float fy = sy - y0;
+            for (int x = 0; x < size; x++) {
+                float sx = std::max(0.0f, (x + 0.5f) * width / size - 0.5f);
+                int x0 = std::min((int)sx, width - 1), x1 = std::min(x0 + 1, width - 1);
+                float fx = sx - x0;
+                for (int c = 0; c < 4; c++) {
+                    float top = src[(y0 * width + x0) * 4 + c] * (1 - fx) + src[(y0 * width + x1) * 4 + c] * fx;
+                    float bottom = src[(y1 * width + x0) * 4 + c] * (1 - fx) + src[(y1 * width + x1) * 4 + c] * fx;
+                    dst[(y * size + x) * 4 + c] = (unsigned char)(top * (1 - fy) + bottom * fy + 0.5f);
+                }
+            }
+        }
+    }
+
+    static void halve(const unsigned char* src, int srcSize, unsigned char* dst, int dstSize) {
+        for (int y = 0; y < dstSize; y++) {
+            int y0 = std::min(2 * y, srcSize - 1), y1 = std::min(2 * y + 1, srcSize - 1);
+            for (int x = 0; x < dstSize; x++) {
+                int x0 = std::min(2 * x, srcSize - 1), x1 = std::min(2 * x + 1, srcSize - 1);
+                for (int c = 0; c < 4; c++)
+                    dst[(y * dstSize + x) * 4 + c] = (src[(y0 * srcSize + x0) * 4 + c] + src[(y0 * srcSize + x1) * 4 + c] +
+                                                      src[(y1 * srcSize + x0) * 4 + c] + src[(y1 * srcSize + x1) * 4 + c] + 2) / 4;
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,346 @@
+#ifndef SKINNEDMESH
+#define SKINNEDMESH
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <openpose/headers.hpp>
+
+#include "avatar.h"
+#include "limbtransform.h"
+#include "partmesh.h"
+
+// bones of the skinned avatar, the limbs of limbMap then the head, one per part texture
+const int SKIN_BONES = NUM_PARTS;
+// bones blended per vertex
+const int SKIN_INFLUENCES = 4;
+// rest pose vertices within this many limb widths of a shared joint blend into the neighbouring bone
+const float SKIN_BLEND_RADIUS = 1.5f;
+// floats per bone in the skin transform buffer, two RGBA texels
+const int SKIN_BONE_FLOATS = 8;
+
+// rest pose of the generated mesh, BODY_25 joints 0 - 14 in view units,
+// sized for LIMB_WIDTH and FACE_RADIUS
+const float skinRestJoints[15][2] = {  {0.0f, -90.0f},     // nose
+                                       {0.0f, 0.0f},       // neck
+                                       {-110.0f, 15.0f},   // R shoulder
+                                       {-140.0f, 215.0f},  // R elbow
+                                       {-160.0f, 410.0f},  // R wrist
+                                       {110.0f, 15.0f},    // L shoulder
+                                       {140.0f, 215.0f},   // L elbow
+                                       {160.0f, 410.0f},   // L wrist
+                                       {0.0f, 400.0f},     // mid hip
+                                       {-55.0f, 400.0f},   // R hip
+                                       {-60.0f, 650.0f},   // R knee
+                                       {-65.0f, 900.0f},   // R ankle
+                                       {55.0f, 400.0f},    // L hip
+                                       {60.0f, 650.0f},    // L knee
+                                       {65.0f, 900.0f}};   // L ankle
+
+// joints shared by two bones of the generated mesh: part, joint, neighbouring part
+// limbs blend into their neighbours at the elbows and knees, and into the torso at the
+// shoulders and hips; the torso and head stay rigid
+const int skinBlendMap[12][3] = {  {2, 3, 3}, {3, 3, 2},     // R elbow
+                                   {4, 6, 5}, {5, 6, 4},     // L elbow
+                                   {6, 10, 7}, {7, 10, 6},   // R knee
+                                   {8, 13, 9}, {9, 13, 8},   // L knee
+                                   {2, 2, 0}, {4, 5, 0},     // shoulders
+                                   {6, 9, 0}, {8, 12, 0}};   // hips
+
+// vertex of the skinned mesh, bones[0] is the part it is textured with
+struct SkinVertex {
+    float position[2];
+    float texel[2];
+    unsigned char bones[SKIN_INFLUENCES];
+    float weights[SKIN_INFLUENCES];
+};
+
+
+// one mesh for the whole avatar, deformed on the GPU by linear blend skinning
+// vertices are in rest pose view coords, texels in the part texture, (0, 0) top left
+// every bone has a rest transform, the unit square of its part in the rest pose, so a
+// vertex weighted fully to its own bone lands exactly where the instanced renderer puts it
+// and vertices near a joint follow both limbs meeting there instead of leaving a gap
+// per frame only the SKIN_BONES transforms of every person are computed, whatever the
+// resolution of the mesh
+class SkinnedMesh {
+public:
+    std::vector<SkinVertex> vertices;
+    std::vector<unsigned int> indices;
+    // rest pose transform of every bone, the unit square of its part in rest view coords
+    std::vector<LimbInstance> rest;
+
+    // grid of columns cells along every limb, and columns / 4 across, over the rest pose of
+    // the parts, cells outside the traced outlines are left out
+    void build(const PartMeshes& outlines, int columns) {
+        columns = std::max(columns, 1);
+        int rows = std::max(columns / 4, 1);
+        vertices.clear();
+        indices.clear();
+        rest.resize(SKIN_BONES);
+
+        LimbBatch batch;
+        for (int l = 0; l < SKIN_BONES - 1; l++) {
+            const float* j1 = skinRestJoints[limbMap[l][0]];
+            const float* j2 = skinRestJoints[limbMap[l][1]];
+            // make torso wider
+            batch.add(0, l, j1[0], j1[1], j2[0], j2[1], (l == 0 || l == 1) ? LIMB_WIDTH * 2 : LIMB_WIDTH);
+        }
+        batch.compute();
+        for (int l = 0; l < SKIN_BONES - 1; l++)
+            rest[l] = batch.instance(l, l);
+        rest[HEAD_PART] = headInstance(skinRestJoints[0][0], skinRestJoints[0][1], FACE_RADIUS);
+
+        for (int part = 0; part < SKIN_BONES; part++) {
+            bool head = part == (int)HEAD_PART;
+            grid(part, head ? 1 : columns, head ? 1 : rows, outlines);
+        }
+        invertRest();
+    }
+
+    // text format: SKINMESH bones vertices triangles, one line per bone with its rest
+    // transform axisX axisY offset, one per vertex with x y u v, the bones and their weights,
+    // one per triangle with its vertex indices
+    bool load(const std::string& path) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            std::cout << "ERROR::SKINNEDMESH::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+            return false;
+        }
+        std::string magic;
+        int bones, count, triangles;
+        if (!(file >> magic >> bones >> count >> triangles) || magic != "SKINMESH" ||
+            bones != SKIN_BONES || count <= 0 || triangles <= 0) {
+            std::cout << "ERROR::SKINNEDMESH::INVALID_HEADER " << path << std::endl;
+            return false;
+        }
+        rest.resize(bones);
+        for (int b = 0; b < bones; b++) {
+            LimbInstance& r = rest[b];
+            r.layer = b;
+            if (!(file >> r.axisX[0] >> r.axisX[1] >> r.axisY[0] >> r.axisY[1] >> r.offset[0] >> r.offset[1]) ||
+                r.axisX[0] * r.axisY[1] - r.axisY[0] * r.axisX[1] == 0.0f) {
+                std::cout << "ERROR::SKINNEDMESH::INVALID_BONE " << b << " " << path << std::endl;
+                return false;
+            }
+        }
+        vertices.resize(count);
+        for (int v = 0; v < count; v++) {
+            SkinVertex& vertex = vertices[v];
+            if (!(file >> vertex.position[0] >> vertex.position[1] >> vertex.texel[0] >> vertex.texel[1])) {
+                std::cout << "ERROR::SKINNEDMESH::INVALID_VERTEX " << v << " " << path << std::endl;
+                return false;
+            }
+            float total = 0.0f;
+            for (int i = 0; i < SKIN_INFLUENCES; i++) {
+                int bone;
+                if (!(file >> bone) || bone < 0 || bone >= bones) {
+                    std::cout << "ERROR::SKINNEDMESH::INVALID_VERTEX " << v << " " << path << std::endl;
+                    return false;
+                }
+                vertex.bones[i] = bone;
+            }
+            for (int i = 0; i < SKIN_INFLUENCES; i++) {
+                file >> vertex.weights[i];
+                total += vertex.weights[i];
+            }
+            // the shader blends with normalized weights
+            if (!file || total <= 0.0f) {
+                std::cout << "ERROR::SKINNEDMESH::INVALID_VERTEX " << v << " " << path << std::endl;
+                return false;
+            }
+            for (int i = 0; i < SKIN_INFLUENCES; i++)
+                vertex.weights[i] /= total;
+        }
+        indices.resize(triangles * 3);
+        for (size_t i = 0; i < indices.size(); i++) {
+            if (!(file >> indices[i]) || indices[i] >= vertices.size()) {
+                std::cout << "ERROR::SKINNEDMESH::INVALID_TRIANGLE " << i / 3 << " " << path << std::endl;
+                return false;
+            }
+        }
+        invertRest();
+        return true;
+    }
+
+    bool save(const std::string& path) const {
+        std::ofstream file(path);
+        if (!file.is_open()) {
+            std::cout << "ERROR::SKINNEDMESH::FILE_NOT_WRITTEN " << path << std::endl;
+            return false;
+        }
+        file.precision(9);
+        file << "SKINMESH " << rest.size() << " " << vertices.size() << " " << indices.size() / 3 << "\n";
+        for (size_t b = 0; b < rest.size(); b++) {
+            const LimbInstance& r = rest[b];
+            file << r.axisX[0] << " " << r.axisX[1] << " " << r.axisY[0] << " " << r.axisY[1] << " "
+                 << r.offset[0] << " " << r.offset[1] << "\n";
+        }
+        for (size_t v = 0; v < vertices.size(); v++) {
+            const SkinVertex& vertex = vertices[v];
+            file << vertex.position[0] << " " << vertex.position[1] << " " << vertex.texel[0] << " " << vertex.texel[1];
+            for (int i = 0; i < SKIN_INFLUENCES; i++)
+                file << " " << (int)vertex.bones[i];
+            for (int i = 0; i < SKIN_INFLUENCES; i++)
+                file << " " << vertex.weights[i];
+            file << "\n";
+        }
+        for (size_t i = 0; i < indices.size(); i += 3)
+            file << indices[i] << " " << indices[i + 1] << " " << indices[i + 2] << "\n";
+        return true;
+    }
+
+    // skin transforms of every person for the vertex shader, SKIN_BONE_FLOATS per bone:
+    // the 2x2 matrix by columns, then the translation, 1 when the bone was detected and 0
+    // otherwise; the current pose of a bone is its part transform in the instanced renderer
+    void skin(const op::Array<float>& keypoints, LimbBatch& batch, std::vector<float>& transforms) const {
+        int people = keypoints.getSize(0);
+        transforms.assign((size_t)people * SKIN_BONES * SKIN_BONE_FLOATS, 0.0f);
+        batch.clear();
+        for (int p = 0; p < people; p++) {
+            float faceRadius, limbWidth;
+            avatarScale(keypoints, p, faceRadius, limbWidth);
+            for (int l = 0; l < SKIN_BONES - 1; l++) {
+                int idx1 = limbMap[l][0];
+                int idx2 = limbMap[l][1];
+                if (keypoints[{p, idx1, 2}] == 0 || keypoints[{p, idx2, 2}] == 0)
+                    continue;
+                // make torso wider
+                float width = (l == 0 || l == 1) ? limbWidth * 2 : limbWidth;
+                batch.add(p, l, keypoints[{p, idx1, 0}], keypoints[{p, idx1, 1}],
+                          keypoints[{p, idx2, 0}], keypoints[{p, idx2, 1}], width);
+            }
+            if (keypoints[{p, 0, 2}] != 0)
+                compose(headInstance(keypoints[{p, 0, 0}], keypoints[{p, 0, 1}], faceRadius), HEAD_PART,
+                        &transforms[((size_t)p * SKIN_BONES + HEAD_PART) * SKIN_BONE_FLOATS]);
+        }
+        batch.compute();
+        for (size_t i = 0; i < batch.size(); i++)
+            compose(batch.instance(i, batch.limb[i]), batch.limb[i],
+                    &transforms[((size_t)batch.person[i] * SKIN_BONES + batch.limb[i]) * SKIN_BONE_FLOATS]);
+    }
+
+private:
+    // inverse of the rest matrix of every bone, by columns
+    std::vector<float> restInverse;
+
+    void invertRest() {
+        restInverse.resize(rest.size() * 4);
+        for (size_t b = 0; b < rest.size(); b++) {
+            const LimbInstance& r = rest[b];
+            float det = r.axisX[0] * r.axisY[1] - r.axisY[0] * r.axisX[1];
+            restInverse[b * 4] = r.axisY[1] / det;
+            restInverse[b * 4 + 1] = -r.axisX[1] / det;
+            restInverse[b * 4 + 2] = -r.axisY[0] / det;
+            restInverse[b * 4 + 3] = r.axisX[0] / det;
+        }
+    }
+
+    // current part transform after the inverse rest transform of the bone, rest view
+    // coords to current view coords
+    void compose(const LimbInstance& current, int bone, float* out) const {
+        const float* inv = &restInverse[bone * 4];
+        const LimbInstance& r = rest[bone];
+        float m0 = current.axisX[0] * inv[0] + current.axisY[0] * inv[1];
+        float m1 = current.axisX[1] * inv[0] + current.axisY[1] * inv[1];
+        float m2 = current.axisX[0] * inv[2] + current.axisY[0] * inv[3];
+        float m3 = current.axisX[1] * inv[2] + current.axisY[1] * inv[3];
+        out[0] = m0;
+        out[1] = m1;
+        out[2] = m2;
+        out[3] = m3;
+        out[4] = current.offset[0] - (m0 * r.offset[0] + m2 * r.offset[1]);
+        out[5] = current.offset[1] - (m1 * r.offset[0] + m3 * r.offset[1]);
+        out[6] = 1.0f;
+        out[7] = 0.0f;
+    }
+
+    // true when the cell of texels (u0, v0) - (u1, v1) lies entirely outside one edge of
+    // the convex outline of the part
+    static bool outside(const PartMeshes& outlines, int part, float u0, float v0, float u1, float v1) {
+        const float* outline = &outlines.vertices[part * PART_MESH_VERTS * 2];
+        // outlines are wound either way, the signed area tells which side is inside
+        float area = 0.0f;
+        for (int i = 0; i < PART_MESH_VERTS; i++) {
+            int j = (i + 1) % PART_MESH_VERTS;
+            area += outline[i * 2] * outline[j * 2 + 1] - outline[j * 2] * outline[i * 2 + 1];
+        }
+        if (area == 0.0f)
+            return false;
+        const float corners[4][2] = {{u0, v0}, {u1, v0}, {u0, v1}, {u1, v1}};
+        for (int i = 0; i < PART_MESH_VERTS; i++) {
+            int j = (i + 1) % PART_MESH_VERTS;
+            float ex = outline[j * 2] - outline[i * 2], ey = outline[j * 2 + 1] - outline[i * 2 + 1];
+            if (ex == 0.0f && ey == 0.0f)
+                continue;
+            bool separated = true;
+            for (int c = 0; c < 4 && separated; c++) {
+                float side = ex * (corners[c][1] - outline[i * 2 + 1]) - ey * (corners[c][0] - outline[i * 2]);
+                separated = side * area < 0.0f;
+            }
+            if (separated)
+                return true;
+        }
+        return false;
+    }
+
+    // blended bones of a rest pose position on part
+    static void weigh(int part, float x, float y, SkinVertex& vertex) {
+        for (int i = 0; i < SKIN_INFLUENCES; i++) {
+            vertex.bones[i] = part;
+            vertex.weights[i] = 0.0f;
+        }
+        float own = 1.0f;
+        int used = 1;
+        for (unsigned int b = 0; b < sizeof(skinBlendMap) / sizeof(skinBlendMap[0]) && used < SKIN_INFLUENCES; b++) {
+            if (skinBlendMap[b][0] != part)
+                continue;
+            const float* joint = skinRestJoints[skinBlendMap[b][1]];
+            float distance = std::sqrt((x - joint[0]) * (x - joint[0]) + (y - joint[1]) * (y - joint[1]));
+            // half and half at the joint, fading out over the blend radius
+            float weight = 0.5f * std::max(0.0f, 1.0f - distance / (SKIN_BLEND_RADIUS * LIMB_WIDTH));
+            if (weight <= 0.0f)
+                continue;
+            vertex.bones[used] = skinBlendMap[b][2];
+            vertex.weights[used++] = weight;
+            own -= weight;
+        }
+        vertex.weights[0] = own;
+    }
+
+    // columns x rows cells over the unit square of part, in the layout of the instanced
+    // renderer: texel (s, 1 - t) at unit square position (s, t)
+    void grid(int part, int columns, int rows, const PartMeshes& outlines) {
+        const LimbInstance& r = rest[part];
+        unsigned int base = vertices.size();
+        for (int j = 0; j <= rows; j++) {
+            for (int i = 0; i <= columns; i++) {
+                float s = i / (float)columns, t = j / (float)rows;
+                SkinVertex vertex;
+                vertex.position[0] = r.offset[0] + r.axisX[0] * s + r.axisY[0] * t;
+                vertex.position[1] = r.offset[1] + r.axisX[1] * s + r.axisY[1] * t;
+                vertex.texel[0] = s;
+                vertex.texel[1] = 1.0f - t;
+                weigh(part, vertex.position[0], vertex.position[1], vertex);
+                vertices.push_back(vertex);
+            }
+        }
+        for (int j = 0; j < rows; j++) {
+            for (int i = 0; i < columns; i++) {
+                float s0 = i / (float)columns, s1 = (i + 1) / (float)columns;
+                float t0 = j / (float)rows, t1 = (j + 1) / (float)rows;
+                if (!outlines.vertices.empty() && outside(outlines, part, s0, 1.0f - t1, s1, 1.0f - t0))
+                    continue;
+                unsigned int v00 = base + j * (columns + 1) + i, v10 = v00 + 1;
+                unsigned int v01 = v00 + columns + 1, v11 = v01 + 1;
+                indices.insert(indices.end(), {v00, v10, v11, v00, v11, v01});
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef TEXTUREARRAY
+#define TEXTUREARRAY
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "stb_image.h"
+
+
+// avatar part textures packed into the layers of one GL_TEXTURE_2D_ARRAY
+// parts of different sizes are padded into the largest one at the layer origin,
+// uvScale[2 * layer] and uvScale[2 * layer + 1] map the unit quad onto the part
+class PartTextureArray {
+public:
+    unsigned int ID = 0;
+    int width = 0;
+    int height = 0;
+    int layers = 0;
+    std::vector<GLfloat> uvScale;
+
+    bool load(const std::vector<std::string>& paths) {
+        std::vector<unsigned char*> images(paths.size());
+        std::vector<int> sizes(2 * paths.size());
+        width = height = 0;
+        bool ok = true;
+        for (size_t i = 0; i < paths.size(); i++) {
+            int channels;
+            images[i] = stbi_load(paths[i].c_str(), &sizes[2 * i], &sizes[2 * i + 1], &channels, 4);
+            if (images[i] == NULL) {
+                std::cout << "ERROR::TEXTUREARRAY::FILE_NOT_SUCCESFULLY_READ " << paths[i] << std::endl;
+                ok = false;
+                continue;
+            }
+            width = std::max(width, sizes[2 * i]);
+            height = std::max(height, sizes[2 * i + 1]);
+        }
+
+        if (ok) {
+            layers = paths.size();
+            uvScale.resize(2 * layers);
+            glGenTextures(1, &ID);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, ID);
+            // transparent padding around smaller parts
+            std::vector<unsigned char> clear((size_t)width * height * layers * 4, 0);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, clear.data());
+            for (int i = 0; i < layers; i++) {
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, sizes[2 * i], sizes[2 * i + 1], 1,
+                                GL_RGBA, GL_UNSIGNED_BYTE, images[i]);
+                uvScale[2 * i] = sizes[2 * i] / (GLfloat)width;
+                uvScale[2 * i + 1] = sizes[2 * i + 1] / (GLfloat)height;
+            }
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        }
+
+        for (size_t i = 0; i < images.size(); i++) {
+            if (images[i] != NULL)
+                stbi_image_free(images[i]);
+        }
+        return ok;
+    }
+
+    void free() {
+        glDeleteTextures(1, &ID);
+        ID = 0;
+    }
+};
+
+#endif
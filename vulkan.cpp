@@ -0,0 +1,104 @@
+// stb_image implementation in this file only, the headers include stb_image.h again
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#undef STB_IMAGE_IMPLEMENTATION
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <opencv2/opencv.hpp>
+#include <openpose/headers.hpp>
+
+#include "avatar.h"
+#include "limbtransform.h"
+#include "partmesh.h"
+#include "posestream.h"
+#include "vulkanrenderer.h"
+
+
+DEFINE_string(video, "", "Read frames from a video file instead of the camera, stops at its end");
+DEFINE_string(output, "", "Write the rendered frames to this video file, without it frames are not read back");
+DEFINE_int32(width, DISPLAY_WIDTH, "Width of the rendered frames");
+DEFINE_int32(height, DISPLAY_HEIGHT, "Height of the rendered frames");
+DEFINE_double(output_fps, 30.0, "Frame rate written to the output");
+DEFINE_string(device, "", "Use the first Vulkan device whose name contains this, llvmpipe for lavapipe");
+DEFINE_bool(validation, false, "Enable the Vulkan validation layer");
+DEFINE_bool(part_meshes, true, "Draw avatar parts as tight outlines traced from their alpha channel instead of full quads");
+
+// the avatar of main.bin's instanced renderer drawn with Vulkan, offscreen, with the
+// per-frame CPU cost printed for comparison against main.bin --headless --stats
+int main(int argc, char* argv[]) {
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+    cv::VideoCapture cam;
+    if (FLAGS_video.empty())
+        cam.open(0);
+    else
+        cam.open(FLAGS_video);
+    if (!cam.isOpened()) {
+        std::cout << "Cannot open " << (FLAGS_video.empty() ? "camera" : FLAGS_video) << std::endl;
+        return -1;
+    }
+
+    std::vector<std::string> partPaths;
+    for (unsigned int i = 0; i < NUM_PARTS; i++)
+        partPaths.push_back("../textures/avatar/" + std::to_string(i) + ".png");
+    PartMeshes partMeshes;
+    if (!FLAGS_part_meshes || !partMeshes.load(partPaths, "avatar_parts.mesh"))
+        partMeshes.quads(NUM_PARTS);
+
+    cv::VideoWriter writer;
+    if (!FLAGS_output.empty()) {
+        writer.open(FLAGS_output, CV_FOURCC('m', 'p', '4', 'v'), FLAGS_output_fps, cv::Size(FLAGS_width, FLAGS_height));
+        if (!writer.isOpened()) {
+            std::cout << "ERROR::VULKAN::FILE_NOT_OPENED " << FLAGS_output << std::endl;
+            return -1;
+        }
+    }
+
+    // SPIR-V shaders are compiled into the build directory
+    VulkanRenderer renderer;
+    if (!renderer.create(FLAGS_width, FLAGS_height, FLAGS_device, FLAGS_validation, writer.isOpened(),
+                         partPaths, partMeshes, "shaders/")) {
+        renderer.destroy();
+        return -1;
+    }
+
+    op::Wrapper opWrapper{op::ThreadManagerMode::Asynchronous};
+    opWrapper.start();
+    PoseStream poseStream(cam, opWrapper, false, cam.get(CV_CAP_PROP_FRAME_HEIGHT));
+    poseStream.start();
+
+    LimbBatch limbBatch;
+    std::vector<LimbInstance> instances;
+    cv::Mat frame;
+    unsigned int frames = 0;
+    while (!poseStream.finished()) {
+        PoseSample sample;
+        if (!poseStream.take(sample)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        avatarInstances(sample.keypoints, limbBatch, instances, VULKAN_MAX_INSTANCES);
+        if (renderer.render(instances, &frame))
+            writer.write(frame);
+
+        if (++frames == 120) {
+            renderer.report();
+            frames = 0;
+        }
+    }
+    while (renderer.drain(&frame))
+        writer.write(frame);
+
+    poseStream.stop();
+    renderer.destroy();
+    cam.release();
+    writer.release();
+    return 0;
+}
@@ -0,0 +1,864 @@
+#ifndef VULKANRENDERER
+#define VULKANRENDERER
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+#include <vulkan/vulkan.h>
+
+#include "avatar.h"
+#include "limbtransform.h"
+#include "partmesh.h"
+#include "stb_image.h"
+
+// frames the GPU may be rendering while the CPU prepares the next one, each has its own
+// target, readback buffer and command buffers
+const int VULKAN_FRAMES_IN_FLIGHT = 2;
+// instances per frame, the range of a uniform buffer binding is only guaranteed to 16 KB
+const int VULKAN_MAX_INSTANCES = 512;
+// two vec4 per instance, as laid out by vkinstanced.vert
+const VkDeviceSize VULKAN_INSTANCE_BYTES = VULKAN_MAX_INSTANCES * 8 * sizeof(float);
+
+
+// the instanced avatar renderer on Vulkan, headless into an offscreen target
+// every command buffer is recorded once at creation: per frame slot, a secondary command
+// buffer draws all instances with one indirect draw, and a primary one runs it in the
+// render pass and copies the target to a readback buffer; a frame only writes its
+// instances and draw count into the slot's region of a mapped dynamic uniform buffer
+// and submits, so no commands are recorded in the render loop at all
+// runs on any Vulkan 1.0 device, including Mesa's lavapipe without a GPU
+class VulkanRenderer {
+public:
+    int width = 0;
+    int height = 0;
+
+    // deviceName picks the first device whose name contains it, empty takes the first one;
+    // without readback the frames are rendered but never copied back to the CPU
+    bool create(int w, int h, const std::string& deviceName, bool validation, bool readback,
+                const std::vector<std::string>& partPaths, const PartMeshes& meshes, const std::string& shaderDir) {
+        width = w;
+        height = h;
+        copyBack = readback;
+        return createDevice(deviceName, validation) &&
+               createTargets() &&
+               loadParts(partPaths, meshes) &&
+               createPipeline(shaderDir + "vkinstanced.vert.spv", shaderDir + "vkinstanced.frag.spv") &&
+               recordCommands();
+    }
+
+    // draw instances into the next frame slot; finished receives the frame previously
+    // rendered in that slot, VULKAN_FRAMES_IN_FLIGHT frames ago, true if there was one
+    bool render(const std::vector<LimbInstance>& instances, cv::Mat* finished) {
+        Frame& frame = frames[next];
+        bool done = frame.pending && wait(frame, finished);
+
+        auto start = std::chrono::steady_clock::now();
+        float* data = (float*)((char*)frameData + next * frameStride);
+        size_t count = std::min(instances.size(), (size_t)VULKAN_MAX_INSTANCES);
+        for (size_t i = 0; i < count; i++, data += 8) {
+            const LimbInstance& instance = instances[i];
+            data[0] = instance.axisX[0];
+            data[1] = instance.axisX[1];
+            data[2] = instance.axisY[0];
+            data[3] = instance.axisY[1];
+            data[4] = instance.offset[0];
+            data[5] = instance.offset[1];
+            data[6] = instance.layer;
+            data[7] = 0.0f;
+        }
+        VkDrawIndirectCommand* draw = (VkDrawIndirectCommand*)((char*)frameData + next * frameStride + VULKAN_INSTANCE_BYTES);
+        draw->vertexCount = PART_MESH_VERTS;
+        draw->instanceCount = count;
+        draw->firstVertex = 0;
+        draw->firstInstance = 0;
+
+        VkSubmitInfo submit = {};
+        submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit.commandBufferCount = 1;
+        submit.pCommandBuffers = &frame.primary;
+        VkResult result = vkQueueSubmit(queue, 1, &submit, frame.fence);
+        frame.pending = result == VK_SUCCESS;
+        submitTime += std::chrono::steady_clock::now() - start;
+        frameCount++;
+        if (!frame.pending)
+            std::cout << "ERROR::VULKAN::SUBMIT_FAILED " << result << std::endl;
+
+        next = (next + 1) % VULKAN_FRAMES_IN_FLIGHT;
+        return done;
+    }
+
+    // the frames still in flight, oldest first, false once all are returned
+    bool drain(cv::Mat* finished) {
+        for (int i = 0; i < VULKAN_FRAMES_IN_FLIGHT; i++) {
+            Frame& frame = frames[(next + i) % VULKAN_FRAMES_IN_FLIGHT];
+            if (frame.pending)
+                return wait(frame, finished);
+        }
+        return false;
+    }
+
+    // CPU time per frame preparing and submitting, waiting for the GPU and reading back
+    void report() {
+        if (frameCount == 0)
+            return;
+        std::cout << "vulkan: " << submitTime.count() / frameCount << " ms render CPU, "
+                  << waitTime.count() / frameCount << " ms fence wait, "
+                  << readbackTime.count() / frameCount << " ms readback per frame" << std::endl;
+        frameCount = 0;
+        submitTime = waitTime = readbackTime = std::chrono::duration<double, std::milli>::zero();
+    }
+
+    void destroy() {
+        if (device != VK_NULL_HANDLE) {
+            vkDeviceWaitIdle(device);
+            for (int i = 0; i < VULKAN_FRAMES_IN_FLIGHT; i++) {
+                Frame& frame = frames[i];
+                vkDestroyFence(device, frame.fence, NULL);
+                vkDestroyFramebuffer(device, frame.framebuffer, NULL);
+                vkDestroyImageView(device, frame.view, NULL);
+                vkDestroyImage(device, frame.image, NULL);
+                vkFreeMemory(device, frame.memory, NULL);
+                vkDestroyBuffer(device, frame.readback, NULL);
+                vkFreeMemory(device, frame.readbackMemory, NULL);
+            }
+            vkDestroyPipeline(device, pipeline, NULL);
+            vkDestroyPipelineLayout(device, pipelineLayout, NULL);
+            vkDestroyDescriptorPool(device, descriptorPool, NULL);
+            vkDestroyDescriptorSetLayout(device, descriptorSetLayout, NULL);
+            vkDestroySampler(device, sampler, NULL);
+            vkDestroyImageView(device, partView, NULL);
+            vkDestroyImage(device, partImage, NULL);
+            vkFreeMemory(device, partMemory, NULL);
+            vkDestroyBuffer(device, partBuffer, NULL);
+            vkFreeMemory(device, partBufferMemory, NULL);
+            vkDestroyBuffer(device, frameBuffer, NULL);
+            vkFreeMemory(device, frameMemory, NULL);
+            vkDestroyRenderPass(device, renderPass, NULL);
+            vkDestroyCommandPool(device, commandPool, NULL);
+            vkDestroyDevice(device, NULL);
+            device = VK_NULL_HANDLE;
+        }
+        if (instance != VK_NULL_HANDLE) {
+            vkDestroyInstance(instance, NULL);
+            instance = VK_NULL_HANDLE;
+        }
+    }
+
+private:
+    struct Frame {
+        VkImage image = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkFramebuffer framebuffer = VK_NULL_HANDLE;
+        VkBuffer readback = VK_NULL_HANDLE;
+        VkDeviceMemory readbackMemory = VK_NULL_HANDLE;
+        void* readbackData = NULL;
+        VkCommandBuffer primary = VK_NULL_HANDLE;
+        VkCommandBuffer secondary = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        bool pending = false;
+    };
+
+    VkInstance instance = VK_NULL_HANDLE;
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    VkDevice device = VK_NULL_HANDLE;
+    uint32_t queueFamily = 0;
+    VkQueue queue = VK_NULL_HANDLE;
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+
+    Frame frames[VULKAN_FRAMES_IN_FLIGHT];
+    int next = 0;
+    bool copyBack = true;
+
+    // instances and indirect draw of every frame slot, persistently mapped
+    VkBuffer frameBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory frameMemory = VK_NULL_HANDLE;
+    void* frameData = NULL;
+    VkDeviceSize frameStride = 0;
+
+    // part texture array, and the part outlines and scales
+    VkImage partImage = VK_NULL_HANDLE;
+    VkDeviceMemory partMemory = VK_NULL_HANDLE;
+    VkImageView partView = VK_NULL_HANDLE;
+    VkSampler sampler = VK_NULL_HANDLE;
+    VkBuffer partBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory partBufferMemory = VK_NULL_HANDLE;
+
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+
+    unsigned int frameCount = 0;
+    std::chrono::duration<double, std::milli> submitTime = std::chrono::duration<double, std::milli>::zero();
+    std::chrono::duration<double, std::milli> waitTime = std::chrono::duration<double, std::milli>::zero();
+    std::chrono::duration<double, std::milli> readbackTime = std::chrono::duration<double, std::milli>::zero();
+
+    static bool check(VkResult result, const char* what) {
+        if (result != VK_SUCCESS)
+            std::cout << "ERROR::VULKAN::" << what << " " << result << std::endl;
+        return result == VK_SUCCESS;
+    }
+
+    // wait for a frame slot and copy its target out, BGRA to BGR
+    bool wait(Frame& frame, cv::Mat* finished) {
+        auto start = std::chrono::steady_clock::now();
+        vkWaitForFences(device, 1, &frame.fence, VK_TRUE, UINT64_MAX);
+        vkResetFences(device, 1, &frame.fence);
+        frame.pending = false;
+        auto waited = std::chrono::steady_clock::now();
+        waitTime += waited - start;
+        if (!copyBack || finished == NULL)
+            return false;
+        cv::Mat bgra(height, width, CV_8UC4, frame.readbackData);
+        cv::cvtColor(bgra, *finished, cv::COLOR_BGRA2BGR);
+        readbackTime += std::chrono::steady_clock::now() - waited;
+        return true;
+    }
+
+    bool createDevice(const std::string& deviceName, bool validation) {
+        VkApplicationInfo app = {};
+        app.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        app.pApplicationName = "Morpheus";
+        app.apiVersion = VK_API_VERSION_1_0;
+
+        // the validation layer only when asked for, it costs as much CPU as GL's own checks
+        const char* layer = "VK_LAYER_KHRONOS_validation";
+        VkInstanceCreateInfo instanceInfo = {};
+        instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        instanceInfo.pApplicationInfo = &app;
+        if (validation) {
+            instanceInfo.enabledLayerCount = 1;
+            instanceInfo.ppEnabledLayerNames = &layer;
+        }
+        if (!check(vkCreateInstance(&instanceInfo, NULL, &instance), "INSTANCE_NOT_CREATED"))
+            return false;
+
+        uint32_t count = 0;
+        vkEnumeratePhysicalDevices(instance, &count, NULL);
+        std::vector<VkPhysicalDevice> devices(count);
+        vkEnumeratePhysicalDevices(instance, &count, devices.data());
+        for (uint32_t i = 0; i < count && physicalDevice == VK_NULL_HANDLE; i++) {
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(devices[i], &properties);
+            if (std::string(properties.deviceName).find(deviceName) == std::string::npos)
+                continue;
+            uint32_t families = 0;
+            vkGetPhysicalDeviceQueueFamilyProperties(devices[i], &families, NULL);
+            std::vector<VkQueueFamilyProperties> familyProperties(families);
+            vkGetPhysicalDeviceQueueFamilyProperties(devices[i], &families, familyProperties.data());
+            for (uint32_t f = 0; f < families; f++) {
+                if (familyProperties[f].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+                    physicalDevice = devices[i];
+                    queueFamily = f;
+                    std::cout << "Vulkan device: " << properties.deviceName << std::endl;
+                    break;
+                }
+            }
+        }
+        if (physicalDevice == VK_NULL_HANDLE) {
+            std::cout << "No Vulkan device with graphics" << (deviceName.empty() ? "" : " named " + deviceName) << std::endl;
+            return false;
+        }
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+        float priority = 1.0f;
+        VkDeviceQueueCreateInfo queueInfo = {};
+        queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueInfo.queueFamilyIndex = queueFamily;
+        queueInfo.queueCount = 1;
+        queueInfo.pQueuePriorities = &priority;
+        VkDeviceCreateInfo deviceInfo = {};
+        deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        deviceInfo.queueCreateInfoCount = 1;
+        deviceInfo.pQueueCreateInfos = &queueInfo;
+        if (!check(vkCreateDevice(physicalDevice, &deviceInfo, NULL, &device), "DEVICE_NOT_CREATED"))
+            return false;
+        vkGetDeviceQueue(device, queueFamily, 0, &queue);
+
+        VkCommandPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.queueFamilyIndex = queueFamily;
+        return check(vkCreateCommandPool(device, &poolInfo, NULL, &commandPool), "COMMAND_POOL_NOT_CREATED");
+    }
+
+    // memory of a type allowed by the requirements with the wanted properties
+    bool allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, VkDeviceMemory& memory) {
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            if ((requirements.memoryTypeBits & (1u << i)) &&
+                (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                VkMemoryAllocateInfo info = {};
+                info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+                info.allocationSize = requirements.size;
+                info.memoryTypeIndex = i;
+                return check(vkAllocateMemory(device, &info, NULL, &memory), "MEMORY_NOT_ALLOCATED");
+            }
+        }
+        std::cout << "ERROR::VULKAN::NO_MEMORY_TYPE " << properties << std::endl;
+        return false;
+    }
+
+    // host visible buffers, mapped for their whole lifetime
+    bool createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& memory, void** data) {
+        VkBufferCreateInfo info = {};
+        info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        info.size = size;
+        info.usage = usage;
+        info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (!check(vkCreateBuffer(device, &info, NULL, &buffer), "BUFFER_NOT_CREATED"))
+            return false;
+        VkMemoryRequirements requirements;
+        vkGetBufferMemoryRequirements(device, buffer, &requirements);
+        // cached memory reads back faster, coherent memory needs no flushes
+        VkMemoryPropertyFlags coherent = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        bool cached = false;
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            VkMemoryPropertyFlags flags = memoryProperties.memoryTypes[i].propertyFlags;
+            if ((requirements.memoryTypeBits & (1u << i)) && (flags & coherent) == coherent && (flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT))
+                cached = true;
+        }
+        if (!allocate(requirements, cached ? coherent | VK_MEMORY_PROPERTY_HOST_CACHED_BIT : coherent, memory))
+            return false;
+        vkBindBufferMemory(device, buffer, memory, 0);
+        return check(vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, data), "MEMORY_NOT_MAPPED");
+    }
+
+    bool createImage(uint32_t w, uint32_t h, uint32_t mipLevels, uint32_t layers, VkFormat format, VkImageViewType viewType,
+                     VkImageUsageFlags usage, VkImage& image, VkDeviceMemory& memory, VkImageView& view) {
+        VkImageCreateInfo info = {};
+        info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        info.imageType = VK_IMAGE_TYPE_2D;
+        info.format = format;
+        info.extent.width = w;
+        info.extent.height = h;
+        info.extent.depth = 1;
+        info.mipLevels = mipLevels;
+        info.arrayLayers = layers;
+        info.samples = VK_SAMPLE_COUNT_1_BIT;
+        info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        info.usage = usage;
+        info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        if (!check(vkCreateImage(device, &info, NULL, &image), "IMAGE_NOT_CREATED"))
+            return false;
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(device, image, &requirements);
+        if (!allocate(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, memory))
+            return false;
+        vkBindImageMemory(device, image, memory, 0);
+
+        VkImageViewCreateInfo viewInfo = {};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = viewType;
+        viewInfo.format = format;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.levelCount = mipLevels;
+        viewInfo.subresourceRange.layerCount = layers;
+        return check(vkCreateImageView(device, &viewInfo, NULL, &view), "IMAGE_VIEW_NOT_CREATED");
+    }
+
+    static void imageBarrier(VkCommandBuffer commands, VkImage image, uint32_t level, uint32_t levels, uint32_t layers,
+                             VkImageLayout from, VkImageLayout to, VkAccessFlags srcAccess, VkAccessFlags dstAccess,
+                             VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage) {
+        VkImageMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = dstAccess;
+        barrier.oldLayout = from;
+        barrier.newLayout = to;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = level;
+        barrier.subresourceRange.levelCount = levels;
+        barrier.subresourceRange.layerCount = layers;
+        vkCmdPipelineBarrier(commands, srcStage, dstStage, 0, 0, NULL, 0, NULL, 1, &barrier);
+    }
+
+    // render pass clearing and drawing the target, left ready to be copied out, and the
+    // targets, readback buffers and instance data of every frame slot
+    bool createTargets() {
+        VkAttachmentDescription color = {};
+        color.format = VK_FORMAT_B8G8R8A8_UNORM;
+        color.samples = VK_SAMPLE_COUNT_1_BIT;
+        color.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        color.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        color.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        color.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        color.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        color.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        VkAttachmentReference colorRef = {0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+        VkSubpassDescription subpass = {};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = 1;
+        subpass.pColorAttachments = &colorRef;
+        // the previous copy out of the target finishes before it is cleared again, and
+        // the drawing before it is copied out
+        VkSubpassDependency dependencies[2] = {};
+        dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[0].dstSubpass = 0;
+        dependencies[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependencies[1].srcSubpass = 0;
+        dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        VkRenderPassCreateInfo passInfo = {};
+        passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        passInfo.attachmentCount = 1;
+        passInfo.pAttachments = &color;
+        passInfo.subpassCount = 1;
+        passInfo.pSubpasses = &subpass;
+        passInfo.dependencyCount = 2;
+        passInfo.pDependencies = dependencies;
+        if (!check(vkCreateRenderPass(device, &passInfo, NULL, &renderPass), "RENDER_PASS_NOT_CREATED"))
+            return false;
+
+        for (int i = 0; i < VULKAN_FRAMES_IN_FLIGHT; i++) {
+            Frame& frame = frames[i];
+            if (!createImage(width, height, 1, 1, VK_FORMAT_B8G8R8A8_UNORM, VK_IMAGE_VIEW_TYPE_2D,
+                             VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                             frame.image, frame.memory, frame.view))
+                return false;
+            VkFramebufferCreateInfo framebufferInfo = {};
+            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebufferInfo.renderPass = renderPass;
+            framebufferInfo.attachmentCount = 1;
+            framebufferInfo.pAttachments = &frame.view;
+            framebufferInfo.width = width;
+            framebufferInfo.height = height;
+            framebufferInfo.layers = 1;
+            if (!check(vkCreateFramebuffer(device, &framebufferInfo, NULL, &frame.framebuffer), "FRAMEBUFFER_NOT_CREATED"))
+                return false;
+            if (copyBack && !createBuffer((VkDeviceSize)width * height * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                          frame.readback, frame.readbackMemory, &frame.readbackData))
+                return false;
+            VkFenceCreateInfo fenceInfo = {};
+            fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+            if (!check(vkCreateFence(device, &fenceInfo, NULL, &frame.fence), "FENCE_NOT_CREATED"))
+                return false;
+        }
+
+        // the draw command follows the instances of each slot, slots start at dynamic offsets
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        VkDeviceSize alignment = std::max(properties.limits.minUniformBufferOffsetAlignment, (VkDeviceSize)16);
+        frameStride = (VULKAN_INSTANCE_BYTES + sizeof(VkDrawIndirectCommand) + alignment - 1) / alignment * alignment;
+        if (!createBuffer(frameStride * VULKAN_FRAMES_IN_FLIGHT,
+                          VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                          frameBuffer, frameMemory, &frameData))
+            return false;
+        memset(frameData, 0, frameStride * VULKAN_FRAMES_IN_FLIGHT);
+        return true;
+    }
+
+    // part textures padded into the layers of one array with a full mip chain, sampled with
+    // the GL defaults, and the outlines and scales of the parts
+    bool loadParts(const std::vector<std::string>& paths, const PartMeshes& meshes) {
+        int layers = paths.size();
+        std::vector<unsigned char*> images(layers);
+        std::vector<int> sizes(2 * layers);
+        int w = 0, h = 0;
+        bool ok = true;
+        for (int i = 0; i < layers; i++) {
+            int channels;
+            images[i] = stbi_load(paths[i].c_str(), &sizes[2 * i], &sizes[2 * i + 1], &channels, 4);
+            if (images[i] == NULL) {
+                std::cout << "ERROR::VULKAN::FILE_NOT_SUCCESFULLY_READ " << paths[i] << std::endl;
+                ok = false;
+                continue;
+            }
+            w = std::max(w, sizes[2 * i]);
+            h = std::max(h, sizes[2 * i + 1]);
+        }
+
+        // transparent padding around smaller parts
+        VkBuffer staging = VK_NULL_HANDLE;
+        VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
+        void* stagingData = NULL;
+        VkDeviceSize layerBytes = (VkDeviceSize)w * h * 4;
+        if (ok)
+            ok = createBuffer(layerBytes * layers, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, staging, stagingMemory, &stagingData);
+        if (ok) {
+            memset(stagingData, 0, layerBytes * layers);
+            for (int i = 0; i < layers; i++) {
+                for (int y = 0; y < sizes[2 * i + 1]; y++)
+                    memcpy((char*)stagingData + i * layerBytes + (VkDeviceSize)y * w * 4,
+                           images[i] + (size_t)y * sizes[2 * i] * 4, sizes[2 * i] * 4);
+            }
+        }
+        for (int i = 0; i < layers; i++) {
+            if (images[i] != NULL)
+                stbi_image_free(images[i]);
+        }
+
+        uint32_t levels = 1;
+        while ((std::max(w, h) >> levels) > 0)
+            levels++;
+        if (ok)
+            ok = createImage(w, h, levels, layers, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_VIEW_TYPE_2D_ARRAY,
+                             VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                             partImage, partMemory, partView);
+        if (ok)
+            ok = uploadParts(staging, w, h, levels, layers);
+        if (staging != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, staging, NULL);
+            vkFreeMemory(device, stagingMemory, NULL);
+        }
+        if (!ok)
+            return false;
+
+        // GL defaults of the part texture array: linear magnification, nearest texels from
+        // the two closest levels for minification
+        VkSamplerCreateInfo samplerInfo = {};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_LINEAR;
+        samplerInfo.minFilter = VK_FILTER_NEAREST;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.maxLod = (float)levels;
+        if (!check(vkCreateSampler(device, &samplerInfo, NULL, &sampler), "SAMPLER_NOT_CREATED"))
+            return false;
+
+        // std140 vec4 per outline vertex and per part scale
+        void* partData = NULL;
+        if (!createBuffer((layers * PART_MESH_VERTS + layers) * 4 * sizeof(float), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                          partBuffer, partBufferMemory, &partData))
+            return false;
+        float* data = (float*)partData;
+        for (int i = 0; i < layers * PART_MESH_VERTS; i++, data += 4) {
+            data[0] = meshes.vertices[2 * i];
+            data[1] = meshes.vertices[2 * i + 1];
+            data[2] = data[3] = 0.0f;
+        }
+        for (int i = 0; i < layers; i++, data += 4) {
+            data[0] = sizes[2 * i] / (float)w;
+            data[1] = sizes[2 * i + 1] / (float)h;
+            data[2] = data[3] = 0.0f;
+        }
+        return true;
+    }
+
+    // copy the padded layers into level 0 and blit each level down into the next
+    bool uploadParts(VkBuffer staging, int w, int h, uint32_t levels, uint32_t layers) {
+        VkCommandBufferAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+        VkCommandBuffer commands;
+        if (!check(vkAllocateCommandBuffers(device, &allocInfo, &commands), "COMMAND_BUFFER_NOT_ALLOCATED"))
+            return false;
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(commands, &beginInfo);
+
+        imageBarrier(commands, partImage, 0, levels, layers, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                     0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+        VkBufferImageCopy copy = {};
+        copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        copy.imageSubresource.layerCount = layers;
+        copy.imageExtent.width = w;
+        copy.imageExtent.height = h;
+        copy.imageExtent.depth = 1;
+        vkCmdCopyBufferToImage(commands, staging, partImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+
+        // linear blits halve like glGenerateMipmap, nearest ones where the format can't filter
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, VK_FORMAT_R8G8B8A8_UNORM, &formatProperties);
+        VkFilter filter = (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)
+                          ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+        for (uint32_t level = 1; level < levels; level++) {
+            imageBarrier(commands, partImage, level - 1, 1, layers,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                         VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+            VkImageBlit blit = {};
+            blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.srcSubresource.mipLevel = level - 1;
+            blit.srcSubresource.layerCount = layers;
+            blit.srcOffsets[1].x = std::max(w >> (level - 1), 1);
+            blit.srcOffsets[1].y = std::max(h >> (level - 1), 1);
+            blit.srcOffsets[1].z = 1;
+            blit.dstSubresource = blit.srcSubresource;
+            blit.dstSubresource.mipLevel = level;
+            blit.dstOffsets[1].x = std::max(w >> level, 1);
+            blit.dstOffsets[1].y = std::max(h >> level, 1);
+            blit.dstOffsets[1].z = 1;
+            vkCmdBlitImage(commands, partImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                           partImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, filter);
+        }
+        // every level but the last is a blit source by now
+        if (levels > 1)
+            imageBarrier(commands, partImage, 0, levels - 1, layers,
+                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                         VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+        imageBarrier(commands, partImage, levels - 1, 1, layers,
+                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                     VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+                     VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+        vkEndCommandBuffer(commands);
+
+        VkSubmitInfo submit = {};
+        submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit.commandBufferCount = 1;
+        submit.pCommandBuffers = &commands;
+        bool ok = check(vkQueueSubmit(queue, 1, &submit, VK_NULL_HANDLE), "SUBMIT_FAILED");
+        vkQueueWaitIdle(queue);
+        vkFreeCommandBuffers(device, commandPool, 1, &commands);
+        return ok;
+    }
+
+    bool loadShader(const std::string& path, VkShaderModule& module) {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file.is_open()) {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+            return false;
+        }
+        std::vector<uint32_t> code(((size_t)file.tellg() + 3) / 4);
+        file.seekg(0);
+        file.read((char*)code.data(), code.size() * 4);
+        VkShaderModuleCreateInfo info = {};
+        info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        info.codeSize = code.size() * 4;
+        info.pCode = code.data();
+        return check(vkCreateShaderModule(device, &info, NULL, &module), "SHADER_MODULE_NOT_CREATED");
+    }
+
+    // the instanced part pipeline: no vertex input, outline fans indexed by gl_VertexIndex,
+    // fixed viewport, no blending (fragments under the alpha threshold are discarded)
+    bool createPipeline(const std::string& vertexPath, const std::string& fragmentPath) {
+        VkDescriptorSetLayoutBinding bindings[3] = {};
+        bindings[0].binding = 0;
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        bindings[0].descriptorCount = 1;
+        bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        bindings[1].binding = 1;
+        bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        bindings[1].descriptorCount = 1;
+        bindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        bindings[2].binding = 2;
+        bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[2].descriptorCount = 1;
+        bindings[2].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        VkDescriptorSetLayoutCreateInfo setLayoutInfo = {};
+        setLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        setLayoutInfo.bindingCount = 3;
+        setLayoutInfo.pBindings = bindings;
+        if (!check(vkCreateDescriptorSetLayout(device, &setLayoutInfo, NULL, &descriptorSetLayout), "DESCRIPTOR_SET_LAYOUT_NOT_CREATED"))
+            return false;
+
+        VkDescriptorPoolSize poolSizes[3] = {{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1},
+                                             {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1},
+                                             {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1}};
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.maxSets = 1;
+        poolInfo.poolSizeCount = 3;
+        poolInfo.pPoolSizes = poolSizes;
+        if (!check(vkCreateDescriptorPool(device, &poolInfo, NULL, &descriptorPool), "DESCRIPTOR_POOL_NOT_CREATED"))
+            return false;
+        VkDescriptorSetAllocateInfo setInfo = {};
+        setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        setInfo.descriptorPool = descriptorPool;
+        setInfo.descriptorSetCount = 1;
+        setInfo.pSetLayouts = &descriptorSetLayout;
+        if (!check(vkAllocateDescriptorSets(device, &setInfo, &descriptorSet), "DESCRIPTOR_SET_NOT_ALLOCATED"))
+            return false;
+
+        VkDescriptorBufferInfo instanceInfo = {frameBuffer, 0, VULKAN_INSTANCE_BYTES};
+        VkDescriptorBufferInfo partInfo = {partBuffer, 0, VK_WHOLE_SIZE};
+        VkDescriptorImageInfo imageInfo = {sampler, partView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        VkWriteDescriptorSet writes[3] = {};
+        for (int i = 0; i < 3; i++) {
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = descriptorSet;
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = bindings[i].descriptorType;
+        }
+        writes[0].pBufferInfo = &instanceInfo;
+        writes[1].pBufferInfo = &partInfo;
+        writes[2].pImageInfo = &imageInfo;
+        vkUpdateDescriptorSets(device, 3, writes, 0, NULL);
+
+        // view size for the projection
+        VkPushConstantRange pushRange = {VK_SHADER_STAGE_VERTEX_BIT, 0, 2 * sizeof(float)};
+        VkPipelineLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        layoutInfo.setLayoutCount = 1;
+        layoutInfo.pSetLayouts = &descriptorSetLayout;
+        layoutInfo.pushConstantRangeCount = 1;
+        layoutInfo.pPushConstantRanges = &pushRange;
+        if (!check(vkCreatePipelineLayout(device, &layoutInfo, NULL, &pipelineLayout), "PIPELINE_LAYOUT_NOT_CREATED"))
+            return false;
+
+        VkShaderModule vertex = VK_NULL_HANDLE, fragment = VK_NULL_HANDLE;
+        if (!loadShader(vertexPath, vertex) || !loadShader(fragmentPath, fragment)) {
+            vkDestroyShaderModule(device, vertex, NULL);
+            return false;
+        }
+        VkPipelineShaderStageCreateInfo stages[2] = {};
+        stages[0].sType = stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+        stages[0].module = vertex;
+        stages[0].pName = "main";
+        stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        stages[1].module = fragment;
+        stages[1].pName = "main";
+
+        VkPipelineVertexInputStateCreateInfo vertexInput = {};
+        vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_FAN;
+        VkViewport viewport = {0.0f, 0.0f, (float)width, (float)height, 0.0f, 1.0f};
+        VkRect2D scissor = {{0, 0}, {(uint32_t)width, (uint32_t)height}};
+        VkPipelineViewportStateCreateInfo viewportState = {};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.pViewports = &viewport;
+        viewportState.scissorCount = 1;
+        viewportState.pScissors = &scissor;
+        VkPipelineRasterizationStateCreateInfo rasterization = {};
+        rasterization.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterization.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterization.cullMode = VK_CULL_MODE_NONE;
+        rasterization.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        rasterization.lineWidth = 1.0f;
+        VkPipelineMultisampleStateCreateInfo multisample = {};
+        multisample.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        VkPipelineColorBlendAttachmentState blendAttachment = {};
+        blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+                                         VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        VkPipelineColorBlendStateCreateInfo blend = {};
+        blend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        blend.attachmentCount = 1;
+        blend.pAttachments = &blendAttachment;
+
+        VkGraphicsPipelineCreateInfo pipelineInfo = {};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = 2;
+        pipelineInfo.pStages = stages;
+        pipelineInfo.pVertexInputState = &vertexInput;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterization;
+        pipelineInfo.pMultisampleState = &multisample;
+        pipelineInfo.pColorBlendState = &blend;
+        pipelineInfo.layout = pipelineLayout;
+        pipelineInfo.renderPass = renderPass;
+        pipelineInfo.subpass = 0;
+        bool ok = check(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &pipeline), "PIPELINE_NOT_CREATED");
+        vkDestroyShaderModule(device, vertex, NULL);
+        vkDestroyShaderModule(device, fragment, NULL);
+        return ok;
+    }
+
+    // the command buffers of every frame slot, recorded once and resubmitted each frame
+    bool recordCommands() {
+        VkCommandBuffer primaries[VULKAN_FRAMES_IN_FLIGHT], secondaries[VULKAN_FRAMES_IN_FLIGHT];
+        VkCommandBufferAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = VULKAN_FRAMES_IN_FLIGHT;
+        if (!check(vkAllocateCommandBuffers(device, &allocInfo, primaries), "COMMAND_BUFFER_NOT_ALLOCATED"))
+            return false;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        if (!check(vkAllocateCommandBuffers(device, &allocInfo, secondaries), "COMMAND_BUFFER_NOT_ALLOCATED"))
+            return false;
+
+        const float viewSize[2] = {(float)DISPLAY_WIDTH, (float)DISPLAY_HEIGHT};
+        for (int i = 0; i < VULKAN_FRAMES_IN_FLIGHT; i++) {
+            Frame& frame = frames[i];
+            frame.primary = primaries[i];
+            frame.secondary = secondaries[i];
+
+            // all instances of the slot in one indirect draw, its count is written per frame
+            VkCommandBufferInheritanceInfo inheritance = {};
+            inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+            inheritance.renderPass = renderPass;
+            inheritance.subpass = 0;
+            inheritance.framebuffer = frame.framebuffer;
+            VkCommandBufferBeginInfo beginInfo = {};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+            beginInfo.pInheritanceInfo = &inheritance;
+            vkBeginCommandBuffer(frame.secondary, &beginInfo);
+            vkCmdBindPipeline(frame.secondary, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+            uint32_t offset = i * frameStride;
+            vkCmdBindDescriptorSets(frame.secondary, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 1, &offset);
+            vkCmdPushConstants(frame.secondary, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(viewSize), viewSize);
+            vkCmdDrawIndirect(frame.secondary, frameBuffer, offset + VULKAN_INSTANCE_BYTES, 1, sizeof(VkDrawIndirectCommand));
+            if (!check(vkEndCommandBuffer(frame.secondary), "COMMAND_BUFFER_NOT_RECORDED"))
+                return false;
+
+            beginInfo.flags = 0;
+            beginInfo.pInheritanceInfo = NULL;
+            vkBeginCommandBuffer(frame.primary, &beginInfo);
+            VkClearValue clear;
+            clear.color.float32[0] = 0.2f;
+            clear.color.float32[1] = 0.3f;
+            clear.color.float32[2] = 0.3f;
+            clear.color.float32[3] = 1.0f;
+            VkRenderPassBeginInfo passInfo = {};
+            passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            passInfo.renderPass = renderPass;
+            passInfo.framebuffer = frame.framebuffer;
+            passInfo.renderArea.extent.width = width;
+            passInfo.renderArea.extent.height = height;
+            passInfo.clearValueCount = 1;
+            passInfo.pClearValues = &clear;
+            vkCmdBeginRenderPass(frame.primary, &passInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+            vkCmdExecuteCommands(frame.primary, 1, &frame.secondary);
+            vkCmdEndRenderPass(frame.primary);
+
+            if (copyBack) {
+                VkBufferImageCopy copy = {};
+                copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                copy.imageSubresource.layerCount = 1;
+                copy.imageExtent.width = width;
+                copy.imageExtent.height = height;
+                copy.imageExtent.depth = 1;
+                vkCmdCopyImageToBuffer(frame.primary, frame.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, frame.readback, 1, &copy);
+                // the copy is visible to the host once the fence is signalled
+                VkBufferMemoryBarrier barrier = {};
+                barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+                barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.buffer = frame.readback;
+                barrier.size = VK_WHOLE_SIZE;
+                vkCmdPipelineBarrier(frame.primary, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+                                     0, 0, NULL, 1, &barrier, 0, NULL);
+            }
+            if (!check(vkEndCommandBuffer(frame.primary), "COMMAND_BUFFER_NOT_RECORDED"))
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif